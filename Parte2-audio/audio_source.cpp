@@ -0,0 +1,363 @@
+#include "audio_source.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+std::uint16_t littleEndian16(const std::uint8_t *data)
+{
+    return static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+}
+
+std::uint32_t littleEndian32(const std::uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<std::uint32_t>(data[3]) << 24);
+}
+
+std::uint64_t littleEndian64(const std::uint8_t *data)
+{
+    return littleEndian32(data) | (static_cast<std::uint64_t>(littleEndian32(data + 4)) << 32);
+}
+
+// Samples are used in place, so the host has to share the file's byte order
+bool littleEndianHost()
+{
+    const std::uint16_t one = 1;
+    std::uint8_t first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+// Chunk ids are four letters, digits or spaces ("fmt ", "LIST", "ds64")
+bool plausibleChunkId(const std::uint8_t *id)
+{
+    return std::all_of(id, id + 4, [](std::uint8_t c) {
+        return c == ' ' || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+    });
+}
+
+// KSDATAFORMAT_SUBTYPE_PCM and _IEEE_FLOAT after their leading format tag
+const std::uint8_t pcmGuidTail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+const std::uint16_t formatPcm = 1;
+const std::uint16_t formatFloat = 3;
+}
+
+MappedWav::~MappedWav()
+{
+    close();
+}
+
+bool MappedWav::open(const std::string &path, std::string &error)
+{
+    close();
+    if (!littleEndianHost())
+    {
+        error = "Memory-mapped WAV files need a little-endian host";
+        return false;
+    }
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        error = "Failed to open " + path;
+        return false;
+    }
+    fileHandle = handle;
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(handle, &length) || length.QuadPart < 12)
+    {
+        error = "Not a WAV file: " + path;
+        close();
+        return false;
+    }
+    size = static_cast<std::size_t>(length.QuadPart);
+    mappingHandle = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle)
+        data = static_cast<const std::uint8_t *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+    {
+        error = "Failed to open " + path;
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size < 12)
+    {
+        ::close(descriptor);
+        error = "Not a WAV file: " + path;
+        return false;
+    }
+    size = static_cast<std::size_t>(status.st_size);
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // The mapping keeps the file alive on its own
+    ::close(descriptor);
+    if (mapping != MAP_FAILED)
+    {
+        data = static_cast<const std::uint8_t *>(mapping);
+        // The analysis walks the file front to back
+        madvise(mapping, size, MADV_SEQUENTIAL);
+    }
+#endif
+    if (!data)
+    {
+        error = "Failed to map " + path;
+        close();
+        return false;
+    }
+    if (!parse(error))
+    {
+        error += ": " + path;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedWav::close()
+{
+#ifdef _WIN32
+    if (data)
+        UnmapViewOfFile(data);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+    fileHandle = mappingHandle = nullptr;
+#else
+    if (data)
+        munmap(const_cast<std::uint8_t *>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+    rate = 0;
+    channels = bits = 0;
+    frames = 0;
+    samples = nullptr;
+}
+
+bool MappedWav::parse(std::string &error)
+{
+    bool rf64 = std::memcmp(data, "RF64", 4) == 0;
+    if ((std::memcmp(data, "RIFF", 4) != 0 && !rf64) || std::memcmp(data + 8, "WAVE", 4) != 0)
+    {
+        error = "Not a WAV file";
+        return false;
+    }
+
+    // The RIFF size is not trusted: chunks are walked up to the end of the file
+    std::uint64_t ds64DataSize = 0;
+    const std::uint8_t *format = nullptr;
+    std::uint32_t formatSize = 0;
+    std::size_t dataOffset = 0;
+    std::uint64_t dataSize = 0;
+    bool haveData = false;
+    std::size_t offset = 12;
+    while (size - offset >= 8)
+    {
+        const std::uint8_t *chunk = data + offset;
+        std::uint64_t chunkSize = littleEndian32(chunk + 4);
+        std::size_t body = offset + 8;
+        std::size_t available = size - body;
+
+        if (std::memcmp(chunk, "ds64", 4) == 0 && chunkSize >= 16 && available >= 16)
+            ds64DataSize = littleEndian64(chunk + 16);
+        else if (std::memcmp(chunk, "fmt ", 4) == 0 && chunkSize <= available)
+        {
+            format = chunk + 8;
+            formatSize = static_cast<std::uint32_t>(chunkSize);
+        }
+        else if (std::memcmp(chunk, "data", 4) == 0 && !haveData)
+        {
+            if (rf64 && chunkSize == 0xFFFFFFFFu)
+                chunkSize = ds64DataSize;
+            // 0 and 0xFFFFFFFF are left by writers that never came back to
+            // patch the header; a data chunk past the end of the file was cut
+            // short. Both mean the samples run to the end of the file.
+            if (chunkSize == 0 || chunkSize == 0xFFFFFFFFu || chunkSize > available)
+                chunkSize = available;
+            dataOffset = body;
+            dataSize = chunkSize;
+            haveData = true;
+        }
+        // Chunks are padded to an even size, but some writers leave the pad
+        // byte out; the next chunk id tells which one this file did
+        std::uint64_t next = body + chunkSize + (chunkSize & 1);
+        if ((chunkSize & 1) && next + 4 <= size && !plausibleChunkId(data + next) && plausibleChunkId(data + next - 1))
+            next--;
+        if (next > size)
+            break;
+        offset = static_cast<std::size_t>(next);
+    }
+
+    if (!format || formatSize < 16)
+    {
+        error = "WAV file has no format chunk";
+        return false;
+    }
+    if (!haveData)
+    {
+        error = "WAV file has no data chunk";
+        return false;
+    }
+
+    std::uint16_t formatTag = littleEndian16(format);
+    channels = littleEndian16(format + 2);
+    rate = littleEndian32(format + 4);
+    std::uint16_t blockAlign = littleEndian16(format + 12);
+    bits = littleEndian16(format + 14);
+    if (formatTag == 0xFFFE)
+    {
+        // WAVE_FORMAT_EXTENSIBLE: the real format is the sub-format GUID
+        if (formatSize < 40 || littleEndian16(format + 16) < 22 || std::memcmp(format + 26, pcmGuidTail, sizeof(pcmGuidTail)) != 0)
+        {
+            error = "WAV file is not PCM or float";
+            return false;
+        }
+        formatTag = littleEndian16(format + 24);
+    }
+    bool pcm = formatTag == formatPcm && (bits == 16 || bits == 24 || bits == 32);
+    bool ieee = formatTag == formatFloat && bits == 32;
+    if ((!pcm && !ieee) || channels == 0 || blockAlign != channels * bits / 8 || rate == 0)
+    {
+        error = "WAV file is not 16, 24 or 32-bit PCM or 32-bit float";
+        return false;
+    }
+    type = ieee ? SampleFormat::Float32 : bits == 16 ? SampleFormat::Int16 : SampleFormat::Int32;
+
+    frames = dataSize / blockAlign;
+    // May be misaligned for its type after an odd chunk: view() then refuses
+    // it and the samples are decoded byte by byte, block by block
+    samples = data + dataOffset;
+    return true;
+}
+
+// One loop per stored format, so the conversion is chosen once per call and
+// not per sample
+template <typename T>
+void MappedWav::decode(std::uint64_t first, std::size_t count, T *out) const
+{
+    std::size_t sampleBytes = bits / 8;
+    std::size_t total = count * channels;
+    const std::uint8_t *in = samples + first * channels * sampleBytes;
+    if (type == SampleFormat::Float32)
+    {
+        for (std::size_t i = 0; i < total; ++i)
+        {
+            float value;
+            std::memcpy(&value, in + 4 * i, 4);
+            out[i] = SampleTraits<T>::fromFloat(value);
+        }
+    }
+    else if (bits == 16)
+    {
+        for (std::size_t i = 0; i < total; ++i)
+            out[i] = SampleTraits<T>::fromInt32(static_cast<std::int16_t>(littleEndian16(in + 2 * i)) * 65536);
+    }
+    else if (bits == 24)
+    {
+        for (std::size_t i = 0; i < total; ++i)
+        {
+            const std::uint8_t *sample = in + 3 * i;
+            std::uint32_t value = (sample[0] << 8) | (sample[1] << 16) | (static_cast<std::uint32_t>(sample[2]) << 24);
+            out[i] = SampleTraits<T>::fromInt32(static_cast<std::int32_t>(value));
+        }
+    }
+    else
+    {
+        for (std::size_t i = 0; i < total; ++i)
+            out[i] = SampleTraits<T>::fromInt32(static_cast<std::int32_t>(littleEndian32(in + 4 * i)));
+    }
+}
+
+template void MappedWav::decode(std::uint64_t, std::size_t, sf::Int16 *) const;
+template void MappedWav::decode(std::uint64_t, std::size_t, std::int32_t *) const;
+template void MappedWav::decode(std::uint64_t, std::size_t, float *) const;
+
+
+bool AudioSource::open(const std::string &path, bool allowMapping)
+{
+    std::string error;
+    isMapped = allowMapping && wav.open(path, error);
+    position = 0;
+    if (isMapped)
+    {
+        rate = wav.sampleRate();
+        channels = wav.channelCount();
+        frames = wav.frameCount();
+        bits = wav.bitsPerSample();
+        format = wav.sampleFormat();
+        return true;
+    }
+
+    wav.close();
+    if (!file.openFromFile(path))
+        return false;
+    bits = 16;
+    format = SampleFormat::Int16;
+    rate = file.getSampleRate();
+    channels = file.getChannelCount();
+    frames = channels ? file.getSampleCount() / channels : 0;
+    return channels > 0;
+}
+
+template <typename T>
+BasicPcmView<T> AudioSource::read(std::uint64_t first, std::size_t count, std::vector<T> &buffer)
+{
+    BasicPcmView<T> view;
+    if (isMapped)
+    {
+        view = wav.view<T>();
+        if (view.samples)
+            return view.range(first, first + count);
+    }
+
+    view.channels = channels;
+    view.stride = channels;
+    first = std::min(first, frames);
+    count = static_cast<std::size_t>(std::min<std::uint64_t>(count, frames - first));
+    buffer.resize(count * channels);
+    view.samples = buffer.data();
+    if (isMapped)
+    {
+        wav.decode(first, count, buffer.data());
+        view.frames = count;
+        return view;
+    }
+
+    if (first != position)
+        file.seek(first * channels);
+    std::size_t got;
+    if constexpr (std::is_same_v<T, sf::Int16>)
+        got = static_cast<std::size_t>(file.read(buffer.data(), buffer.size()));
+    else
+    {
+        decoded.resize(buffer.size());
+        got = static_cast<std::size_t>(file.read(decoded.data(), decoded.size()));
+        for (std::size_t i = 0; i < got; ++i)
+            buffer[i] = SampleTraits<T>::fromInt32(decoded[i] * 65536);
+    }
+    view.frames = got / channels;
+    position = first + view.frames;
+    return view;
+}
+
+template BasicPcmView<sf::Int16> AudioSource::read(std::uint64_t, std::size_t, std::vector<sf::Int16> &);
+template BasicPcmView<std::int32_t> AudioSource::read(std::uint64_t, std::size_t, std::vector<std::int32_t> &);
+template BasicPcmView<float> AudioSource::read(std::uint64_t, std::size_t, std::vector<float> &);
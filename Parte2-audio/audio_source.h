@@ -0,0 +1,151 @@
+#ifndef AUDIO_SOURCE_H
+#define AUDIO_SOURCE_H
+
+#include <SFML/Audio.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sample_format.h"
+
+// Interleaved samples seen in place: sample c of frame i is at
+// samples[i * stride + c]. A view does not own its samples.
+template <typename T>
+struct BasicPcmView
+{
+    const T *samples = nullptr;
+    std::uint64_t frames = 0;
+    unsigned int channels = 0;
+    std::size_t stride = 0; // samples from one frame to the next
+
+    T at(std::uint64_t frame, unsigned int channel) const { return samples[frame * stride + channel]; }
+
+    // Frames [first, last), clipped to the view
+    BasicPcmView range(std::uint64_t first, std::uint64_t last) const
+    {
+        BasicPcmView view = *this;
+        first = std::min(first, frames);
+        last = std::clamp(last, first, frames);
+        view.samples = samples + first * stride;
+        view.frames = last - first;
+        return view;
+    }
+    // Channel c alone, as a one-channel view with the same stride
+    BasicPcmView channel(unsigned int c) const
+    {
+        BasicPcmView view = *this;
+        view.samples = samples + c;
+        view.channels = 1;
+        return view;
+    }
+    // Contiguous interleaved frames, as the block functions expect
+    bool packed() const { return stride == channels; }
+};
+
+using PcmView = BasicPcmView<sf::Int16>;
+
+// A WAV file mapped into memory, with its RIFF chunks parsed in place.
+// Handles WAVE_FORMAT_EXTENSIBLE, RF64, odd-sized chunks (with their pad
+// byte), chunks after the data, RIFF / data sizes that disagree with the file
+// length and data sizes left at 0 or 0xFFFFFFFF by streaming writers.
+// 16, 24 and 32-bit PCM and 32-bit float are mapped; open() fails for
+// anything else, so callers can fall back to SFML.
+class MappedWav
+{
+public:
+    MappedWav() = default;
+    ~MappedWav();
+    MappedWav(const MappedWav &) = delete;
+    MappedWav &operator=(const MappedWav &) = delete;
+
+    bool open(const std::string &path, std::string &error);
+    void close();
+
+    unsigned int sampleRate() const { return rate; }
+    unsigned int channelCount() const { return channels; }
+    std::uint64_t frameCount() const { return frames; }
+    unsigned int bitsPerSample() const { return bits; }
+    // The type the samples are analysed as: int16, int32 (24 and 32-bit) or float
+    SampleFormat sampleFormat() const { return type; }
+
+    // The samples in place when the file stores them as T (16-bit as int16,
+    // 32-bit PCM as int32, float as float); an empty view otherwise, such as
+    // for packed 24-bit samples or samples an odd chunk left misaligned
+    template <typename T = sf::Int16>
+    BasicPcmView<T> view() const
+    {
+        BasicPcmView<T> view;
+        if (SampleTraits<T>::format != type || bits != sizeof(T) * 8 || reinterpret_cast<std::uintptr_t>(samples) % alignof(T) != 0)
+            return view;
+        view.samples = reinterpret_cast<const T *>(samples);
+        view.frames = frames;
+        view.channels = view.stride = channels;
+        return view;
+    }
+
+    // Frames [first, first + count) converted to T; the range must be in the file
+    template <typename T>
+    void decode(std::uint64_t first, std::size_t count, T *out) const;
+
+private:
+    bool parse(std::string &error);
+
+    const std::uint8_t *data = nullptr;
+    std::size_t size = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+    unsigned int rate = 0;
+    unsigned int channels = 0;
+    unsigned int bits = 0;
+    SampleFormat type = SampleFormat::Int16;
+    std::uint64_t frames = 0;
+    const std::uint8_t *samples = nullptr;
+};
+
+// Frames of an audio file, read block by block as any sample type. WAV files
+// are memory-mapped: read as their own type they are handed out as views into
+// the mapping, without copying, and as any other type they are converted into
+// a caller-provided buffer. Every other file SFML can decode is streamed
+// through sf::InputSoundFile as 16-bit samples and converted when needed.
+class AudioSource
+{
+public:
+    // allowMapping = false always goes through SFML
+    bool open(const std::string &path, bool allowMapping = true);
+
+    bool mapped() const { return isMapped; }
+    unsigned int sampleRate() const { return rate; }
+    unsigned int channelCount() const { return channels; }
+    std::uint64_t frameCount() const { return frames; }
+    // Bits per sample of the file as decoded, and the type to analyse it as
+    unsigned int bitsPerSample() const { return bits; }
+    SampleFormat sampleFormat() const { return format; }
+
+    // Frames [first, first + count), clipped to the end of the file. Mapped
+    // files stored as T return a view into the mapping and leave buffer
+    // alone; otherwise the frames are read into buffer, which the view then
+    // points to. Defined for sf::Int16, std::int32_t and float.
+    template <typename T>
+    BasicPcmView<T> read(std::uint64_t first, std::size_t count, std::vector<T> &buffer);
+    // The whole file, mapped or read into buffer
+    template <typename T>
+    BasicPcmView<T> readAll(std::vector<T> &buffer) { return read(0, static_cast<std::size_t>(frames), buffer); }
+
+private:
+    MappedWav wav;
+    sf::InputSoundFile file;
+    bool isMapped = false;
+    unsigned int rate = 0;
+    unsigned int channels = 0;
+    std::uint64_t frames = 0;
+    unsigned int bits = 16;
+    SampleFormat format = SampleFormat::Int16;
+    std::uint64_t position = 0; // next frame of the SFML stream
+    std::vector<sf::Int16> decoded; // SFML samples on their way to a wider type
+};
+
+#endif
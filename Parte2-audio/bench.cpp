@@ -0,0 +1,923 @@
+#include <SFML/Audio.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <fstream>
+#include <filesystem>
+#include <type_traits>
+
+#include "audio_source.h"
+#include "channels.h"
+#include "correlation.h"
+#include "error_metrics.h"
+#include "fft.h"
+#include "fingerprint.h"
+#include "frame_features.h"
+#include "thread_pool.h"
+#include "waveform.h"
+#include "histogram.h"
+#include "plot_output.h"
+#include "lossless.h"
+#include "mdct.h"
+#include "quantize.h"
+#include "resampler.h"
+#include "sample_format.h"
+#include "signal_generator.h"
+#include "stft.h"
+
+// Times fn over several repetitions and returns the best run in seconds
+double timeBest(const std::function<void()> &fn, int repetitions = 5)
+{
+    double best = 1e30;
+    for (int r = 0; r < repetitions; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+void report(const std::string &name, std::size_t samples, double seconds)
+{
+    std::cout << std::left << std::setw(44) << name << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+              << samples / seconds / 1e6 << " Msamples/s" << std::endl;
+}
+
+// Deinterleave + normalize + mid/side: the original push_back loops against the kernel
+void benchDeinterleave(std::size_t frames)
+{
+    std::vector<sf::Int16> interleaved(frames * 2);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> dist(-32768, 32767);
+    for (auto &s : interleaved)
+        s = static_cast<sf::Int16>(dist(rng));
+
+    std::cout << "\nDeinterleave, " << frames << " stereo frames" << std::endl;
+
+    double legacy = timeBest([&]() {
+        std::vector<double> leftChannel;
+        std::vector<double> rightChannel;
+        for (std::size_t i = 0; i < interleaved.size(); i += 2)
+        {
+            leftChannel.push_back(static_cast<double>(interleaved[i]) / 32768.0);
+            rightChannel.push_back(static_cast<double>(interleaved[i + 1]) / 32768.0);
+        }
+        std::vector<double> midChannel(leftChannel.size());
+        std::vector<double> sideChannel(leftChannel.size());
+        for (std::size_t i = 0; i < leftChannel.size(); ++i)
+        {
+            midChannel[i] = (leftChannel[i] + rightChannel[i]) / 2.0;
+            sideChannel[i] = (leftChannel[i] - rightChannel[i]) / 2.0;
+        }
+    });
+    report("legacy push_back loops (double)", interleaved.size(), legacy);
+
+    std::vector<double> left(frames), right(frames), mid(frames), side(frames);
+    double *planes[2] = {left.data(), right.data()};
+    double kernel = timeBest([&]() { deinterleave(interleaved.data(), frames, 2, planes, mid.data(), side.data()); });
+    report("deinterleave<double> + mid/side", interleaved.size(), kernel);
+
+    std::vector<float> leftF(frames), rightF(frames), midF(frames), sideF(frames);
+    float *planesF[2] = {leftF.data(), rightF.data()};
+    double kernelF = timeBest([&]() { deinterleave(interleaved.data(), frames, 2, planesF, midF.data(), sideF.data()); });
+    report("deinterleave<float> + mid/side", interleaved.size(), kernelF);
+
+    // Generic path with more channels
+    for (unsigned int channelCount : {1u, 6u})
+    {
+        std::vector<sf::Int16> multi(frames * channelCount);
+        for (auto &s : multi)
+            s = static_cast<sf::Int16>(dist(rng));
+        std::vector<std::vector<float>> planeData(channelCount, std::vector<float>(frames));
+        std::vector<float *> multiPlanes;
+        for (auto &plane : planeData)
+            multiPlanes.push_back(plane.data());
+        double t = timeBest([&]() { deinterleave(multi.data(), frames, channelCount, multiPlanes.data(), midF.data(), sideF.data()); });
+        report("deinterleave<float> " + std::to_string(channelCount) + " channels", multi.size(), t);
+    }
+}
+
+// Quantization error metrics of a stereo signal against its 6-bit truncation:
+// deinterleaving to double planes and summing in double (the old path)
+// against the integer kernel on the int16 buffers, serial and on the pool
+void benchErrorMetrics(std::size_t frames)
+{
+    std::vector<sf::Int16> original(frames * 2), processed(frames * 2);
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> dist(-32768, 32767);
+    for (std::size_t i = 0; i < original.size(); ++i)
+    {
+        original[i] = static_cast<sf::Int16>(dist(rng));
+        processed[i] = static_cast<sf::Int16>(original[i] & ~1023);
+    }
+
+    std::cout << "\nError metrics, " << frames << " stereo frames" << std::endl;
+
+    double doubleSnr = 0.0;
+    double legacy = timeBest([&]() {
+        std::vector<double> left(frames), right(frames), quantizedLeft(frames), quantizedRight(frames);
+        double *planes[2] = {left.data(), right.data()};
+        double *quantizedPlanes[2] = {quantizedLeft.data(), quantizedRight.data()};
+        deinterleave(original.data(), frames, 2, planes);
+        deinterleave(processed.data(), frames, 2, quantizedPlanes);
+        double squaredError = 0.0, signalPower = 0.0;
+        for (std::size_t i = 0; i < frames; ++i)
+        {
+            double error = left[i] - quantizedLeft[i];
+            squaredError += error * error;
+            signalPower += left[i] * left[i];
+        }
+        doubleSnr = 10 * std::log10(signalPower / squaredError);
+    });
+    report("deinterleave + double sums (left only)", original.size(), legacy);
+
+    ErrorResult serialResult;
+    double serial = timeBest([&]() {
+        ErrorMetrics metrics(2);
+        metrics.feed(original.data(), processed.data(), frames);
+        serialResult = metrics.result(0);
+    });
+    report("ErrorMetrics, int64 sums + segmental", original.size(), serial);
+
+    ThreadPool pool;
+    double pooled = timeBest([&]() {
+        ErrorMetrics metrics(2);
+        metrics.feed(original.data(), processed.data(), frames, pool);
+    });
+    report("ErrorMetrics, " + std::to_string(pool.size()) + " threads", original.size(), pooled);
+    std::cout << "left SNR: double " << std::setprecision(12) << doubleSnr << " dB, integer " << serialResult.snr << " dB" << std::endl;
+}
+
+// Real-to-complex transforms: the built-in FFT against FFTW when it is available
+void benchFFT()
+{
+    std::cout << "\nReal FFT (time per transform, MFLOPS = 5 n log2(n) / t)" << std::endl;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+    for (std::size_t size : {256u, 1024u, 4096u, 16384u, 65536u, 44100u})
+    {
+        std::vector<double> signal(size);
+        for (double &s : signal)
+            s = dist(rng);
+        // Enough repetitions per timing for about 2^24 samples
+        int batch = static_cast<int>(std::max<std::size_t>(1, (1u << 24) / size));
+        double flops = 5.0 * size * std::log2(static_cast<double>(size));
+
+        auto run = [&](const std::string &name, auto &fft, auto &workspace) {
+            std::copy(signal.begin(), signal.end(), workspace.input());
+            double t = timeBest([&]() {
+                for (int i = 0; i < batch; ++i)
+                    fft.forward(workspace);
+            }) / batch;
+            std::cout << std::left << std::setw(28) << name + " n=" + std::to_string(size) << std::right << std::setw(10)
+                      << std::fixed << std::setprecision(2) << t * 1e6 << " us" << std::setw(12) << flops / t / 1e6 << " MFLOPS"
+                      << std::endl;
+        };
+
+        BuiltinRealFFT builtin(size);
+        BuiltinRealFFT::Workspace builtinWorkspace(size);
+        run("builtin", builtin, builtinWorkspace);
+#ifdef USE_FFT
+        RealFFT fftw(size);
+        RealFFT::Workspace fftwWorkspace(size);
+        run("fftw", fftw, fftwWorkspace);
+#endif
+    }
+}
+
+// Waveform overview: the old every-kth-sample decimation against the min / max pyramid
+void benchWaveform(std::size_t frames)
+{
+    std::vector<sf::Int16> interleaved(frames * 2);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> dist(-32768, 32767);
+    for (auto &s : interleaved)
+        s = static_cast<sf::Int16>(dist(rng));
+
+    std::cout << "\nWaveform overview, " << frames << " stereo frames" << std::endl;
+
+    double decimate = timeBest([&]() {
+        std::size_t factor = std::max<std::size_t>(1, frames / 10000);
+        std::vector<double> time, data;
+        for (std::size_t i = 0; i < frames; i += factor)
+        {
+            time.push_back(static_cast<double>(i) / 44100);
+            data.push_back(interleaved[i * 2] / 32768.0);
+        }
+    });
+    report("every-kth-sample decimation (skips samples)", frames, decimate);
+
+    std::vector<unsigned int> threadCounts = {1u};
+    if (std::thread::hardware_concurrency() > 1)
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    for (unsigned int threads : threadCounts)
+    {
+        ThreadPool pool(threads);
+        double build = timeBest([&]() {
+            WaveformPyramid pyramid(2, 44100);
+            for (std::size_t first = 0; first < frames; first += 65536)
+                pyramid.feed(interleaved.data() + first * 2, std::min<std::size_t>(65536, frames - first), pool);
+            pyramid.finish();
+        });
+        report("pyramid build, 2 channels, " + std::to_string(threads) + " threads", interleaved.size(), build);
+    }
+
+    ThreadPool pool(1);
+    WaveformPyramid pyramid(2, 44100);
+    pyramid.feed(interleaved.data(), frames, pool);
+    pyramid.finish();
+    double query = timeBest([&]() {
+        for (int i = 0; i < 100; ++i)
+            pyramid.envelope(0, frames / 7 * (i % 3), frames, 1800);
+    }) / 100;
+    std::cout << std::left << std::setw(44) << "envelope query, 1800 columns" << std::right << std::setw(10) << std::fixed
+              << std::setprecision(2) << query * 1e6 << " us" << std::endl;
+}
+
+// L / R / MID / SIDE histograms: per-value add() calls against the fused kernel
+void benchHistogram(std::size_t frames)
+{
+    std::vector<sf::Int16> interleaved(frames * 2);
+    std::mt19937 rng(11);
+    std::normal_distribution<double> dist(0.0, 4000.0);
+    for (auto &s : interleaved)
+        s = static_cast<sf::Int16>(std::clamp(dist(rng), -32768.0, 32767.0));
+
+    std::cout << "\nHistograms (L, R, MID, SIDE), " << frames << " stereo frames" << std::endl;
+
+    double perValue = timeBest([&]() {
+        std::vector<HistogramAccumulator> histograms(2, HistogramAccumulator(-32768, 32767, 1.0 / 32768.0));
+        HistogramAccumulator mid(-65536, 65534, 1.0 / 65536.0), side(-65535, 65535, 1.0 / 65536.0);
+        for (std::size_t i = 0; i < frames; ++i)
+        {
+            const sf::Int16 *frame = &interleaved[i * 2];
+            histograms[0].add(frame[0]);
+            histograms[1].add(frame[1]);
+            mid.add(frame[0] + frame[1]);
+            side.add(frame[0] - frame[1]);
+        }
+    });
+    report("per-value add() calls", interleaved.size(), perValue);
+
+    std::vector<unsigned int> threadCounts = {1u};
+    if (std::thread::hardware_concurrency() > 1)
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    for (unsigned int threads : threadCounts)
+    {
+        ThreadPool pool(threads);
+        double fused = timeBest([&]() {
+            ChannelHistograms histograms(2);
+            for (std::size_t first = 0; first < frames; first += 65536)
+                histograms.add(interleaved.data() + first * 2, std::min<std::size_t>(65536, frames - first), pool);
+            histograms.finish();
+        });
+        report("fused kernel, " + std::to_string(threads) + " threads", interleaved.size(), fused);
+    }
+}
+
+// Two-column CSV output: ofstream with setprecision(10) against CsvWriter
+void benchCsv(std::size_t rows)
+{
+    std::vector<double> x(rows), y(rows);
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+        x[i] = i / 44100.0;
+        y[i] = dist(rng);
+    }
+    std::string path = (std::filesystem::temp_directory_path() / "bench.csv").string();
+
+    std::cout << "\nCSV output, " << rows << " rows" << std::endl;
+
+    double stream = timeBest([&]() {
+        std::ofstream outfile(path);
+        outfile << std::setprecision(10);
+        for (std::size_t i = 0; i < rows; ++i)
+            outfile << x[i] << "," << y[i] << "\n";
+    }, 3);
+    std::cout << std::left << std::setw(44) << "ofstream << setprecision(10)" << std::right << std::setw(10) << std::fixed
+              << std::setprecision(2) << rows / stream / 1e6 << " Mrows/s" << std::endl;
+
+    double writer = timeBest([&]() {
+        CsvWriter outfile(path);
+        for (std::size_t i = 0; i < rows; ++i)
+            outfile.row(x[i], y[i]);
+    }, 3);
+    std::cout << std::left << std::setw(44) << "CsvWriter (to_chars)" << std::right << std::setw(10) << std::fixed
+              << std::setprecision(2) << rows / writer / 1e6 << " Mrows/s" << std::endl;
+    std::filesystem::remove(path);
+}
+
+// Band-limited stereo test signal: two tones plus noise
+std::vector<sf::Int16> toneSignal(std::size_t frames)
+{
+    std::vector<sf::Int16> interleaved(frames * 2);
+    std::mt19937 rng(23);
+    std::normal_distribution<double> noise(0.0, 60.0);
+    const double pi = 3.14159265358979323846;
+    for (std::size_t i = 0; i < frames; ++i)
+    {
+        double t = i / 44100.0;
+        double tone = 9000.0 * std::sin(2 * pi * 220.0 * t) + 4000.0 * std::sin(2 * pi * 1375.0 * t);
+        interleaved[2 * i] = static_cast<sf::Int16>(std::clamp(tone + noise(rng), -32768.0, 32767.0));
+        interleaved[2 * i + 1] = static_cast<sf::Int16>(std::clamp(0.8 * tone + noise(rng), -32768.0, 32767.0));
+    }
+    return interleaved;
+}
+
+// Lossless codec on the tone signal
+void benchLossless(std::size_t frames)
+{
+    std::vector<sf::Int16> interleaved = toneSignal(frames);
+    double bytes = interleaved.size() * sizeof(sf::Int16);
+
+    std::cout << "\nLossless codec, " << frames << " stereo frames" << std::endl;
+
+    std::vector<unsigned int> threadCounts = {1u};
+    if (std::thread::hardware_concurrency() > 1)
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    for (unsigned int threads : threadCounts)
+    {
+        ThreadPool pool(threads);
+        std::vector<std::uint8_t> encoded;
+        double encode = timeBest([&]() { encoded = encodeLossless(interleaved.data(), frames, 2, 44100, pool); }, 3);
+        LosslessAudio decoded;
+        double decode = timeBest([&]() { decodeLossless(encoded.data(), encoded.size(), decoded, pool); }, 3);
+        std::string suffix = ", " + std::to_string(threads) + " threads";
+        std::cout << std::left << std::setw(44) << "encode" + suffix << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+                  << bytes / encode / 1e6 << " MB/s (ratio " << std::setprecision(3) << bytes / encoded.size() << ")" << std::endl;
+        std::cout << std::left << std::setw(44) << "decode" + suffix << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+                  << bytes / decode / 1e6 << " MB/s" << (decoded.samples == interleaved ? "" : " (MISMATCH)") << std::endl;
+    }
+}
+
+// MDCT coder on the tone signal at 6 bits per sample, as a real-time factor
+void benchTransform(std::size_t frames)
+{
+    std::vector<sf::Int16> interleaved = toneSignal(frames);
+    double seconds = frames / 44100.0;
+
+    std::cout << "\nMDCT coder, " << frames << " stereo frames at 6 bits per sample" << std::endl;
+
+    ThreadPool pool;
+    std::vector<std::uint8_t> encoded;
+    double encode = timeBest([&]() { encoded = encodeTransform(interleaved.data(), frames, 2, 44100, pool); }, 3);
+    std::vector<sf::Int16> decoded;
+    unsigned int channels;
+    double decode = timeBest([&]() { decodeTransform(encoded.data(), encoded.size(), decoded, channels, pool); }, 3);
+    std::cout << std::left << std::setw(44) << "encode" << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+              << seconds / encode << "x real time" << std::endl;
+    std::cout << std::left << std::setw(44) << "decode" << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+              << seconds / decode << "x real time" << std::endl;
+}
+
+// Polyphase resampler between 44.1 and 48 kHz in 64k-frame blocks, as a
+// real-time factor of the input, with the measured response of its filter
+void benchResampler(std::size_t frames)
+{
+    std::cout << "\nResampler, " << frames << " stereo frames" << std::endl;
+
+    const unsigned int rates[][2] = {{44100, 48000}, {48000, 44100}};
+    const std::size_t blockFrames = 65536;
+    for (const auto &rate : rates)
+    {
+        std::vector<sf::Int16> interleaved = toneSignal(frames);
+        std::vector<sf::Int16> out;
+        std::size_t produced = 0;
+        double seconds = timeBest([&]() {
+            PolyphaseResampler resampler(rate[0], rate[1], 2);
+            produced = 0;
+            for (std::size_t first = 0; first < frames; first += blockFrames)
+                produced += resampler.process(interleaved.data() + first * 2, std::min(blockFrames, frames - first), out);
+            produced += resampler.flush(out);
+        }, 3);
+        PolyphaseResampler resampler(rate[0], rate[1], 2);
+        ResamplerQuality quality = resampler.measureQuality();
+        std::string name = std::to_string(rate[0]) + " -> " + std::to_string(rate[1]) + " Hz";
+        std::cout << std::left << std::setw(44) << name << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+                  << frames / static_cast<double>(rate[0]) / seconds << "x real time (" << resampler.phases() << " x "
+                  << resampler.tapsPerPhase() << " taps, ripple " << std::setprecision(5) << quality.passbandRippleDb << " dB, stopband "
+                  << std::setprecision(1) << quality.stopbandDb << " dB)"
+                  << (produced == resampler.outputFrames(frames) ? "" : " (LENGTH MISMATCH)") << std::endl;
+    }
+}
+
+// Frame features of a mono signal on top of the STFT that feeds them, at the
+// default 4096 / 1024 framing, single-threaded and on the whole pool
+void benchFeatures(std::size_t frames)
+{
+    std::vector<sf::Int16> interleaved = toneSignal(frames);
+    std::vector<double> mid(frames);
+    for (std::size_t i = 0; i < frames; ++i)
+        mid[i] = (interleaved[2 * i] + interleaved[2 * i + 1]) / 65536.0;
+    double seconds = frames / 44100.0;
+
+    std::cout << "\nFrame features, " << frames << " mono samples" << std::endl;
+
+    std::vector<unsigned int> threadCounts = {1u};
+    if (std::thread::hardware_concurrency() > 1)
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    for (unsigned int threads : threadCounts)
+    {
+        ThreadPool pool(threads);
+        StftConfig config;
+        std::uint64_t featureFrames = 0;
+        auto run = [&](bool features) {
+            StftEngine stft(config, pool);
+            FrameFeatures table(config, 44100, pool);
+            if (features)
+                stft.addFrameSink([&](std::uint64_t first, const double *samples, const float *rows, std::size_t n) {
+                    table.consume(first, samples, rows, n);
+                });
+            stft.feed(mid.data(), mid.size());
+            stft.finish();
+            featureFrames = table.frames();
+        };
+        double stftOnly = timeBest([&]() { run(false); }, 3);
+        double withFeatures = timeBest([&]() { run(true); }, 3);
+        std::string suffix = ", " + std::to_string(threads) + " threads";
+        std::cout << std::left << std::setw(44) << "stft" + suffix << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+                  << seconds / stftOnly << "x real time" << std::endl;
+        std::cout << std::left << std::setw(44) << "stft + features" + suffix << std::right << std::setw(10) << std::fixed
+                  << std::setprecision(2) << seconds / withFeatures << "x real time ("
+                  << featureFrames << " frames x " << FrameFeatures::columnNames().size() << " columns)" << std::endl;
+    }
+}
+
+// Landmark fingerprints of eight synthetic speech signals: fingerprinting as a
+// real-time factor, the index size per audio hour, and the lookup of a clip
+// cut from one of them
+void benchFingerprint(std::size_t frames)
+{
+    const unsigned int signals = 8;
+    const unsigned int sampleRate = 44100;
+    std::cout << "\nFingerprint index, " << signals << " x " << frames << " mono frames" << std::endl;
+
+    ThreadPool pool;
+    FingerprintIndex index;
+    std::vector<float> clip;
+    double fingerprintSeconds = 0.0;
+    for (unsigned int s = 0; s < signals; ++s)
+    {
+        SignalSpec spec;
+        spec.kind = SignalKind::Speech;
+        spec.channels = 1;
+        spec.seed = s + 1;
+        SignalGenerator generator(spec);
+        std::vector<std::int32_t> samples(frames);
+        generator.generate(samples.data(), frames);
+        std::vector<float> signal(frames);
+        for (std::size_t i = 0; i < frames; ++i)
+            signal[i] = samples[i] / 32768.0f;
+        if (s == signals / 2)
+            clip.assign(signal.begin() + frames / 3, signal.begin() + std::min(frames, frames / 3 + 5 * sampleRate));
+
+        std::vector<FingerprintHash> hashes;
+        fingerprintSeconds += timeBest([&]() {
+            Fingerprinter fingerprinter(sampleRate, pool);
+            fingerprinter.feed(signal.data(), signal.size());
+            fingerprinter.finish();
+            hashes = fingerprinter.hashes();
+        }, 1);
+        index.addFile("signal " + std::to_string(s), static_cast<double>(frames) / sampleRate, hashes);
+    }
+    index.build();
+
+    Fingerprinter fingerprinter(sampleRate, pool);
+    fingerprinter.feed(clip.data(), clip.size());
+    fingerprinter.finish();
+    std::vector<FingerprintMatch> matches;
+    double lookup = timeBest([&]() { matches = index.query(fingerprinter.hashes()); });
+
+    double audioHours = index.audioSeconds() / 3600.0;
+    bool found = !matches.empty() && matches[0].file == signals / 2;
+    std::cout << std::left << std::setw(44) << "fingerprint" << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+              << index.audioSeconds() / fingerprintSeconds << "x real time" << std::endl;
+    std::cout << std::left << std::setw(44) << "index size" << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+              << index.sizeBytes() / 1e6 / audioHours << " MB per audio hour (" << index.postingCount() << " landmarks)" << std::endl;
+    std::cout << std::left << std::setw(44) << "lookup of a 5 s clip" << std::right << std::setw(10) << std::fixed << std::setprecision(3)
+              << lookup * 1e3 << " ms" << (found ? "" : " (NOT FOUND)") << std::endl;
+}
+
+// Delay of R against L in 64k-frame blocks over +/- 10 ms, by FFT against
+// the direct sum over every lag
+void benchCorrelation(std::size_t frames)
+{
+    const std::size_t blockFrames = std::min<std::size_t>(65536, frames);
+    const std::size_t maxLag = 441;
+    const std::int64_t delay = 17;
+    std::vector<sf::Int16> interleaved = toneSignal(blockFrames + delay);
+    std::vector<float> left(blockFrames), right(blockFrames);
+    for (std::size_t i = 0; i < blockFrames; ++i)
+    {
+        left[i] = interleaved[2 * (i + delay)] / 32768.0f;
+        right[i] = interleaved[2 * i] / 32768.0f;
+    }
+
+    std::cout << "\nCross-correlation, " << blockFrames << " frames, lags +/- " << maxLag << std::endl;
+
+    CrossCorrelator correlator(blockFrames, maxLag);
+    DelayEstimate estimate;
+    double fft = timeBest([&]() { estimate = correlator.estimate(left.data(), right.data(), blockFrames); });
+    std::int64_t directLag = 0;
+    double direct = timeBest([&]() {
+        double best = 0.0;
+        for (std::int64_t lag = -static_cast<std::int64_t>(maxLag); lag <= static_cast<std::int64_t>(maxLag); ++lag)
+        {
+            double sum = 0.0;
+            for (std::size_t i = static_cast<std::size_t>(std::max<std::int64_t>(0, -lag));
+                 i < blockFrames && static_cast<std::int64_t>(i) + lag < static_cast<std::int64_t>(blockFrames); ++i)
+                sum += left[i] * right[i + lag];
+            if (std::abs(sum) > best)
+            {
+                best = std::abs(sum);
+                directLag = lag;
+            }
+        }
+    }, 1);
+    std::cout << std::left << std::setw(44) << "fft" << std::right << std::setw(10) << std::fixed << std::setprecision(3) << fft * 1e3
+              << " ms (lag " << estimate.lag << ")" << std::endl;
+    std::cout << std::left << std::setw(44) << "direct" << std::right << std::setw(10) << std::fixed << std::setprecision(3) << direct * 1e3
+              << " ms (lag " << directLag << ")" << std::endl;
+}
+
+// Every quantizer of every sample type, 6 bits kept, single-threaded, in
+// place and on the whole pool, against the original push_back shift loop
+template <typename T>
+void benchQuantizerType(const std::vector<T> &samples, const std::string &type, ThreadPool &pool)
+{
+    const int bitsToReduce = SampleTraits<T>::bits - 6;
+    std::vector<T> out(samples.size()), inPlace(samples);
+    for (QuantizerKind kind : quantizerKinds)
+    {
+        // The first call builds the int16 compander tables
+        quantizeAudio(samples.data(), out.data(), samples.size(), bitsToReduce, kind);
+        std::string name = type + " " + quantizerName(kind);
+        report(name, samples.size(), timeBest([&]() { quantizeAudio(samples.data(), out.data(), samples.size(), bitsToReduce, kind); }));
+        report(name + ", in place", samples.size(), timeBest([&]() { quantizeAudio(inPlace.data(), inPlace.data(), inPlace.size(), bitsToReduce, kind); }));
+        report(name + ", " + std::to_string(pool.size()) + " threads", samples.size(),
+               timeBest([&]() { quantizeAudio(samples.data(), out.data(), samples.size(), bitsToReduce, kind, 0, pool); }));
+    }
+}
+
+void benchQuantizers(std::size_t frames)
+{
+    std::vector<sf::Int16> interleaved = toneSignal(frames);
+    std::vector<std::int32_t> wide(interleaved.size());
+    std::vector<float> floats(interleaved.size());
+    for (std::size_t i = 0; i < interleaved.size(); ++i)
+    {
+        wide[i] = static_cast<std::int32_t>(interleaved[i]) * 65536;
+        floats[i] = interleaved[i] / 32768.0f;
+    }
+
+    std::cout << "\nQuantizers, " << frames << " stereo frames, 6 bits kept" << std::endl;
+
+    const int bitsToReduce = 10;
+    double legacy = timeBest([&]() {
+        std::vector<sf::Int16> quantized;
+        for (sf::Int16 sample : interleaved)
+            quantized.push_back(static_cast<sf::Int16>((sample >> bitsToReduce) << bitsToReduce));
+    });
+    report("int16 push_back shifts", interleaved.size(), legacy);
+
+    ThreadPool pool;
+    benchQuantizerType(interleaved, "int16", pool);
+    benchQuantizerType(wide, "int32", pool);
+    benchQuantizerType(floats, "float", pool);
+}
+
+// Time to load a WAV file and read all its samples: the old SoundBuffer path
+// (decode, then copy into a vector), streaming through sf::InputSoundFile,
+// and the memory-mapped parser, both up to the first sample and for a full
+// pass over the data. The file is in the page cache after the first run.
+void benchLoading(std::size_t frames)
+{
+    std::vector<sf::Int16> interleaved = toneSignal(frames);
+    std::string path = (std::filesystem::temp_directory_path() / "bench.wav").string();
+    {
+        sf::OutputSoundFile file;
+        if (!file.openFromFile(path, 44100, 2))
+            return;
+        file.write(interleaved.data(), interleaved.size());
+    }
+
+    std::cout << "\nWAV loading, " << frames << " stereo frames" << std::endl;
+    auto print = [](const std::string &name, double seconds) {
+        std::cout << std::left << std::setw(44) << name << std::right << std::setw(10) << std::fixed << std::setprecision(3)
+                  << seconds * 1e3 << " ms" << std::endl;
+    };
+    // Read samples go here so the reads are not optimised away
+    volatile long long checksum = 0;
+
+    print("sf::SoundBuffer + copy", timeBest([&]() {
+        sf::SoundBuffer buffer;
+        buffer.loadFromFile(path);
+        std::vector<sf::Int16> samples(buffer.getSamples(), buffer.getSamples() + buffer.getSampleCount());
+        checksum += samples.back();
+    }, 3));
+    print("sf::InputSoundFile, 65536-frame blocks", timeBest([&]() {
+        AudioSource source;
+        source.open(path, false);
+        std::vector<sf::Int16> block;
+        for (std::uint64_t first = 0; first < source.frameCount(); first += 65536)
+            checksum += source.read(first, 65536, block).at(0, 0);
+    }, 3));
+    print("MappedWav, open to first sample", timeBest([&]() {
+        MappedWav wav;
+        std::string error;
+        wav.open(path, error);
+        checksum += wav.view().at(0, 0);
+    }, 3));
+    print("MappedWav, open and touch every page", timeBest([&]() {
+        MappedWav wav;
+        std::string error;
+        wav.open(path, error);
+        PcmView view = wav.view();
+        // One sample per 4 KiB page
+        for (std::uint64_t i = 0; i < view.frames; i += 1024)
+            checksum += view.at(i, 0);
+    }, 3));
+    std::filesystem::remove(path);
+}
+
+// Pipeline suite: every configuration is generated block by block and run
+// through the stages of analyzeFile, each timed on its own
+struct SuiteOptions
+{
+    double seconds = 10.0;
+    std::vector<SignalKind> signals = {SignalKind::Sine, SignalKind::Noise, SignalKind::Silence, SignalKind::Speech};
+    std::vector<unsigned int> channels = {1, 2, 8};
+    std::vector<int> bits = {16, 24, 32};
+    unsigned int threads = std::thread::hardware_concurrency();
+    std::string jsonPath;
+};
+
+struct SuiteResult
+{
+    std::string signal;
+    unsigned int channels;
+    int bits;
+    std::string stage;
+    std::uint64_t samples; // interleaved input samples, the same for every stage
+    double seconds;
+};
+
+// Comma-separated list, each item converted by parse
+template <typename T, typename F>
+std::vector<T> parseList(const std::string &text, F parse)
+{
+    std::vector<T> items;
+    std::size_t start = 0;
+    while (start <= text.size())
+    {
+        std::size_t comma = std::min(text.find(',', start), text.size());
+        if (comma > start)
+            items.push_back(parse(text.substr(start, comma - start)));
+        start = comma + 1;
+    }
+    return items;
+}
+
+// Generated samples as the decoder hands them out: 16-bit ones as int16,
+// wider ones at the top of an int32
+template <typename T>
+void storeSamples(const std::int32_t *raw, T *out, std::size_t count, int bits)
+{
+    for (std::size_t i = 0; i < count; ++i)
+        out[i] = SampleTraits<T>::fromInt32(static_cast<std::int32_t>(static_cast<std::uint32_t>(raw[i]) << (32 - bits)));
+}
+
+// The stages of analyzeFile on samples of type T: quantization, metrics and
+// the split run on T, the histograms and the pyramid on the 16-bit values
+template <typename T>
+std::vector<SuiteResult> runConfiguration(const SignalSpec &spec, double seconds, ThreadPool &pool)
+{
+    constexpr bool int16Samples = std::is_same_v<T, sf::Int16>;
+    const std::size_t blockFrames = 65536;
+    const unsigned int channels = spec.channels;
+    std::uint64_t totalFrames = static_cast<std::uint64_t>(seconds * spec.sampleRate);
+
+    SignalGenerator generator(spec);
+    std::vector<std::int32_t> raw(blockFrames * channels);
+    std::vector<T> samples(blockFrames * channels), quantized(blockFrames * channels);
+    std::vector<sf::Int16> display(blockFrames * channels);
+    // Ten bits less than the generated depth
+    const int bitsToReduce = SampleTraits<T>::bits - spec.bits + 10;
+    std::vector<std::vector<double>> planes(channels, std::vector<double>(blockFrames));
+    std::vector<double *> planePointers;
+    for (auto &plane : planes)
+        planePointers.push_back(plane.data());
+    std::vector<double> mid(blockFrames);
+
+    ChannelHistograms histograms(channels);
+    BasicErrorMetrics<T> errors(channels);
+    WaveformPyramid pyramid(channels, spec.sampleRate);
+    StftEngine stft(StftConfig(), pool);
+    double spectrumSum = 0.0;
+    stft.addSink([&](std::uint64_t, const float *rows, std::size_t frames) { spectrumSum += rows[frames - 1]; });
+
+    const char *stageNames[] = {"convert", "split", "histogram", "quantize", "metrics", "fft", "waveform"};
+    const std::size_t stageCount = sizeof(stageNames) / sizeof(stageNames[0]);
+    double stageSeconds[stageCount] = {};
+    auto timed = [&](std::size_t stage, auto &&fn) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        stageSeconds[stage] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    for (std::uint64_t done = 0; done < totalFrames;)
+    {
+        std::size_t frames = static_cast<std::size_t>(std::min<std::uint64_t>(blockFrames, totalFrames - done));
+        std::size_t count = frames * channels;
+        generator.generate(raw.data(), frames);
+        storeSamples(raw.data(), samples.data(), count, spec.bits);
+
+        const sf::Int16 *displaySamples = display.data();
+        if constexpr (int16Samples)
+            displaySamples = samples.data();
+        else
+            timed(0, [&]() { convertToInt16(samples.data(), display.data(), count); });
+        timed(1, [&]() { deinterleave(samples.data(), frames, channels, planePointers.data(), mid.data()); });
+        timed(2, [&]() { histograms.add(displaySamples, frames, pool); });
+        timed(3, [&]() { quantizeAudio(samples.data(), quantized.data(), count, bitsToReduce); });
+        timed(4, [&]() { errors.feed(samples.data(), quantized.data(), frames, pool); });
+        timed(5, [&]() { stft.feed(mid.data(), frames); });
+        timed(6, [&]() { pyramid.feed(displaySamples, frames, pool); });
+        done += frames;
+    }
+
+    // End of file work: folding the histogram parts and the 64-bin binning
+    // that plotHistogram does, the last STFT frames, the last pyramid groups
+    timed(2, [&]() {
+        histograms.finish();
+        std::vector<double> centers;
+        std::vector<std::uint64_t> bins;
+        double width;
+        for (unsigned int c = 0; c < channels; ++c)
+            histograms.channel(c).binned(64, centers, bins, width);
+    });
+    timed(4, [&]() {
+        for (unsigned int c = 0; c < channels; ++c)
+            errors.result(c);
+    });
+    timed(5, [&]() { stft.finish(); });
+    timed(6, [&]() { pyramid.finish(); });
+
+    std::vector<SuiteResult> results;
+    for (std::size_t stage = 0; stage < stageCount; ++stage)
+    {
+        // 16-bit samples need no display copy
+        if (stage == 0 && int16Samples)
+            continue;
+        results.push_back({signalKindName(spec.kind), channels, spec.bits, stageNames[stage], totalFrames * channels, stageSeconds[stage]});
+    }
+    return results;
+}
+
+bool writeSuiteJson(const std::string &path, const SuiteOptions &options, unsigned int threads, const std::vector<SuiteResult> &results)
+{
+    std::filesystem::path file(path);
+    if (file.has_parent_path())
+        std::filesystem::create_directories(file.parent_path());
+    std::ofstream out(path);
+    if (!out)
+        return false;
+    out << std::setprecision(10);
+    out << "{\n  \"suite\": \"pipeline\",\n  \"sampleRate\": 44100,\n  \"blockFrames\": 65536,\n  \"threads\": " << threads
+        << ",\n  \"seconds\": " << options.seconds << ",\n  \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const SuiteResult &result = results[i];
+        out << (i ? "," : "") << "\n    {\"signal\": \"" << result.signal << "\", \"channels\": " << result.channels << ", \"bits\": "
+            << result.bits << ", \"stage\": \"" << result.stage << "\", \"samples\": " << result.samples << ", \"time\": "
+            << result.seconds << ", \"samplesPerSecond\": " << result.samples / result.seconds << "}";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+int runSuite(int argc, char *argv[])
+{
+    SuiteOptions options;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc)
+            options.seconds = std::stod(argv[++i]);
+        else if (arg == "--signals" && i + 1 < argc)
+        {
+            options.signals = parseList<SignalKind>(argv[++i], [](const std::string &name) {
+                SignalKind kind = SignalKind::Sine;
+                if (!parseSignalKind(name, kind))
+                    std::cerr << "Unknown signal '" << name << "', using sine" << std::endl;
+                return kind;
+            });
+        }
+        else if (arg == "--channels" && i + 1 < argc)
+            options.channels = parseList<unsigned int>(argv[++i], [](const std::string &n) { return static_cast<unsigned int>(std::clamp(std::stoi(n), 1, 8)); });
+        else if (arg == "--bits" && i + 1 < argc)
+        {
+            options.bits = parseList<int>(argv[++i], [](const std::string &n) {
+                int bits = std::stoi(n);
+                return bits <= 16 ? 16 : bits <= 24 ? 24 : 32;
+            });
+        }
+        else if (arg == "-j" && i + 1 < argc)
+            options.threads = std::stoul(argv[++i]);
+        else if (arg == "--json" && i + 1 < argc)
+            options.jsonPath = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " --suite [--seconds S] [--signals sine,noise,silence,speech] [--channels 1,2,8]"
+                      << " [--bits 16,24,32] [-j threads] [--json file]" << std::endl;
+            return 1;
+        }
+    }
+
+    ThreadPool pool(options.threads);
+    std::cout << "Pipeline suite, " << options.seconds << " s per configuration at 44100 Hz, " << pool.size() << " threads" << std::endl;
+    std::cout << std::left << std::setw(10) << "Signal" << std::right << std::setw(9) << "Channels" << std::setw(6) << "Bits" << "  "
+              << std::left << std::setw(12) << "Stage" << std::right << std::setw(14) << "Msamples/s" << std::endl;
+    std::vector<SuiteResult> results;
+    for (SignalKind kind : options.signals)
+    {
+        for (unsigned int channels : options.channels)
+        {
+            for (int bits : options.bits)
+            {
+                SignalSpec spec;
+                spec.kind = kind;
+                spec.channels = channels;
+                spec.bits = bits;
+                std::vector<SuiteResult> configuration = bits == 16 ? runConfiguration<sf::Int16>(spec, options.seconds, pool)
+                                                                    : runConfiguration<std::int32_t>(spec, options.seconds, pool);
+                for (const SuiteResult &result : configuration)
+                {
+                    std::cout << std::left << std::setw(10) << result.signal << std::right << std::setw(9) << result.channels << std::setw(6)
+                              << result.bits << "  " << std::left << std::setw(12) << result.stage << std::right << std::setw(14)
+                              << std::fixed << std::setprecision(2) << result.samples / result.seconds / 1e6 << std::defaultfloat << std::endl;
+                    results.push_back(result);
+                }
+            }
+        }
+    }
+
+    if (!options.jsonPath.empty())
+    {
+        if (!writeSuiteJson(options.jsonPath, options, pool.size(), results))
+        {
+            std::cerr << "Failed to write " << options.jsonPath << std::endl;
+            return 1;
+        }
+        std::cout << "Results written to " << options.jsonPath << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "--suite")
+        return runSuite(argc, argv);
+
+    std::size_t frames = 1 << 22;
+    if (argc > 1)
+    {
+        std::string count = argv[1];
+        bool digits = argc == 2 && !count.empty() && count.size() <= 12 && std::all_of(count.begin(), count.end(), [](char c) { return c >= '0' && c <= '9'; });
+        if (!digits || std::stoull(count) == 0)
+        {
+            std::cerr << "Usage: " << argv[0] << " [frames]\n"
+                      << "       " << argv[0] << " --suite [options]" << std::endl;
+            return 1;
+        }
+        frames = static_cast<std::size_t>(std::stoull(count));
+    }
+
+    benchDeinterleave(frames);
+    benchErrorMetrics(frames);
+    benchWaveform(frames);
+    benchHistogram(frames);
+    benchCsv(frames / 4);
+    benchLossless(frames);
+    benchTransform(frames);
+    benchResampler(frames);
+    benchFeatures(frames);
+    benchFingerprint(frames);
+    benchCorrelation(frames);
+    benchQuantizers(frames);
+    benchLoading(frames);
+    benchFFT();
+    return 0;
+}
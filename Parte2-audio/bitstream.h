@@ -0,0 +1,220 @@
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace detail
+{
+// Leading zero bits of a non-zero value
+inline unsigned int countLeadingZeros(std::uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return 63 - index;
+#else
+    return static_cast<unsigned int>(__builtin_clzll(value));
+#endif
+}
+}
+
+// Maps signed values to unsigned ones, small magnitudes first: 0, -1, 1, -2, ...
+inline std::uint32_t zigzagEncode(std::int32_t value)
+{
+    return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+}
+
+inline std::int32_t zigzagDecode(std::uint32_t value)
+{
+    return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1);
+}
+
+// Size of count Rice codes with parameter k whose values add up to sum. Exact
+// for the remainders, close for the unary parts (sum >> k rather than the sum
+// of every value >> k).
+inline std::uint64_t riceBits(std::uint64_t sum, std::size_t count, unsigned int k)
+{
+    return static_cast<std::uint64_t>(count) * (k + 1) + (sum >> k);
+}
+
+// Rice parameter (at most maxK) for count values adding up to sum
+inline unsigned int riceParameter(std::uint64_t sum, std::size_t count, unsigned int maxK = 30)
+{
+    unsigned int k = 0;
+    while (k < maxK && (static_cast<std::uint64_t>(count) << k) < sum)
+        ++k;
+    if (k > 0 && riceBits(sum, count, k - 1) <= riceBits(sum, count, k))
+        --k;
+    return k;
+}
+
+// MSB-first bit writer appending to a byte vector. Bits collect in a 64-bit
+// accumulator and leave it 32 at a time, so a put is a shift, an or and, every
+// few calls, one 4-byte store.
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<std::uint8_t> &out) : out(out) {}
+
+    // Writes the low `bits` bits of value (bits <= 32, higher bits must be zero)
+    void put(std::uint32_t value, unsigned int bits)
+    {
+        accumulator = (accumulator << bits) | value;
+        count += bits;
+        if (count >= 32)
+        {
+            count -= 32;
+            std::uint32_t word = static_cast<std::uint32_t>(accumulator >> count);
+            std::size_t at = out.size();
+            out.resize(at + 4);
+            out[at] = static_cast<std::uint8_t>(word >> 24);
+            out[at + 1] = static_cast<std::uint8_t>(word >> 16);
+            out[at + 2] = static_cast<std::uint8_t>(word >> 8);
+            out[at + 3] = static_cast<std::uint8_t>(word);
+        }
+    }
+
+    // Two's complement value in `bits` bits
+    void putSigned(std::int32_t value, unsigned int bits)
+    {
+        put(static_cast<std::uint32_t>(value) & mask(bits), bits);
+    }
+
+    // Rice code of an unsigned value: value >> k in unary (zeros ended by a one),
+    // then the low k bits
+    void putRice(std::uint32_t value, unsigned int k)
+    {
+        std::uint32_t quotient = value >> k;
+        while (quotient >= 32)
+        {
+            put(0, 32);
+            quotient -= 32;
+        }
+        if (quotient + 1 + k <= 32)
+        {
+            put((1u << k) | (value & mask(k)), quotient + 1 + k);
+        }
+        else
+        {
+            put(1, quotient + 1);
+            put(value & mask(k), k);
+        }
+    }
+
+    // Pads the last byte with zero bits and writes out whatever is buffered
+    void flush()
+    {
+        while (count >= 8)
+        {
+            count -= 8;
+            out.push_back(static_cast<std::uint8_t>(accumulator >> count));
+        }
+        if (count > 0)
+            out.push_back(static_cast<std::uint8_t>(accumulator << (8 - count)));
+        count = 0;
+    }
+
+private:
+    static std::uint32_t mask(unsigned int bits) { return bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1; }
+
+    std::vector<std::uint8_t> &out;
+    std::uint64_t accumulator = 0;
+    unsigned int count = 0; // bits waiting in the low end of the accumulator
+};
+
+// MSB-first reader for BitWriter streams. Refills take eight bytes at a time
+// while they are available; reading past the end yields zero bits and sets
+// overrun(), so a truncated stream cannot read out of bounds.
+class BitReader
+{
+public:
+    BitReader(const std::uint8_t *data, std::size_t size) : data(data), size(size) {}
+
+    // Next `bits` bits (1 <= bits <= 32) as an unsigned value
+    std::uint32_t get(unsigned int bits)
+    {
+        if (count < bits)
+            refill();
+        count -= bits;
+        return static_cast<std::uint32_t>(accumulator >> count) & (bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1);
+    }
+
+    std::int32_t getSigned(unsigned int bits)
+    {
+        std::uint32_t value = get(bits);
+        std::uint32_t sign = 1u << (bits - 1);
+        return static_cast<std::int32_t>((value ^ sign) - sign);
+    }
+
+    // Zero bits before the next one bit, which is consumed
+    std::uint32_t getUnary()
+    {
+        std::uint32_t zeros = 0;
+        for (;;)
+        {
+            if (count == 0 || (accumulator << (64 - count)) == 0)
+            {
+                zeros += count;
+                count = 0;
+                if (position >= size)
+                {
+                    // No terminating one before the end of the data
+                    exhausted = true;
+                    return zeros;
+                }
+                refill();
+                continue;
+            }
+            unsigned int run = detail::countLeadingZeros(accumulator << (64 - count));
+            count -= run + 1;
+            return zeros + run;
+        }
+    }
+
+    std::uint32_t getRice(unsigned int k)
+    {
+        std::uint32_t quotient = getUnary();
+        return k ? (quotient << k) | get(k) : quotient;
+    }
+
+    // True once bits past the end of the data were consumed
+    bool overrun() const { return exhausted || (position > size && (position - size) * 8 > count); }
+
+private:
+    // Tops the accumulator up to at least 56 bits
+    void refill()
+    {
+        unsigned int bytes = (63 - count) >> 3;
+        if (position + 8 <= size)
+        {
+            std::uint64_t word = 0;
+            for (int b = 0; b < 8; ++b)
+                word = (word << 8) | data[position + b];
+            accumulator = (accumulator << (bytes * 8)) | (word >> (64 - bytes * 8));
+            position += bytes;
+            count += bytes * 8;
+            return;
+        }
+        for (; bytes > 0; --bytes)
+        {
+            accumulator = (accumulator << 8) | (position < size ? data[position] : 0);
+            position++;
+            count += 8;
+        }
+    }
+
+    const std::uint8_t *data;
+    std::size_t size;
+    std::size_t position = 0;
+    std::uint64_t accumulator = 0;
+    unsigned int count = 0; // unread bits in the low end of the accumulator
+    bool exhausted = false;
+};
+
+#endif
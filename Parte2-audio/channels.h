@@ -0,0 +1,153 @@
+#ifndef CHANNELS_H
+#define CHANNELS_H
+
+#include <SFML/Config.hpp>
+#include <algorithm>
+#include <cstddef>
+
+#include "sample_format.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHANNELS_USE_SSE2
+#endif
+
+namespace detail
+{
+// Scalar version of one stereo frame, also used for the tail of the SIMD loops
+template <typename T, typename S>
+inline void deinterleaveStereoFrame(const S *frame, T *left, T *right, T *mid, T *side, std::size_t i)
+{
+    T l = static_cast<T>(frame[0]) * static_cast<T>(SampleTraits<S>::scale);
+    T r = static_cast<T>(frame[1]) * static_cast<T>(SampleTraits<S>::scale);
+    left[i] = l;
+    right[i] = r;
+    if (mid)
+        mid[i] = (l + r) / 2;
+    if (side)
+        side[i] = (l - r) / 2;
+}
+
+template <typename T, typename S>
+inline void deinterleaveStereo(const S *in, std::size_t frames, T *left, T *right, T *mid, T *side)
+{
+    for (std::size_t i = 0; i < frames; ++i)
+        deinterleaveStereoFrame(in + 2 * i, left, right, mid, side, i);
+}
+
+#ifdef CHANNELS_USE_SSE2
+// Sign-extends the low / high four int16 lanes of v to int32
+inline __m128i widenLow(__m128i v) { return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); }
+inline __m128i widenHigh(__m128i v) { return _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16); }
+
+// Four frames per iteration: [L0 R0 L1 R1 L2 R2 L3 R3] -> [L0 L1 L2 L3], [R0 R1 R2 R3]
+template <>
+inline void deinterleaveStereo<float, sf::Int16>(const sf::Int16 *in, std::size_t frames, float *left, float *right, float *mid, float *side)
+{
+    const __m128 scale = _mm_set1_ps(static_cast<float>(int16Scale));
+    const __m128 half = _mm_set1_ps(0.5f);
+    std::size_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * i));
+        __m128 lo = _mm_cvtepi32_ps(widenLow(v));
+        __m128 hi = _mm_cvtepi32_ps(widenHigh(v));
+        __m128 l = _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)), scale);
+        __m128 r = _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)), scale);
+        _mm_storeu_ps(left + i, l);
+        _mm_storeu_ps(right + i, r);
+        if (mid)
+            _mm_storeu_ps(mid + i, _mm_mul_ps(_mm_add_ps(l, r), half));
+        if (side)
+            _mm_storeu_ps(side + i, _mm_mul_ps(_mm_sub_ps(l, r), half));
+    }
+    for (; i < frames; ++i)
+        deinterleaveStereoFrame(in + 2 * i, left, right, mid, side, i);
+}
+
+template <>
+inline void deinterleaveStereo<double, sf::Int16>(const sf::Int16 *in, std::size_t frames, double *left, double *right, double *mid, double *side)
+{
+    const __m128d scale = _mm_set1_pd(int16Scale);
+    const __m128d half = _mm_set1_pd(0.5);
+    std::size_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * i));
+        // [L0 R0 L1 R1] -> [L0 L1 R0 R1], same for frames 2 and 3
+        __m128i lo = _mm_shuffle_epi32(widenLow(v), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i hi = _mm_shuffle_epi32(widenHigh(v), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128d l0 = _mm_mul_pd(_mm_cvtepi32_pd(lo), scale);
+        __m128d r0 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(lo, lo)), scale);
+        __m128d l1 = _mm_mul_pd(_mm_cvtepi32_pd(hi), scale);
+        __m128d r1 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(hi, hi)), scale);
+        _mm_storeu_pd(left + i, l0);
+        _mm_storeu_pd(left + i + 2, l1);
+        _mm_storeu_pd(right + i, r0);
+        _mm_storeu_pd(right + i + 2, r1);
+        if (mid)
+        {
+            _mm_storeu_pd(mid + i, _mm_mul_pd(_mm_add_pd(l0, r0), half));
+            _mm_storeu_pd(mid + i + 2, _mm_mul_pd(_mm_add_pd(l1, r1), half));
+        }
+        if (side)
+        {
+            _mm_storeu_pd(side + i, _mm_mul_pd(_mm_sub_pd(l0, r0), half));
+            _mm_storeu_pd(side + i + 2, _mm_mul_pd(_mm_sub_pd(l1, r1), half));
+        }
+    }
+    for (; i < frames; ++i)
+        deinterleaveStereoFrame(in + 2 * i, left, right, mid, side, i);
+}
+#endif
+} // namespace detail
+
+// Splits interleaved frames into one preallocated plane per channel,
+// normalized to [-1, 1). int16 stereo, the common case, has SSE2 kernels.
+// When mid / side are given they are filled in the same pass from the first
+// two channels ((L + R) / 2 and (L - R) / 2); a mono file has mid equal to its
+// only channel and a silent side.
+template <typename T, typename S>
+void deinterleave(const S *interleaved, std::size_t frames, unsigned int channelCount, T *const *planes, T *mid = nullptr, T *side = nullptr)
+{
+    if (channelCount == 2)
+    {
+        detail::deinterleaveStereo(interleaved, frames, planes[0], planes[1], mid, side);
+        return;
+    }
+
+    const T scale = static_cast<T>(SampleTraits<S>::scale);
+    if (channelCount == 1)
+    {
+        for (std::size_t i = 0; i < frames; ++i)
+            planes[0][i] = static_cast<T>(interleaved[i]) * scale;
+        if (mid)
+            std::copy(planes[0], planes[0] + frames, mid);
+        if (side)
+            std::fill(side, side + frames, T(0));
+        return;
+    }
+
+    // Work in tiles so the strided reads of every channel hit the same cache lines
+    const std::size_t tile = 1024;
+    for (std::size_t start = 0; start < frames; start += tile)
+    {
+        std::size_t end = std::min(frames, start + tile);
+        for (unsigned int c = 0; c < channelCount; ++c)
+        {
+            const S *in = interleaved + c;
+            T *out = planes[c];
+            for (std::size_t i = start; i < end; ++i)
+                out[i] = static_cast<T>(in[i * channelCount]) * scale;
+        }
+        for (std::size_t i = start; i < end; ++i)
+        {
+            if (mid)
+                mid[i] = (planes[0][i] + planes[1][i]) / 2;
+            if (side)
+                side[i] = (planes[0][i] - planes[1][i]) / 2;
+        }
+    }
+}
+
+#endif
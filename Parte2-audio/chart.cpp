@@ -0,0 +1,546 @@
+#include "chart.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <memory>
+
+#include "plot_output.h"
+#include "thread_pool.h"
+
+namespace
+{
+// 5x7 ASCII font (32 - 126), one byte per column, least significant bit on top;
+// bit 7 holds the descender row
+const std::uint8_t font[95][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14},
+    {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62}, {0x36, 0x49, 0x56, 0x20, 0x50}, {0x00, 0x08, 0x07, 0x03, 0x00},
+    {0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x2A, 0x1C, 0x7F, 0x1C, 0x2A}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+    {0x00, 0x80, 0x70, 0x30, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x00, 0x60, 0x60, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},
+    {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00}, {0x72, 0x49, 0x49, 0x49, 0x46}, {0x21, 0x41, 0x49, 0x4D, 0x33},
+    {0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x31}, {0x41, 0x21, 0x11, 0x09, 0x07},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x46, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x00, 0x14, 0x00, 0x00}, {0x00, 0x40, 0x34, 0x00, 0x00},
+    {0x00, 0x08, 0x14, 0x22, 0x41}, {0x14, 0x14, 0x14, 0x14, 0x14}, {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x59, 0x09, 0x06},
+    {0x3E, 0x41, 0x5D, 0x59, 0x4E}, {0x7C, 0x12, 0x11, 0x12, 0x7C}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+    {0x7F, 0x41, 0x41, 0x41, 0x3E}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x41, 0x51, 0x73},
+    {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00}, {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41},
+    {0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x1C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x26, 0x49, 0x49, 0x49, 0x32},
+    {0x03, 0x01, 0x7F, 0x01, 0x03}, {0x3F, 0x40, 0x40, 0x40, 0x3F}, {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F},
+    {0x63, 0x14, 0x08, 0x14, 0x63}, {0x03, 0x04, 0x78, 0x04, 0x03}, {0x61, 0x59, 0x49, 0x4D, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x41},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x41, 0x7F}, {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},
+    {0x00, 0x03, 0x07, 0x08, 0x00}, {0x20, 0x54, 0x54, 0x78, 0x40}, {0x7F, 0x28, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x28},
+    {0x38, 0x44, 0x44, 0x28, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18}, {0x00, 0x08, 0x7E, 0x09, 0x02}, {0x18, 0xA4, 0xA4, 0x9C, 0x78},
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x40, 0x3D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00},
+    {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x78, 0x04, 0x78}, {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},
+    {0xFC, 0x18, 0x24, 0x24, 0x18}, {0x18, 0x24, 0x24, 0x18, 0xFC}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x24},
+    {0x04, 0x04, 0x3F, 0x44, 0x24}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C},
+    {0x44, 0x28, 0x10, 0x28, 0x44}, {0x4C, 0x90, 0x90, 0x90, 0x7C}, {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},
+    {0x00, 0x00, 0x77, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00}, {0x02, 0x01, 0x02, 0x04, 0x02}};
+
+const int glyphAdvance = 6;
+const int glyphHeight = 8;
+
+struct Rgb
+{
+    std::uint8_t r, g, b;
+};
+
+// gnuplot's default linetype colours
+const Rgb palette[] = {{148, 0, 211}, {0, 158, 115}, {86, 180, 233}, {230, 159, 0}, {240, 228, 66}, {0, 114, 178}, {229, 30, 16}};
+const Rgb black = {0, 0, 0};
+const Rgb gridGrey = {190, 190, 190};
+
+// RGBA pixel buffer with alpha blending and an optional clip rectangle
+class Canvas
+{
+public:
+    Canvas(unsigned int width, unsigned int height) : width(width), height(height), pixels(static_cast<std::size_t>(width) * height * 4, 255)
+    {
+        resetClip();
+    }
+
+    void resetClip()
+    {
+        clipX0 = 0;
+        clipY0 = 0;
+        clipX1 = static_cast<int>(width);
+        clipY1 = static_cast<int>(height);
+    }
+
+    void setClip(int x0, int y0, int x1, int y1)
+    {
+        clipX0 = std::max(0, x0);
+        clipY0 = std::max(0, y0);
+        clipX1 = std::min(static_cast<int>(width), x1);
+        clipY1 = std::min(static_cast<int>(height), y1);
+    }
+
+    void blend(int x, int y, Rgb colour, double alpha)
+    {
+        if (x < clipX0 || y < clipY0 || x >= clipX1 || y >= clipY1 || alpha <= 0.0)
+            return;
+        alpha = std::min(alpha, 1.0);
+        std::uint8_t *p = &pixels[(static_cast<std::size_t>(y) * width + x) * 4];
+        p[0] = static_cast<std::uint8_t>(p[0] + (colour.r - p[0]) * alpha + 0.5);
+        p[1] = static_cast<std::uint8_t>(p[1] + (colour.g - p[1]) * alpha + 0.5);
+        p[2] = static_cast<std::uint8_t>(p[2] + (colour.b - p[2]) * alpha + 0.5);
+    }
+
+    void fillRect(int x0, int y0, int x1, int y1, Rgb colour, double alpha = 1.0)
+    {
+        for (int y = std::max(y0, clipY0); y < std::min(y1, clipY1); ++y)
+            for (int x = std::max(x0, clipX0); x < std::min(x1, clipX1); ++x)
+                blend(x, y, colour, alpha);
+    }
+
+    // Anti-aliased line (Xiaolin Wu)
+    void line(double x0, double y0, double x1, double y1, Rgb colour, double alpha = 1.0)
+    {
+        bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+        if (steep)
+        {
+            std::swap(x0, y0);
+            std::swap(x1, y1);
+        }
+        if (x0 > x1)
+        {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+        double dx = x1 - x0;
+        double gradient = dx == 0.0 ? 1.0 : (y1 - y0) / dx;
+        auto plot = [&](int x, int y, double coverage) {
+            if (steep)
+                blend(y, x, colour, coverage * alpha);
+            else
+                blend(x, y, colour, coverage * alpha);
+        };
+
+        int xStart = static_cast<int>(std::round(x0));
+        int xEnd = static_cast<int>(std::round(x1));
+        double y = y0 + gradient * (xStart - x0);
+        for (int x = xStart; x <= xEnd; ++x, y += gradient)
+        {
+            int yi = static_cast<int>(std::floor(y));
+            double frac = y - yi;
+            plot(x, yi, 1.0 - frac);
+            plot(x, yi + 1, frac);
+        }
+    }
+
+    void text(int x, int y, const std::string &value, Rgb colour)
+    {
+        for (char ch : value)
+        {
+            int index = static_cast<unsigned char>(ch) - 32;
+            if (index >= 0 && index < 95)
+            {
+                for (int column = 0; column < 5; ++column)
+                    for (int row = 0; row < glyphHeight; ++row)
+                        if (font[index][column] & (1 << row))
+                            blend(x + column, y + row, colour, 1.0);
+            }
+            x += glyphAdvance;
+        }
+    }
+
+    // Text rotated 90 degrees counter-clockwise, read from bottom to top starting at (x, y)
+    void textVertical(int x, int y, const std::string &value, Rgb colour)
+    {
+        for (char ch : value)
+        {
+            int index = static_cast<unsigned char>(ch) - 32;
+            if (index >= 0 && index < 95)
+            {
+                for (int column = 0; column < 5; ++column)
+                    for (int row = 0; row < glyphHeight; ++row)
+                        if (font[index][column] & (1 << row))
+                            blend(x + row, y - column, colour, 1.0);
+            }
+            y -= glyphAdvance;
+        }
+    }
+
+    sf::Image image() const
+    {
+        sf::Image result;
+        result.create(width, height, pixels.data());
+        return result;
+    }
+
+private:
+    unsigned int width, height;
+    std::vector<std::uint8_t> pixels;
+    int clipX0, clipY0, clipX1, clipY1;
+};
+
+int textWidth(const std::string &value)
+{
+    return static_cast<int>(value.size()) * glyphAdvance - 1;
+}
+
+// Tick spacing of 1, 2 or 5 times a power of ten giving about `target` ticks
+double tickStep(double span, int target)
+{
+    double raw = span / target;
+    double magnitude = std::pow(10.0, std::floor(std::log10(raw)));
+    double fraction = raw / magnitude;
+    if (fraction < 1.5)
+        return magnitude;
+    if (fraction < 3.5)
+        return 2.0 * magnitude;
+    if (fraction < 7.5)
+        return 5.0 * magnitude;
+    return 10.0 * magnitude;
+}
+
+std::string tickLabel(double value, double step)
+{
+    if (std::abs(value) < step * 1e-6)
+        value = 0.0;
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%g", value);
+    return buffer;
+}
+
+// Widens [lo, hi] to whole ticks, as gnuplot's autoscale does
+void autoscale(double &lo, double &hi, int target)
+{
+    if (!(hi > lo))
+    {
+        double pad = lo == 0.0 ? 1.0 : std::abs(lo) * 0.1;
+        lo -= pad;
+        hi += pad;
+    }
+    double step = tickStep(hi - lo, target);
+    lo = std::floor(lo / step + 1e-9) * step;
+    hi = std::ceil(hi / step - 1e-9) * step;
+}
+
+ThreadPool &chartPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+}
+
+Chart::Chart(unsigned int width, unsigned int height, std::string title, std::string xlabel, std::string ylabel)
+    : width(width), height(height), title(std::move(title)), xlabel(std::move(xlabel)), ylabel(std::move(ylabel))
+{
+}
+
+void Chart::setXRange(double min, double max)
+{
+    fixedX = true;
+    xMin = min;
+    xMax = max;
+}
+
+void Chart::setYRange(double min, double max)
+{
+    fixedY = true;
+    yMin = min;
+    yMax = max;
+}
+
+void Chart::setYMin(double min)
+{
+    fixedYMin = true;
+    yMin = min;
+}
+
+void Chart::addLines(std::vector<double> x, std::vector<double> y, std::string title, bool points)
+{
+    series.push_back({points ? SeriesType::LinesPoints : SeriesType::Lines, std::move(title), std::move(x), std::move(y), {}, 0.0});
+}
+
+void Chart::addBand(std::vector<double> x, std::vector<double> lower, std::vector<double> upper, std::string title)
+{
+    series.push_back({SeriesType::Band, std::move(title), std::move(x), std::move(lower), std::move(upper), 0.0});
+}
+
+void Chart::addBoxes(std::vector<double> x, std::vector<double> y, double boxWidth, std::string title)
+{
+    series.push_back({SeriesType::Boxes, std::move(title), std::move(x), std::move(y), {}, boxWidth});
+}
+
+sf::Image Chart::render() const
+{
+    Canvas canvas(width, height);
+
+    // Data ranges
+    double x0 = xMin, x1 = xMax, y0 = yMin, y1 = yMax;
+    if (!fixedX || !fixedY)
+    {
+        double dataX0 = std::numeric_limits<double>::infinity(), dataX1 = -dataX0;
+        double dataY0 = dataX0, dataY1 = -dataX0;
+        for (const Series &s : series)
+        {
+            for (std::size_t i = 0; i < s.x.size(); ++i)
+            {
+                double half = s.boxWidth / 2.0;
+                if (std::isfinite(s.x[i]))
+                {
+                    dataX0 = std::min(dataX0, s.x[i] - half);
+                    dataX1 = std::max(dataX1, s.x[i] + half);
+                }
+                // Only points inside a fixed x range count for the y range
+                if (fixedX && (s.x[i] < x0 || s.x[i] > x1))
+                    continue;
+                if (std::isfinite(s.y[i]))
+                {
+                    dataY0 = std::min(dataY0, s.y[i]);
+                    dataY1 = std::max(dataY1, s.y[i]);
+                }
+                if (s.type == SeriesType::Band && std::isfinite(s.y2[i]))
+                {
+                    dataY0 = std::min(dataY0, s.y2[i]);
+                    dataY1 = std::max(dataY1, s.y2[i]);
+                }
+            }
+        }
+        if (!std::isfinite(dataX0))
+        {
+            dataX0 = dataY0 = 0.0;
+            dataX1 = dataY1 = 1.0;
+        }
+        if (!fixedX)
+        {
+            x0 = dataX0;
+            x1 = dataX1;
+            autoscale(x0, x1, 8);
+        }
+        if (!fixedY)
+        {
+            y0 = fixedYMin ? yMin : dataY0;
+            y1 = std::max(dataY1, y0);
+            double lo = y0;
+            autoscale(y0, y1, 6);
+            if (fixedYMin)
+                y0 = lo;
+        }
+    }
+
+    // Layout: room for tick labels and axis labels around the plot area
+    int titleHeight = title.empty() ? 8 : glyphHeight + 14;
+    int left = 12 + (ylabel.empty() ? 0 : glyphHeight + 8);
+    double yStep = tickStep(y1 - y0, 6);
+    int labelWidth = 0;
+    for (double v = std::ceil(y0 / yStep - 1e-9) * yStep; v <= y1 + yStep * 1e-9; v += yStep)
+        labelWidth = std::max(labelWidth, textWidth(tickLabel(v, yStep)));
+    left += labelWidth;
+    int right = static_cast<int>(width) - 20;
+    int top = titleHeight;
+    int bottom = static_cast<int>(height) - (glyphHeight + 12) - (xlabel.empty() ? 0 : glyphHeight + 8);
+    if (right <= left + 10 || bottom <= top + 10)
+        return canvas.image();
+
+    auto mapX = [&](double x) {
+        if (logX)
+            return left + (std::log10(x) - std::log10(x0)) / (std::log10(x1) - std::log10(x0)) * (right - left);
+        return left + (x - x0) / (x1 - x0) * (right - left);
+    };
+    auto mapY = [&](double y) { return bottom - (y - y0) / (y1 - y0) * (bottom - top); };
+
+    // Ticks: positions of major (labelled) and minor ticks on both axes
+    std::vector<std::pair<double, std::string>> xTicks, yTicks;
+    std::vector<double> xMinor;
+    if (logX)
+    {
+        for (int decade = static_cast<int>(std::floor(std::log10(x0))); std::pow(10.0, decade) <= x1; ++decade)
+        {
+            double base = std::pow(10.0, decade);
+            if (base >= x0)
+                xTicks.push_back({base, tickLabel(base, base)});
+            for (int m = 2; m < 10; ++m)
+                if (base * m >= x0 && base * m <= x1)
+                    xMinor.push_back(base * m);
+        }
+    }
+    else
+    {
+        double xStep = tickStep(x1 - x0, 8);
+        for (double v = std::ceil(x0 / xStep - 1e-9) * xStep; v <= x1 + xStep * 1e-9; v += xStep)
+            xTicks.push_back({v, tickLabel(v, xStep)});
+    }
+    for (double v = std::ceil(y0 / yStep - 1e-9) * yStep; v <= y1 + yStep * 1e-9; v += yStep)
+        yTicks.push_back({v, tickLabel(v, yStep)});
+
+    if (showGrid)
+    {
+        for (const auto &tick : xTicks)
+        {
+            double px = std::round(mapX(tick.first));
+            for (int y = top; y < bottom; y += 4)
+                canvas.fillRect(static_cast<int>(px), y, static_cast<int>(px) + 1, y + 2, gridGrey);
+        }
+        for (const auto &tick : yTicks)
+        {
+            double py = std::round(mapY(tick.first));
+            for (int x = left; x < right; x += 4)
+                canvas.fillRect(x, static_cast<int>(py), x + 2, static_cast<int>(py) + 1, gridGrey);
+        }
+    }
+
+    // Series, clipped to the plot area
+    canvas.setClip(left, top, right + 1, bottom + 1);
+    std::size_t colourIndex = 0;
+    for (const Series &s : series)
+    {
+        Rgb colour = palette[colourIndex++ % (sizeof(palette) / sizeof(palette[0]))];
+        switch (s.type)
+        {
+        case SeriesType::Lines:
+        case SeriesType::LinesPoints:
+            for (std::size_t i = 0; i + 1 < s.x.size(); ++i)
+            {
+                if (std::isfinite(s.y[i]) && std::isfinite(s.y[i + 1]) && (!logX || (s.x[i] > 0 && s.x[i + 1] > 0)))
+                    canvas.line(mapX(s.x[i]), mapY(s.y[i]), mapX(s.x[i + 1]), mapY(s.y[i + 1]), colour);
+            }
+            if (s.type == SeriesType::LinesPoints)
+            {
+                // gnuplot's point type 1 / 2: plus, then cross
+                for (std::size_t i = 0; i < s.x.size(); ++i)
+                {
+                    double px = mapX(s.x[i]), py = mapY(s.y[i]);
+                    if ((colourIndex - 1) % 2 == 0)
+                    {
+                        canvas.line(px - 3, py, px + 3, py, colour);
+                        canvas.line(px, py - 3, px, py + 3, colour);
+                    }
+                    else
+                    {
+                        canvas.line(px - 3, py - 3, px + 3, py + 3, colour);
+                        canvas.line(px - 3, py + 3, px + 3, py - 3, colour);
+                    }
+                }
+            }
+            break;
+        case SeriesType::Band:
+        {
+            // Union of the vertical spans that fall in each pixel column
+            int columns = right - left + 1;
+            std::vector<double> lo(columns, std::numeric_limits<double>::infinity()), hi(columns, -std::numeric_limits<double>::infinity());
+            auto span = [&](double px, double a, double b) {
+                int c = static_cast<int>(std::round(px)) - left;
+                if (c < 0 || c >= columns)
+                    return;
+                lo[c] = std::min(lo[c], std::min(a, b));
+                hi[c] = std::max(hi[c], std::max(a, b));
+            };
+            for (std::size_t i = 0; i < s.x.size(); ++i)
+            {
+                double px = mapX(s.x[i]);
+                span(px, mapY(s.y[i]), mapY(s.y2[i]));
+                if (i + 1 < s.x.size())
+                {
+                    // Interpolate across columns between sparse points
+                    double next = mapX(s.x[i + 1]);
+                    for (double c = std::floor(px) + 1; c < next; c += 1.0)
+                    {
+                        double t = (c - px) / (next - px);
+                        span(c, mapY(s.y[i] + t * (s.y[i + 1] - s.y[i])), mapY(s.y2[i] + t * (s.y2[i + 1] - s.y2[i])));
+                    }
+                }
+            }
+            for (int c = 0; c < columns; ++c)
+            {
+                if (lo[c] > hi[c])
+                    continue;
+                canvas.fillRect(left + c, static_cast<int>(std::floor(lo[c])), left + c + 1, static_cast<int>(std::floor(hi[c])) + 1, colour);
+            }
+            break;
+        }
+        case SeriesType::Boxes:
+            for (std::size_t i = 0; i < s.x.size(); ++i)
+            {
+                double bx0 = mapX(s.x[i] - s.boxWidth / 2.0), bx1 = mapX(s.x[i] + s.boxWidth / 2.0);
+                double by0 = mapY(std::max(y0, 0.0)), by1 = mapY(s.y[i]);
+                int ix0 = static_cast<int>(std::round(bx0)), ix1 = std::max(ix0 + 1, static_cast<int>(std::round(bx1)));
+                int iy0 = static_cast<int>(std::round(std::min(by0, by1))), iy1 = static_cast<int>(std::round(std::max(by0, by1)));
+                if (iy1 <= iy0)
+                    continue;
+                // "fill solid 0.5" with a border in the line colour
+                canvas.fillRect(ix0, iy0, ix1, iy1, colour, 0.5);
+                canvas.fillRect(ix0, iy0, ix1, iy0 + 1, colour);
+                canvas.fillRect(ix0, iy0, ix0 + 1, iy1, colour);
+                canvas.fillRect(ix1 - 1, iy0, ix1, iy1, colour);
+            }
+            break;
+        }
+    }
+    canvas.resetClip();
+
+    // Frame with inward ticks on all four sides
+    canvas.fillRect(left, top, right + 1, top + 1, black);
+    canvas.fillRect(left, bottom, right + 1, bottom + 1, black);
+    canvas.fillRect(left, top, left + 1, bottom + 1, black);
+    canvas.fillRect(right, top, right + 1, bottom + 1, black);
+    for (const auto &tick : xTicks)
+    {
+        int px = static_cast<int>(std::round(mapX(tick.first)));
+        canvas.fillRect(px, bottom - 6, px + 1, bottom, black);
+        canvas.fillRect(px, top, px + 1, top + 6, black);
+        canvas.text(px - textWidth(tick.second) / 2, bottom + 6, tick.second, black);
+    }
+    for (double minor : xMinor)
+    {
+        int px = static_cast<int>(std::round(mapX(minor)));
+        canvas.fillRect(px, bottom - 3, px + 1, bottom, black);
+        canvas.fillRect(px, top, px + 1, top + 3, black);
+    }
+    for (const auto &tick : yTicks)
+    {
+        int py = static_cast<int>(std::round(mapY(tick.first)));
+        canvas.fillRect(left, py, left + 6, py + 1, black);
+        canvas.fillRect(right - 6, py, right, py + 1, black);
+        canvas.text(left - 6 - textWidth(tick.second), py - 3, tick.second, black);
+    }
+
+    // Title and axis labels
+    canvas.text((left + right) / 2 - textWidth(title) / 2, 7, title, black);
+    if (!xlabel.empty())
+        canvas.text((left + right) / 2 - textWidth(xlabel) / 2, bottom + glyphHeight + 14, xlabel, black);
+    if (!ylabel.empty())
+        canvas.textVertical(6, (top + bottom) / 2 + textWidth(ylabel) / 2, ylabel, black);
+
+    // Key: titled series in the top right corner
+    int keyY = top + 8;
+    colourIndex = 0;
+    for (const Series &s : series)
+    {
+        Rgb colour = palette[colourIndex++ % (sizeof(palette) / sizeof(palette[0]))];
+        if (s.title.empty())
+            continue;
+        int sampleX0 = right - 52, sampleX1 = right - 12;
+        canvas.text(sampleX0 - 8 - textWidth(s.title), keyY, s.title, black);
+        if (s.type == SeriesType::Band || s.type == SeriesType::Boxes)
+            canvas.fillRect(sampleX0, keyY, sampleX1, keyY + 7, colour, s.type == SeriesType::Boxes ? 0.5 : 1.0);
+        else
+            canvas.fillRect(sampleX0, keyY + 3, sampleX1, keyY + 4, colour);
+        keyY += glyphHeight + 6;
+    }
+
+    return canvas.image();
+}
+
+void saveChartAsync(Chart chart, const std::string &filename)
+{
+    auto shared = std::make_shared<Chart>(std::move(chart));
+    chartPool().submit([shared, filename]() {
+        OutputTimer timer(filename);
+        if (shared->render().saveToFile(filename))
+        {
+            std::error_code ec;
+            timer.setBytes(std::filesystem::file_size(filename, ec));
+        }
+    });
+}
+
+void waitForCharts()
+{
+    chartPool().wait();
+}
@@ -0,0 +1,67 @@
+#ifndef CHART_H
+#define CHART_H
+
+#include <SFML/Graphics.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// In-process 2D chart renderer for the plots main.cpp produces, laid out like
+// gnuplot's pngcairo output (framed axes with inward ticks, centred title, key
+// in the top right corner, gnuplot's default line colours). Series are drawn
+// with anti-aliased lines straight into an RGBA buffer; text uses an embedded
+// 5x7 bitmap font, so no external process or font library is needed.
+class Chart
+{
+public:
+    Chart(unsigned int width, unsigned int height, std::string title, std::string xlabel, std::string ylabel);
+
+    // Fixed axis ranges; axes left unset are autoscaled to whole ticks
+    void setXRange(double min, double max);
+    void setYRange(double min, double max);
+    void setYMin(double min);
+    void setLogX(bool log) { logX = log; }
+    void setGrid(bool grid) { showGrid = grid; }
+
+    void addLines(std::vector<double> x, std::vector<double> y, std::string title = "", bool points = false);
+    // Area between lower and upper, like gnuplot's "with filledcurves"
+    void addBand(std::vector<double> x, std::vector<double> lower, std::vector<double> upper, std::string title = "");
+    // Boxes centred on x, like "with boxes" under "set style fill solid 0.5"
+    void addBoxes(std::vector<double> x, std::vector<double> y, double boxWidth, std::string title = "");
+
+    sf::Image render() const;
+
+private:
+    enum class SeriesType
+    {
+        Lines,
+        LinesPoints,
+        Band,
+        Boxes
+    };
+
+    struct Series
+    {
+        SeriesType type;
+        std::string title;
+        std::vector<double> x, y, y2;
+        double boxWidth = 0.0;
+    };
+
+    unsigned int width, height;
+    std::string title, xlabel, ylabel;
+    bool fixedX = false, fixedY = false, fixedYMin = false;
+    double xMin = 0.0, xMax = 1.0, yMin = 0.0, yMax = 1.0;
+    bool logX = false;
+    bool showGrid = false;
+    std::vector<Series> series;
+};
+
+// Renders and encodes the chart as a PNG on a background pool, so several
+// images are encoded in parallel; the time is recorded as an output time
+void saveChartAsync(Chart chart, const std::string &filename);
+
+// Blocks until every queued chart has been written
+void waitForCharts();
+
+#endif
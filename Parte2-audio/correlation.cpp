@@ -0,0 +1,90 @@
+#include "correlation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+std::size_t fastFftSize(std::size_t n)
+{
+#ifdef USE_FFT
+    for (std::size_t size = std::max<std::size_t>(2, n + n % 2);; size += 2)
+    {
+        std::size_t rest = size;
+        for (std::size_t factor : {2u, 3u, 5u})
+        {
+            while (rest % factor == 0)
+                rest /= factor;
+        }
+        if (rest == 1)
+            return size;
+    }
+#else
+    std::size_t power = 2;
+    while (power < n)
+        power <<= 1;
+    return power;
+#endif
+}
+
+CrossCorrelator::CrossCorrelator(std::size_t max_frames, std::size_t max_lag)
+    : max_frames(max_frames), max_lag(max_lag), fft(fastFftSize(max_frames + max_lag), true), first(fft.size()), second(fft.size())
+{
+}
+
+DelayEstimate CrossCorrelator::estimate(const float *a, const float *b, std::size_t frames)
+{
+    const std::size_t size = fft.size();
+    frames = std::min(frames, max_frames);
+    DelayEstimate result;
+
+    double *x = first.input();
+    double *y = second.input();
+    double energyA = 0.0, energyB = 0.0;
+    for (std::size_t i = 0; i < frames; ++i)
+    {
+        x[i] = a[i];
+        y[i] = b[i];
+        energyA += x[i] * x[i];
+        energyB += y[i] * y[i];
+    }
+    std::fill(x + frames, x + size, 0.0);
+    std::fill(y + frames, y + size, 0.0);
+    if (energyA == 0.0 || energyB == 0.0)
+        return result;
+
+    // conj(A) B is the spectrum of sum a[n] b[n + k]; negative lags wrap to the end
+    fft.forward(first);
+    fft.forward(second);
+    std::complex<double> *spectrum = first.output();
+    const std::complex<double> *other = second.output();
+    for (std::size_t k = 0; k < fft.bins(); ++k)
+        spectrum[k] = std::conj(spectrum[k]) * other[k];
+    fft.inverse(first);
+    const double *correlation = first.input();
+    const std::int64_t lags = static_cast<std::int64_t>(std::min(max_lag, frames - 1));
+    auto at = [&](std::int64_t lag) { return correlation[static_cast<std::size_t>(lag < 0 ? lag + static_cast<std::int64_t>(size) : lag)] / size; };
+
+    std::int64_t best = 0;
+    for (std::int64_t lag = -lags; lag <= lags; ++lag)
+    {
+        if (std::abs(at(lag)) > std::abs(at(best)))
+            best = lag;
+    }
+
+    double peak = at(best);
+    result.valid = true;
+    result.lag = best;
+    result.delay = static_cast<double>(best);
+    if (best > -lags && best < lags)
+    {
+        // Vertex of the parabola through the peak and its neighbours
+        double sign = peak < 0.0 ? -1.0 : 1.0;
+        double before = sign * at(best - 1), centre = sign * peak, after = sign * at(best + 1);
+        double curvature = before - 2.0 * centre + after;
+        if (curvature < 0.0)
+            result.delay += 0.5 * (before - after) / curvature;
+    }
+    result.gain = peak / energyA;
+    result.correlation = peak / std::sqrt(energyA * energyB);
+    return result;
+}
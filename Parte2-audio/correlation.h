@@ -0,0 +1,48 @@
+#ifndef CORRELATION_H
+#define CORRELATION_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "fft.h"
+
+// Where b matches a: b[n + delay] ~ gain x a[n]
+struct DelayEstimate
+{
+    bool valid = false;       // false when either signal is silent
+    std::int64_t lag = 0;     // whole samples
+    double delay = 0.0;       // samples, refined between samples with a parabola through the peak
+    double gain = 0.0;        // least-squares gain of b over a at that lag (negative when inverted)
+    double correlation = 0.0; // normalized correlation at that lag, in [-1, 1]
+};
+
+// Cross-correlation of two signals of up to maxFrames samples over lags in
+// [-maxLag, maxLag], by FFT: both are zero-padded to a fast size of at least
+// maxFrames + maxLag, so the circular correlation conj(A) B does not wrap
+// within the lags searched. That is O(n log n) against O(n x lags) directly.
+class CrossCorrelator
+{
+public:
+    CrossCorrelator(std::size_t max_frames, std::size_t max_lag);
+
+    std::size_t maxFrames() const { return max_frames; }
+    std::size_t maxLag() const { return max_lag; }
+
+    // The lag with the strongest correlation (in either polarity) between
+    // `frames` samples of a and of b
+    DelayEstimate estimate(const float *a, const float *b, std::size_t frames);
+
+private:
+    std::size_t max_frames;
+    std::size_t max_lag;
+    RealFFT fft;
+    RealFFT::Workspace first;
+    RealFFT::Workspace second;
+};
+
+// Smallest size >= n the FFT is fast at: even with no prime factor above 5
+// for FFTW, a power of two for the builtin FFT (its radix-3 and radix-5
+// stages are several times slower per point)
+std::size_t fastFftSize(std::size_t n);
+
+#endif
@@ -0,0 +1,283 @@
+#include "error_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "channels.h"
+
+namespace
+{
+// Whole segments below which a block is not worth splitting
+const std::size_t minSegmentsPerPart = 16;
+
+// Segment SNRs are clamped, as usual for segmental SNR, so that a few
+// near-silent or exactly reproduced segments do not dominate the mean. The
+// ceiling is just above the SNR of a full-scale signal at 16 bits.
+const double segmentFloor = -10.0;
+const double segmentCeiling = 100.0;
+
+template <typename T>
+double segmentSnr(const BasicErrorSums<T> &sums)
+{
+    if (sums.error == 0)
+        return segmentCeiling;
+    double snr = 10 * std::log10(static_cast<double>(sums.signal) / static_cast<double>(sums.error));
+    return std::clamp(snr, segmentFloor, segmentCeiling);
+}
+
+void accumulateScalar(const sf::Int16 *original, const sf::Int16 *processed, std::size_t frames, unsigned int channels, ErrorSums *sums)
+{
+    for (std::size_t i = 0; i < frames; ++i)
+    {
+        for (unsigned int c = 0; c < channels; ++c)
+        {
+            std::int64_t value = original[i * channels + c];
+            std::int64_t difference = value - processed[i * channels + c];
+            sums[c].signal += static_cast<std::uint64_t>(value * value);
+            sums[c].error += static_cast<std::uint64_t>(difference * difference);
+            sums[c].peakError = std::max(sums[c].peakError, static_cast<std::uint32_t>(difference < 0 ? -difference : difference));
+        }
+    }
+}
+
+// Wider samples: differences are exact in double (int32 ones need 33 bits),
+// their squares are rounded
+template <typename T>
+void accumulateWide(const T *original, const T *processed, std::size_t frames, unsigned int channels, BasicErrorSums<T> *sums)
+{
+    for (std::size_t i = 0; i < frames; ++i)
+    {
+        for (unsigned int c = 0; c < channels; ++c)
+        {
+            double value = original[i * channels + c];
+            double difference = value - static_cast<double>(processed[i * channels + c]);
+            sums[c].signal += value * value;
+            sums[c].error += difference * difference;
+            sums[c].peakError = std::max(sums[c].peakError, std::abs(difference));
+        }
+    }
+}
+
+#ifdef CHANNELS_USE_SSE2
+inline __m128i abs32(__m128i v)
+{
+    __m128i sign = _mm_srai_epi32(v, 31);
+    return _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+}
+
+// Squares of four 32-bit lanes below 2^16 into two 64-bit sums: even lanes
+// into even, odd lanes into odd
+inline void addSquares(__m128i v, __m128i &even, __m128i &odd)
+{
+    __m128i high = _mm_srli_epi64(v, 32);
+    even = _mm_add_epi64(even, _mm_mul_epu32(v, v));
+    odd = _mm_add_epi64(odd, _mm_mul_epu32(high, high));
+}
+
+inline __m128i max32(__m128i a, __m128i b)
+{
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+
+inline std::uint64_t lane64(__m128i v, int lane)
+{
+    alignas(16) std::uint64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), v);
+    return lanes[lane];
+}
+
+// Eight samples per iteration, widened to 32 bits. Differences reach 65535 in
+// magnitude, so they are squared as unsigned 32 x 32 -> 64-bit products.
+// Even and odd samples are kept apart: they are the two channels of a stereo
+// signal and are added together for mono.
+void accumulateSse2(const sf::Int16 *original, const sf::Int16 *processed, std::size_t frames, unsigned int channels, ErrorSums *sums)
+{
+    std::size_t count = frames * channels;
+    __m128i signalEven = _mm_setzero_si128(), signalOdd = _mm_setzero_si128();
+    __m128i errorEven = _mm_setzero_si128(), errorOdd = _mm_setzero_si128();
+    __m128i peak = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(original + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(processed + i));
+        __m128i aLow = detail::widenLow(a), aHigh = detail::widenHigh(a);
+        __m128i dLow = abs32(_mm_sub_epi32(aLow, detail::widenLow(b)));
+        __m128i dHigh = abs32(_mm_sub_epi32(aHigh, detail::widenHigh(b)));
+        addSquares(abs32(aLow), signalEven, signalOdd);
+        addSquares(abs32(aHigh), signalEven, signalOdd);
+        addSquares(dLow, errorEven, errorOdd);
+        addSquares(dHigh, errorEven, errorOdd);
+        peak = max32(peak, max32(dLow, dHigh));
+    }
+
+    alignas(16) std::uint32_t peaks[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(peaks), peak);
+    std::uint64_t signal[2] = {lane64(signalEven, 0) + lane64(signalEven, 1), lane64(signalOdd, 0) + lane64(signalOdd, 1)};
+    std::uint64_t error[2] = {lane64(errorEven, 0) + lane64(errorEven, 1), lane64(errorOdd, 0) + lane64(errorOdd, 1)};
+    std::uint32_t peakError[2] = {std::max(peaks[0], peaks[2]), std::max(peaks[1], peaks[3])};
+    if (channels == 1)
+    {
+        sums[0].signal += signal[0] + signal[1];
+        sums[0].error += error[0] + error[1];
+        sums[0].peakError = std::max({sums[0].peakError, peakError[0], peakError[1]});
+    }
+    else
+    {
+        for (int c = 0; c < 2; ++c)
+        {
+            sums[c].signal += signal[c];
+            sums[c].error += error[c];
+            sums[c].peakError = std::max(sums[c].peakError, peakError[c]);
+        }
+    }
+    // i is a multiple of 8, so the tail starts on a frame boundary
+    accumulateScalar(original + i, processed + i, (count - i) / channels, channels, sums);
+}
+#endif
+}
+
+template <typename T>
+void accumulateErrors(const T *original, const T *processed, std::size_t frames, unsigned int channels, BasicErrorSums<T> *sums)
+{
+    accumulateWide(original, processed, frames, channels, sums);
+}
+
+template <>
+void accumulateErrors<sf::Int16>(const sf::Int16 *original, const sf::Int16 *processed, std::size_t frames, unsigned int channels, ErrorSums *sums)
+{
+#ifdef CHANNELS_USE_SSE2
+    if (channels <= 2)
+    {
+        accumulateSse2(original, processed, frames, channels, sums);
+        return;
+    }
+#endif
+    accumulateScalar(original, processed, frames, channels, sums);
+}
+
+template void accumulateErrors<std::int32_t>(const std::int32_t *, const std::int32_t *, std::size_t, unsigned int, BasicErrorSums<std::int32_t> *);
+template void accumulateErrors<float>(const float *, const float *, std::size_t, unsigned int, BasicErrorSums<float> *);
+
+template <typename T>
+BasicErrorMetrics<T>::BasicErrorMetrics(unsigned int channel_count, std::size_t segment_frames)
+    : channel_count(channel_count),
+      segment_frames(std::max<std::size_t>(1, segment_frames)),
+      totals(channel_count),
+      pending(channel_count),
+      segment_snr_sum(channel_count, 0.0),
+      segment_count(channel_count, 0)
+{
+}
+
+template <typename T>
+void BasicErrorMetrics<T>::feed(const T *original, const T *processed, std::size_t frames, ThreadPool &pool)
+{
+    feedBlock(original, processed, frames, &pool);
+}
+
+template <typename T>
+void BasicErrorMetrics<T>::feed(const T *original, const T *processed, std::size_t frames)
+{
+    feedBlock(original, processed, frames, nullptr);
+}
+
+template <typename T>
+void BasicErrorMetrics<T>::feedBlock(const T *original, const T *processed, std::size_t frames, ThreadPool *pool)
+{
+    total_frames += frames;
+
+    // Complete the open segment first
+    if (pending_frames > 0)
+    {
+        std::size_t take = std::min(frames, segment_frames - pending_frames);
+        accumulateErrors(original, processed, take, channel_count, pending.data());
+        pending_frames += take;
+        original += take * channel_count;
+        processed += take * channel_count;
+        frames -= take;
+        if (pending_frames == segment_frames)
+        {
+            closeSegment(pending.data());
+            std::fill(pending.begin(), pending.end(), Sums());
+            pending_frames = 0;
+        }
+    }
+
+    std::size_t segments = frames / segment_frames;
+    feedSegments(original, processed, segments, pool);
+
+    // The rest opens a new segment
+    std::size_t done = segments * segment_frames;
+    accumulateErrors(original + done * channel_count, processed + done * channel_count, frames - done, channel_count, pending.data());
+    pending_frames += frames - done;
+}
+
+// Whole segments: each one is summed on its own (in parallel when there are
+// enough), then folded in order
+template <typename T>
+void BasicErrorMetrics<T>::feedSegments(const T *original, const T *processed, std::size_t segments, ThreadPool *pool)
+{
+    if (segments == 0)
+        return;
+    segment_sums.assign(segments * channel_count, Sums());
+    auto sumSegments = [&](std::size_t first, std::size_t last) {
+        for (std::size_t s = first; s < last; ++s)
+        {
+            std::size_t offset = s * segment_frames * channel_count;
+            accumulateErrors(original + offset, processed + offset, segment_frames, channel_count, segment_sums.data() + s * channel_count);
+        }
+    };
+    if (pool && segments >= 2 * minSegmentsPerPart)
+        pool->parallelFor(0, segments, std::max(minSegmentsPerPart, segments / (4 * pool->size())), sumSegments);
+    else
+        sumSegments(0, segments);
+
+    for (std::size_t s = 0; s < segments; ++s)
+        closeSegment(segment_sums.data() + s * channel_count);
+}
+
+template <typename T>
+void BasicErrorMetrics<T>::closeSegment(const Sums *segment)
+{
+    for (unsigned int c = 0; c < channel_count; ++c)
+    {
+        totals[c].merge(segment[c]);
+        // Silent segments have no meaningful SNR
+        if (segment[c].signal == 0)
+            continue;
+        segment_snr_sum[c] += segmentSnr(segment[c]);
+        segment_count[c]++;
+    }
+}
+
+template <typename T>
+ErrorResult BasicErrorMetrics<T>::result(unsigned int channel) const
+{
+    Sums sums = totals[channel];
+    sums.merge(pending[channel]);
+    double snrSum = segment_snr_sum[channel];
+    std::uint64_t segments = segment_count[channel];
+    if (pending_frames > 0 && pending[channel].signal > 0)
+    {
+        snrSum += segmentSnr(pending[channel]);
+        segments++;
+    }
+
+    // Same definitions as the double-precision path: MSE of the normalized
+    // samples and 10 log10 of signal power over error power
+    ErrorResult result;
+    double samples = static_cast<double>(total_frames);
+    const double scale = SampleTraits<T>::scale;
+    result.mse = static_cast<double>(sums.error) * scale * scale / samples;
+    result.snr = 10 * std::log10(static_cast<double>(sums.signal) / static_cast<double>(sums.error));
+    result.peakError = sums.peakError * scale;
+    result.segmentalSnr = segments > 0 ? snrSum / segments : std::numeric_limits<double>::quiet_NaN();
+    return result;
+}
+
+template class BasicErrorMetrics<sf::Int16>;
+template class BasicErrorMetrics<std::int32_t>;
+template class BasicErrorMetrics<float>;
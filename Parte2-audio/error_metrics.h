@@ -0,0 +1,90 @@
+#ifndef ERROR_METRICS_H
+#define ERROR_METRICS_H
+
+#include <SFML/Config.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sample_format.h"
+#include "thread_pool.h"
+
+// Error sums of one channel, in sample units of T: exact integers for int16
+template <typename T>
+struct BasicErrorSums
+{
+    typename SampleTraits<T>::Sum signal = 0;          // sum of original^2
+    typename SampleTraits<T>::Sum error = 0;           // sum of (original - processed)^2
+    typename SampleTraits<T>::Magnitude peakError = 0; // largest |original - processed|
+
+    void merge(const BasicErrorSums &other)
+    {
+        signal += other.signal;
+        error += other.error;
+        peakError = std::max(peakError, other.peakError);
+    }
+};
+
+using ErrorSums = BasicErrorSums<sf::Int16>;
+
+// Adds `frames` interleaved frames of original and processed samples to
+// sums[0], ..., sums[channels - 1]. Mono and stereo int16 run an SSE2 kernel.
+// Defined for sf::Int16, std::int32_t and float.
+template <typename T>
+void accumulateErrors(const T *original, const T *processed, std::size_t frames, unsigned int channels, BasicErrorSums<T> *sums);
+
+template <>
+void accumulateErrors<sf::Int16>(const sf::Int16 *original, const sf::Int16 *processed, std::size_t frames, unsigned int channels, ErrorSums *sums);
+
+// Quality of one channel, with amplitudes normalized to [-1, 1) like the
+// double-precision planes
+struct ErrorResult
+{
+    double mse = 0.0;
+    double snr = 0.0;
+    double peakError = 0.0;
+    double segmentalSnr = 0.0; // mean SNR of the non-silent segments, in dB
+};
+
+// MSE, SNR, peak error and segmental SNR of every channel of a processed
+// signal against its original, fed block by block straight from interleaved
+// buffers of T. For int16 the sums are exact 64-bit integers, so results do
+// not depend on block sizes or on how a block was split over the pool; wider
+// samples are summed in double per segment, so only the segment that spans a
+// block boundary can round differently. Segments are segmentFrames long and
+// run across block boundaries; the last, partial one counts too. Instantiated
+// for sf::Int16, std::int32_t and float.
+template <typename T>
+class BasicErrorMetrics
+{
+public:
+    explicit BasicErrorMetrics(unsigned int channel_count, std::size_t segment_frames = 1024);
+
+    void feed(const T *original, const T *processed, std::size_t frames, ThreadPool &pool);
+    void feed(const T *original, const T *processed, std::size_t frames);
+
+    ErrorResult result(unsigned int channel) const;
+    std::uint64_t frames() const { return total_frames; }
+
+private:
+    using Sums = BasicErrorSums<T>;
+
+    void feedBlock(const T *original, const T *processed, std::size_t frames, ThreadPool *pool);
+    void feedSegments(const T *original, const T *processed, std::size_t segments, ThreadPool *pool);
+    void closeSegment(const Sums *segment);
+
+    unsigned int channel_count;
+    std::size_t segment_frames;
+    std::uint64_t total_frames = 0;
+    std::vector<Sums> totals;
+    std::vector<Sums> pending; // the open segment
+    std::size_t pending_frames = 0;
+    std::vector<double> segment_snr_sum;
+    std::vector<std::uint64_t> segment_count;
+    std::vector<Sums> segment_sums; // scratch: one entry per channel and whole segment of a block
+};
+
+using ErrorMetrics = BasicErrorMetrics<sf::Int16>;
+
+#endif
@@ -0,0 +1,464 @@
+#include "fft.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FFT_USE_SSE2
+#endif
+
+namespace
+{
+FftRigor plannerRigor = FftRigor::Measure;
+std::string plannerWisdomDirectory;
+}
+
+bool parseFftRigor(const std::string &name, FftRigor &rigor)
+{
+    if (name == "estimate")
+        rigor = FftRigor::Estimate;
+    else if (name == "measure")
+        rigor = FftRigor::Measure;
+    else if (name == "patient")
+        rigor = FftRigor::Patient;
+    else if (name == "exhaustive")
+        rigor = FftRigor::Exhaustive;
+    else
+        return false;
+    return true;
+}
+
+void configureFftPlanner(FftRigor rigor, const std::string &wisdomDirectory)
+{
+    plannerRigor = rigor;
+    plannerWisdomDirectory = wisdomDirectory;
+}
+
+namespace
+{
+const double pi = 3.14159265358979323846;
+
+// Radix-4 butterflies of one Stockham stage for sub-transform j:
+// reads x[q + s (j + r m)], writes y[q + s (4 j + k)] times w^(j k)
+void butterfly4(const double *xr, const double *xi, double *yr, double *yi, std::size_t j, std::size_t m, std::size_t s, const double *wr, const double *wi)
+{
+    const double *x0r = xr + s * j, *x1r = xr + s * (j + m), *x2r = xr + s * (j + 2 * m), *x3r = xr + s * (j + 3 * m);
+    const double *x0i = xi + s * j, *x1i = xi + s * (j + m), *x2i = xi + s * (j + 2 * m), *x3i = xi + s * (j + 3 * m);
+    double *y0r = yr + s * 4 * j, *y1r = y0r + s, *y2r = y0r + 2 * s, *y3r = y0r + 3 * s;
+    double *y0i = yi + s * 4 * j, *y1i = y0i + s, *y2i = y0i + 2 * s, *y3i = y0i + 3 * s;
+    std::size_t q = 0;
+#ifdef FFT_USE_SSE2
+    const __m128d w1r = _mm_set1_pd(wr[0]), w1i = _mm_set1_pd(wi[0]);
+    const __m128d w2r = _mm_set1_pd(wr[1]), w2i = _mm_set1_pd(wi[1]);
+    const __m128d w3r = _mm_set1_pd(wr[2]), w3i = _mm_set1_pd(wi[2]);
+    for (; q + 2 <= s; q += 2)
+    {
+        __m128d a0r = _mm_loadu_pd(x0r + q), a0i = _mm_loadu_pd(x0i + q);
+        __m128d a1r = _mm_loadu_pd(x1r + q), a1i = _mm_loadu_pd(x1i + q);
+        __m128d a2r = _mm_loadu_pd(x2r + q), a2i = _mm_loadu_pd(x2i + q);
+        __m128d a3r = _mm_loadu_pd(x3r + q), a3i = _mm_loadu_pd(x3i + q);
+        __m128d t0r = _mm_add_pd(a0r, a2r), t0i = _mm_add_pd(a0i, a2i);
+        __m128d t1r = _mm_sub_pd(a0r, a2r), t1i = _mm_sub_pd(a0i, a2i);
+        __m128d t2r = _mm_add_pd(a1r, a3r), t2i = _mm_add_pd(a1i, a3i);
+        // (a1 - a3) * -i
+        __m128d t3r = _mm_sub_pd(a1i, a3i), t3i = _mm_sub_pd(a3r, a1r);
+        __m128d b1r = _mm_add_pd(t1r, t3r), b1i = _mm_add_pd(t1i, t3i);
+        __m128d b2r = _mm_sub_pd(t0r, t2r), b2i = _mm_sub_pd(t0i, t2i);
+        __m128d b3r = _mm_sub_pd(t1r, t3r), b3i = _mm_sub_pd(t1i, t3i);
+        _mm_storeu_pd(y0r + q, _mm_add_pd(t0r, t2r));
+        _mm_storeu_pd(y0i + q, _mm_add_pd(t0i, t2i));
+        _mm_storeu_pd(y1r + q, _mm_sub_pd(_mm_mul_pd(b1r, w1r), _mm_mul_pd(b1i, w1i)));
+        _mm_storeu_pd(y1i + q, _mm_add_pd(_mm_mul_pd(b1r, w1i), _mm_mul_pd(b1i, w1r)));
+        _mm_storeu_pd(y2r + q, _mm_sub_pd(_mm_mul_pd(b2r, w2r), _mm_mul_pd(b2i, w2i)));
+        _mm_storeu_pd(y2i + q, _mm_add_pd(_mm_mul_pd(b2r, w2i), _mm_mul_pd(b2i, w2r)));
+        _mm_storeu_pd(y3r + q, _mm_sub_pd(_mm_mul_pd(b3r, w3r), _mm_mul_pd(b3i, w3i)));
+        _mm_storeu_pd(y3i + q, _mm_add_pd(_mm_mul_pd(b3r, w3i), _mm_mul_pd(b3i, w3r)));
+    }
+#endif
+    for (; q < s; ++q)
+    {
+        double t0r = x0r[q] + x2r[q], t0i = x0i[q] + x2i[q];
+        double t1r = x0r[q] - x2r[q], t1i = x0i[q] - x2i[q];
+        double t2r = x1r[q] + x3r[q], t2i = x1i[q] + x3i[q];
+        double t3r = x1i[q] - x3i[q], t3i = x3r[q] - x1r[q];
+        double b1r = t1r + t3r, b1i = t1i + t3i;
+        double b2r = t0r - t2r, b2i = t0i - t2i;
+        double b3r = t1r - t3r, b3i = t1i - t3i;
+        y0r[q] = t0r + t2r;
+        y0i[q] = t0i + t2i;
+        y1r[q] = b1r * wr[0] - b1i * wi[0];
+        y1i[q] = b1r * wi[0] + b1i * wr[0];
+        y2r[q] = b2r * wr[1] - b2i * wi[1];
+        y2i[q] = b2r * wi[1] + b2i * wr[1];
+        y3r[q] = b3r * wr[2] - b3i * wi[2];
+        y3i[q] = b3r * wi[2] + b3i * wr[2];
+    }
+}
+
+void butterfly2(const double *xr, const double *xi, double *yr, double *yi, std::size_t j, std::size_t m, std::size_t s, const double *wr, const double *wi)
+{
+    const double *x0r = xr + s * j, *x1r = xr + s * (j + m);
+    const double *x0i = xi + s * j, *x1i = xi + s * (j + m);
+    double *y0r = yr + s * 2 * j, *y1r = y0r + s;
+    double *y0i = yi + s * 2 * j, *y1i = y0i + s;
+    std::size_t q = 0;
+#ifdef FFT_USE_SSE2
+    const __m128d w1r = _mm_set1_pd(wr[0]), w1i = _mm_set1_pd(wi[0]);
+    for (; q + 2 <= s; q += 2)
+    {
+        __m128d a0r = _mm_loadu_pd(x0r + q), a0i = _mm_loadu_pd(x0i + q);
+        __m128d a1r = _mm_loadu_pd(x1r + q), a1i = _mm_loadu_pd(x1i + q);
+        __m128d br = _mm_sub_pd(a0r, a1r), bi = _mm_sub_pd(a0i, a1i);
+        _mm_storeu_pd(y0r + q, _mm_add_pd(a0r, a1r));
+        _mm_storeu_pd(y0i + q, _mm_add_pd(a0i, a1i));
+        _mm_storeu_pd(y1r + q, _mm_sub_pd(_mm_mul_pd(br, w1r), _mm_mul_pd(bi, w1i)));
+        _mm_storeu_pd(y1i + q, _mm_add_pd(_mm_mul_pd(br, w1i), _mm_mul_pd(bi, w1r)));
+    }
+#endif
+    for (; q < s; ++q)
+    {
+        double br = x0r[q] - x1r[q], bi = x0i[q] - x1i[q];
+        y0r[q] = x0r[q] + x1r[q];
+        y0i[q] = x0i[q] + x1i[q];
+        y1r[q] = br * wr[0] - bi * wi[0];
+        y1i[q] = br * wi[0] + bi * wr[0];
+    }
+}
+
+// Any radix: a direct DFT of size p per butterfly, O(p^2)
+void butterflyGeneric(const double *xr, const double *xi, double *yr, double *yi, std::size_t j, std::size_t m, std::size_t s,
+                      std::size_t p, const double *wr, const double *wi, const double *rootRe, const double *rootIm)
+{
+    for (std::size_t q = 0; q < s; ++q)
+    {
+        for (std::size_t k = 0; k < p; ++k)
+        {
+            double sr = 0.0, si = 0.0;
+            for (std::size_t r = 0; r < p; ++r)
+            {
+                std::size_t e = (r * k) % p;
+                double ar = xr[q + s * (j + r * m)], ai = xi[q + s * (j + r * m)];
+                sr += ar * rootRe[e] - ai * rootIm[e];
+                si += ar * rootIm[e] + ai * rootRe[e];
+            }
+            double outRe = sr, outIm = si;
+            if (k > 0)
+            {
+                outRe = sr * wr[k - 1] - si * wi[k - 1];
+                outIm = sr * wi[k - 1] + si * wr[k - 1];
+            }
+            yr[q + s * (p * j + k)] = outRe;
+            yi[q + s * (p * j + k)] = outIm;
+        }
+    }
+}
+}
+
+MixedRadixFFT::MixedRadixFFT(std::size_t size) : n(size)
+{
+    // Factor n, taking radix 4 first, then 2, 3, 5 and any remaining primes
+    std::vector<std::size_t> radices;
+    std::size_t rest = n;
+    while (rest >= 4 && rest % 4 == 0)
+    {
+        radices.push_back(4);
+        rest /= 4;
+    }
+    for (std::size_t f = 2; rest > 1; f += (f == 2 ? 1 : 2))
+    {
+        if (f * f > rest)
+            f = rest;
+        while (rest % f == 0)
+        {
+            radices.push_back(f);
+            rest /= f;
+        }
+    }
+
+    std::size_t length = n;
+    std::size_t stride = 1;
+    for (std::size_t p : radices)
+    {
+        Stage stage;
+        stage.radix = p;
+        stage.length = length;
+        stage.stride = stride;
+        std::size_t m = length / p;
+        stage.twiddleRe.resize(m * (p - 1));
+        stage.twiddleIm.resize(m * (p - 1));
+        for (std::size_t j = 0; j < m; ++j)
+        {
+            for (std::size_t k = 1; k < p; ++k)
+            {
+                double angle = -2.0 * pi * static_cast<double>(j * k) / length;
+                stage.twiddleRe[j * (p - 1) + k - 1] = std::cos(angle);
+                stage.twiddleIm[j * (p - 1) + k - 1] = std::sin(angle);
+            }
+        }
+        if (p != 2 && p != 4)
+        {
+            for (std::size_t r = 0; r < p; ++r)
+            {
+                stage.rootRe.push_back(std::cos(-2.0 * pi * r / p));
+                stage.rootIm.push_back(std::sin(-2.0 * pi * r / p));
+            }
+        }
+        stages.push_back(std::move(stage));
+        length = m;
+        stride *= p;
+    }
+}
+
+void MixedRadixFFT::forward(double *re, double *im, double *scratchRe, double *scratchIm) const
+{
+    double *xr = re, *xi = im, *yr = scratchRe, *yi = scratchIm;
+    for (const Stage &stage : stages)
+    {
+        std::size_t p = stage.radix;
+        std::size_t m = stage.length / p;
+        for (std::size_t j = 0; j < m; ++j)
+        {
+            const double *wr = stage.twiddleRe.data() + j * (p - 1);
+            const double *wi = stage.twiddleIm.data() + j * (p - 1);
+            if (p == 4)
+                butterfly4(xr, xi, yr, yi, j, m, stage.stride, wr, wi);
+            else if (p == 2)
+                butterfly2(xr, xi, yr, yi, j, m, stage.stride, wr, wi);
+            else
+                butterflyGeneric(xr, xi, yr, yi, j, m, stage.stride, p, wr, wi, stage.rootRe.data(), stage.rootIm.data());
+        }
+        std::swap(xr, yr);
+        std::swap(xi, yi);
+    }
+    if (xr != re)
+    {
+        std::copy(xr, xr + n, re);
+        std::copy(xi, xi + n, im);
+    }
+}
+
+BuiltinRealFFT::Workspace::Workspace(std::size_t size)
+    : in(size), out(size / 2 + 1), re(size), im(size), scratchRe(size), scratchIm(size)
+{
+}
+
+BuiltinRealFFT::BuiltinRealFFT(std::size_t size, bool)
+    : n(size), complexFft(size % 2 == 0 ? size / 2 : size)
+{
+    if (n % 2 == 0)
+    {
+        for (std::size_t k = 0; k <= n / 2; ++k)
+            post.push_back(std::polar(1.0, -2.0 * pi * k / n));
+    }
+}
+
+void BuiltinRealFFT::forward(Workspace &workspace) const
+{
+    const double *x = workspace.in.data();
+    double *re = workspace.re.data();
+    double *im = workspace.im.data();
+    std::complex<double> *out = workspace.out.data();
+
+    if (n % 2 != 0)
+    {
+        // Odd sizes: plain complex transform of the real signal
+        std::copy(x, x + n, re);
+        std::fill(im, im + n, 0.0);
+        complexFft.forward(re, im, workspace.scratchRe.data(), workspace.scratchIm.data());
+        for (std::size_t k = 0; k <= n / 2; ++k)
+            out[k] = std::complex<double>(re[k], im[k]);
+        return;
+    }
+
+    // z[k] = x[2k] + i x[2k + 1], Z = FFT(z), then X[k] = E[k] + w^k O[k] with
+    // E[k] = (Z[k] + conj Z[N - k]) / 2 and O[k] = (Z[k] - conj Z[N - k]) / 2i
+    const std::size_t half = n / 2;
+    for (std::size_t k = 0; k < half; ++k)
+    {
+        re[k] = x[2 * k];
+        im[k] = x[2 * k + 1];
+    }
+    complexFft.forward(re, im, workspace.scratchRe.data(), workspace.scratchIm.data());
+    for (std::size_t k = 0; k <= half; ++k)
+    {
+        std::size_t a = k % half;
+        std::size_t b = (half - k) % half;
+        std::complex<double> zk(re[a], im[a]);
+        std::complex<double> zc(re[b], -im[b]);
+        std::complex<double> even = 0.5 * (zk + zc);
+        std::complex<double> odd = std::complex<double>(0.0, -0.5) * (zk - zc);
+        out[k] = even + post[k] * odd;
+    }
+}
+
+void BuiltinRealFFT::inverse(Workspace &workspace) const
+{
+    double *x = workspace.in.data();
+    double *re = workspace.re.data();
+    double *im = workspace.im.data();
+    const std::complex<double> *spectrum = workspace.out.data();
+
+    // The inverse runs as a forward transform of the conjugate:
+    // sum X[k] w^-km = conj(sum conj(X[k]) w^km)
+    if (n % 2 != 0)
+    {
+        // Odd sizes: the whole Hermitian spectrum through the complex transform
+        for (std::size_t k = 0; k < n; ++k)
+        {
+            std::complex<double> value = k <= n / 2 ? spectrum[k] : std::conj(spectrum[n - k]);
+            re[k] = value.real();
+            im[k] = -value.imag();
+        }
+        complexFft.forward(re, im, workspace.scratchRe.data(), workspace.scratchIm.data());
+        std::copy(re, re + n, x);
+        return;
+    }
+
+    // Undoes the split of forward(): E[k] = (X[k] + conj X[N - k]) / 2,
+    // O[k] = (X[k] - conj X[N - k]) / 2w^k, Z[k] = E[k] + i O[k]
+    const std::size_t half = n / 2;
+    for (std::size_t k = 0; k < half; ++k)
+    {
+        std::complex<double> xk = spectrum[k];
+        std::complex<double> xc = std::conj(spectrum[half - k]);
+        std::complex<double> even = 0.5 * (xk + xc);
+        std::complex<double> odd = 0.5 * (xk - xc) * std::conj(post[k]);
+        std::complex<double> z = even + std::complex<double>(0.0, 1.0) * odd;
+        re[k] = z.real();
+        im[k] = -z.imag();
+    }
+    complexFft.forward(re, im, workspace.scratchRe.data(), workspace.scratchIm.data());
+    for (std::size_t k = 0; k < half; ++k)
+    {
+        x[2 * k] = 2.0 * re[k];
+        x[2 * k + 1] = -2.0 * im[k];
+    }
+}
+
+
+#ifdef USE_FFT
+
+namespace
+{
+// FFTW's planner is not thread-safe, only fftw_execute* is
+std::mutex plannerMutex;
+std::map<std::pair<std::size_t, bool>, fftw_plan> planCache; // (size, inverse)
+
+unsigned int plannerFlags(FftRigor rigor)
+{
+    switch (rigor)
+    {
+    case FftRigor::Estimate:
+        return FFTW_ESTIMATE;
+    case FftRigor::Measure:
+        return FFTW_MEASURE;
+    case FftRigor::Patient:
+        return FFTW_PATIENT;
+    case FftRigor::Exhaustive:
+        return FFTW_EXHAUSTIVE;
+    }
+    return FFTW_ESTIMATE;
+}
+
+const char *rigorName(FftRigor rigor)
+{
+    switch (rigor)
+    {
+    case FftRigor::Estimate:
+        return "estimate";
+    case FftRigor::Measure:
+        return "measure";
+    case FftRigor::Patient:
+        return "patient";
+    case FftRigor::Exhaustive:
+        return "exhaustive";
+    }
+    return "estimate";
+}
+
+// Returns the cached r2c (or c2r) plan for size n, creating it (from wisdom
+// when possible) on first use. Must be called with plannerMutex held.
+fftw_plan cachedPlan(std::size_t n, bool inverse = false)
+{
+    auto it = planCache.find({n, inverse});
+    if (it != planCache.end())
+        return it->second;
+
+    double *in = fftw_alloc_real(n);
+    fftw_complex *out = fftw_alloc_complex(n / 2 + 1);
+    unsigned int flags = plannerFlags(plannerRigor);
+    fftw_plan plan = nullptr;
+    auto makePlan = [&](unsigned int planFlags) {
+        return inverse ? fftw_plan_dft_c2r_1d(static_cast<int>(n), out, in, planFlags) : fftw_plan_dft_r2c_1d(static_cast<int>(n), in, out, planFlags);
+    };
+
+    if (plannerRigor != FftRigor::Estimate && !plannerWisdomDirectory.empty())
+    {
+        // One wisdom file per size and rigor keeps the files small and independent
+        std::filesystem::path wisdomFile = std::filesystem::path(plannerWisdomDirectory) /
+                                           ((inverse ? "c2r-" : "r2c-") + std::to_string(n) + "-" + rigorName(plannerRigor) + ".wisdom");
+        fftw_forget_wisdom();
+        if (fftw_import_wisdom_from_filename(wisdomFile.string().c_str()))
+            plan = makePlan(flags | FFTW_WISDOM_ONLY);
+        if (!plan)
+        {
+            plan = makePlan(flags);
+            std::error_code ec;
+            std::filesystem::create_directories(plannerWisdomDirectory, ec);
+            fftw_export_wisdom_to_filename(wisdomFile.string().c_str());
+        }
+    }
+    else
+        plan = makePlan(flags);
+
+    fftw_free(in);
+    fftw_free(out);
+    planCache[{n, inverse}] = plan;
+    return plan;
+}
+}
+
+RealFFT::Workspace::Workspace(std::size_t size)
+{
+    in = fftw_alloc_real(size);
+    out = fftw_alloc_complex(size / 2 + 1);
+}
+
+RealFFT::Workspace::~Workspace()
+{
+    fftw_free(in);
+    fftw_free(out);
+}
+
+RealFFT::RealFFT(std::size_t size, bool withInverse) : n(size)
+{
+    std::lock_guard<std::mutex> lock(plannerMutex);
+    plan = cachedPlan(n);
+    if (withInverse)
+        inversePlan = cachedPlan(n, true);
+}
+
+void RealFFT::forward(Workspace &workspace) const
+{
+    fftw_execute_dft_r2c(plan, workspace.in, workspace.out);
+}
+
+void RealFFT::inverse(Workspace &workspace) const
+{
+    fftw_execute_dft_c2r(inversePlan, workspace.out, workspace.in);
+}
+
+#endif
+
+std::vector<std::complex<double>> computeFFT(const std::vector<double> &signal)
+{
+    RealFFT fft(signal.size());
+    RealFFT::Workspace workspace(signal.size());
+    std::copy(signal.begin(), signal.end(), workspace.input());
+    fft.forward(workspace);
+    return std::vector<std::complex<double>>(workspace.output(), workspace.output() + fft.bins());
+}
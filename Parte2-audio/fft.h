@@ -0,0 +1,151 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifdef USE_FFT
+#include <fftw3.h>
+#endif
+
+// How hard the FFT planner searches for a fast plan
+enum class FftRigor
+{
+    Estimate,
+    Measure,
+    Patient,
+    Exhaustive
+};
+
+bool parseFftRigor(const std::string &name, FftRigor &rigor);
+
+// Planner settings used by every plan created afterwards. Plans found with
+// Measure or better are saved as FFTW wisdom in wisdomDirectory, one file per
+// transform size, and reused by later runs (an empty directory disables this).
+// Builds without FFTW ignore these settings.
+void configureFftPlanner(FftRigor rigor, const std::string &wisdomDirectory);
+
+// Self-contained mixed-radix complex FFT (Stockham autosort, radix 4 and 2 with
+// SSE2 butterflies, a direct DFT butterfly for 3, 5 and any other prime factor).
+// Works on split real / imaginary arrays so the inner loops are contiguous.
+class MixedRadixFFT
+{
+public:
+    explicit MixedRadixFFT(std::size_t size);
+
+    std::size_t size() const { return n; }
+
+    // Forward transform of (re, im) in place; the scratch arrays need size() values
+    void forward(double *re, double *im, double *scratchRe, double *scratchIm) const;
+
+private:
+    struct Stage
+    {
+        std::size_t radix;
+        std::size_t length; // length of the sub-transforms this stage splits
+        std::size_t stride;
+        std::vector<double> twiddleRe; // (length / radix) x (radix - 1)
+        std::vector<double> twiddleIm;
+        std::vector<double> rootRe; // exp(-2 pi i j / radix), generic radices only
+        std::vector<double> rootIm;
+    };
+
+    std::size_t n;
+    std::vector<Stage> stages;
+};
+
+// Real-to-complex FFT on top of MixedRadixFFT: an even-sized real signal is
+// transformed as a complex signal of half the size and then split apart.
+class BuiltinRealFFT
+{
+public:
+    class Workspace
+    {
+    public:
+        explicit Workspace(std::size_t size);
+
+        double *input() { return in.data(); }
+        std::complex<double> *output() { return out.data(); }
+        const std::complex<double> *output() const { return out.data(); }
+
+    private:
+        friend class BuiltinRealFFT;
+        std::vector<double> in;
+        std::vector<std::complex<double>> out;
+        std::vector<double> re, im, scratchRe, scratchIm;
+    };
+
+    // withInverse only matters for FFTW, which plans the inverse separately
+    explicit BuiltinRealFFT(std::size_t size, bool withInverse = false);
+
+    std::size_t size() const { return n; }
+    std::size_t bins() const { return n / 2 + 1; }
+
+    // Transforms workspace.input() (size() samples) into workspace.output() (bins() values)
+    void forward(Workspace &workspace) const;
+    // Transforms the Hermitian spectrum in workspace.output() back into
+    // workspace.input(), unnormalized (scaled by size()) like FFTW's c2r;
+    // output() is overwritten
+    void inverse(Workspace &workspace) const;
+
+private:
+    std::size_t n;
+    MixedRadixFFT complexFft;
+    std::vector<std::complex<double>> post; // exp(-2 pi i k / n), k = 0 .. n / 2
+};
+
+#ifdef USE_FFT
+// Real-to-complex FFT through FFTW. Plans come from a process-wide cache, so
+// every RealFFT of the same size shares one plan. forward() uses FFTW's
+// new-array execute, so a plan can run on several threads at the same time as
+// long as every thread has its own Workspace.
+class RealFFT
+{
+public:
+    // Input / output arrays, allocated with the alignment the plan was made for
+    class Workspace
+    {
+    public:
+        explicit Workspace(std::size_t size);
+        ~Workspace();
+        Workspace(const Workspace &) = delete;
+        Workspace &operator=(const Workspace &) = delete;
+
+        double *input() { return in; }
+        std::complex<double> *output() { return reinterpret_cast<std::complex<double> *>(out); }
+        const std::complex<double> *output() const { return reinterpret_cast<const std::complex<double> *>(out); }
+
+    private:
+        friend class RealFFT;
+        double *in;
+        fftw_complex *out;
+    };
+
+    // withInverse also plans the complex-to-real transform for inverse()
+    explicit RealFFT(std::size_t size, bool withInverse = false);
+
+    std::size_t size() const { return n; }
+    std::size_t bins() const { return n / 2 + 1; }
+
+    // Transforms workspace.input() (size() samples) into workspace.output() (bins() values)
+    void forward(Workspace &workspace) const;
+    // Transforms the Hermitian spectrum in workspace.output() back into
+    // workspace.input(), unnormalized (scaled by size()); output() is
+    // overwritten. Needs withInverse.
+    void inverse(Workspace &workspace) const;
+
+private:
+    std::size_t n;
+    fftw_plan plan;
+    fftw_plan inversePlan = nullptr;
+};
+#else
+using RealFFT = BuiltinRealFFT;
+#endif
+
+// Spectrum of a real signal: bins 0 .. n / 2 of its DFT
+std::vector<std::complex<double>> computeFFT(const std::vector<double> &signal);
+
+#endif
@@ -0,0 +1,357 @@
+#include "fingerprint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#include "audio_source.h"
+
+namespace
+{
+// Peak picking
+const std::uint32_t firstBin = 2; // above 15 Hz
+const std::uint32_t lastBin = 510; // two bins below Nyquist; anchor bins fit in 9 bits
+const float floorDb = -30.0f;     // quieter bins never become peaks (about -78 dBFS)
+const float decayDb = 0.4f;       // threshold decay per frame
+const float spreadBins = 16.0f;   // standard deviation of the threshold raised around a peak
+const std::size_t maxPeaksPerFrame = 3;
+
+// Pairing: targets up to 31 frames (1 s) later and 63 bins (490 Hz) away
+const std::uint32_t maxFrameDistance = 31;
+const int maxBinDistance = 63;
+const int fanout = 4;
+
+// Postings: hash 21 bits | file 19 bits | frame 24 bits
+const int frameBits = 24;
+const int fileBits = 19;
+const int hashShift = frameBits + fileBits;
+const int directoryBits = 12;
+const int bucketShift = hashShift + 21 - directoryBits;
+
+std::uint32_t landmarkHash(std::uint32_t bin, int binDistance, std::uint32_t frameDistance)
+{
+    return (bin << 12) | (static_cast<std::uint32_t>(binDistance + 64) << 5) | frameDistance;
+}
+
+const std::size_t headerBytes = 4 + 4 + 4 + 8 + 3 * 4;
+}
+
+Fingerprinter::Fingerprinter(unsigned int input_rate, ThreadPool &pool)
+    : stft(StftConfig{frameSize, hop, WindowType::Hann}, pool), threshold(frameSize / 2 + 1, floorDb), levels(frameSize / 2 + 1)
+{
+    // Peaks only need the spectrum up to 4 kHz roughly right: the fast filter will do
+    ResamplerConfig config;
+    parseResamplerQuality("fast", config);
+    if (input_rate != rate)
+        resampler = std::make_unique<PolyphaseResampler>(input_rate, rate, 1, config);
+    stft.addSink([this](std::uint64_t first, const float *rows, std::size_t n) { consume(first, rows, n); });
+}
+
+void Fingerprinter::feed(const float *samples, std::size_t count)
+{
+    if (resampler)
+    {
+        count = resampler->process(samples, count, resampled);
+        samples = resampled.data();
+    }
+    block.assign(samples, samples + count);
+    stft.feed(block.data(), block.size());
+}
+
+void Fingerprinter::finish()
+{
+    if (resampler)
+    {
+        std::size_t count = resampler->flush(resampled);
+        block.assign(resampled.data(), resampled.data() + count);
+        stft.feed(block.data(), block.size());
+    }
+    stft.finish();
+}
+
+void Fingerprinter::consume(std::uint64_t firstFrame, const float *magnitudes, std::size_t frames)
+{
+    const std::size_t bins = frameSize / 2 + 1;
+    for (std::size_t f = 0; f < frames; ++f)
+    {
+        const std::uint32_t frame = static_cast<std::uint32_t>(firstFrame + f);
+        const float *row = magnitudes + f * bins;
+        for (std::size_t b = 0; b < bins; ++b)
+        {
+            levels[b] = 20.0f * std::log10(std::max(row[b], 1e-6f));
+            threshold[b] = std::max(floorDb, threshold[b] - decayDb);
+        }
+
+        // Peaks more than a second old get no more targets
+        while (!anchors.empty() && frame - anchors.front().frame > maxFrameDistance)
+            anchors.pop_front();
+
+        // Local maxima over two bins either side, above the threshold
+        candidates.clear();
+        for (std::uint32_t b = firstBin; b <= lastBin; ++b)
+        {
+            float level = levels[b];
+            if (level > threshold[b] && level > levels[b - 1] && level > levels[b - 2] && level >= levels[b + 1] && level >= levels[b + 2])
+                candidates.push_back(b);
+        }
+        std::sort(candidates.begin(), candidates.end(), [&](std::uint32_t a, std::uint32_t b) { return levels[a] > levels[b]; });
+
+        // Strongest first; each accepted peak masks its neighbourhood
+        std::size_t firstNew = anchors.size();
+        for (std::uint32_t b : candidates)
+        {
+            if (anchors.size() - firstNew == maxPeaksPerFrame)
+                break;
+            if (levels[b] <= threshold[b])
+                continue;
+            for (std::size_t j = 0; j < bins; ++j)
+            {
+                float d = (static_cast<float>(j) - b) / spreadBins;
+                threshold[j] = std::max(threshold[j], levels[b] - 4.343f * d * d);
+            }
+            anchors.push_back({frame, b, 0});
+        }
+        std::sort(anchors.begin() + static_cast<std::ptrdiff_t>(firstNew), anchors.end(),
+                  [](const Peak &a, const Peak &b) { return a.bin < b.bin; });
+
+        // The new peaks are targets for the earlier ones, nearest frames first
+        for (std::size_t t = firstNew; t < anchors.size(); ++t)
+        {
+            const Peak &target = anchors[t];
+            for (std::size_t a = 0; a < firstNew; ++a)
+            {
+                Peak &anchor = anchors[a];
+                int binDistance = static_cast<int>(target.bin) - static_cast<int>(anchor.bin);
+                if (anchor.pairs == fanout || std::abs(binDistance) > maxBinDistance)
+                    continue;
+                landmarks.push_back({landmarkHash(anchor.bin, binDistance, frame - anchor.frame), anchor.frame});
+                anchor.pairs++;
+            }
+        }
+    }
+}
+
+bool fingerprintFile(const std::string &path, ThreadPool &pool, std::vector<FingerprintHash> &hashes, double &seconds, std::string &error)
+{
+    AudioSource source;
+    if (!source.open(path))
+    {
+        error = "Failed to load audio file: " + path;
+        return false;
+    }
+    const unsigned int channels = source.channelCount();
+    seconds = static_cast<double>(source.frameCount()) / source.sampleRate();
+
+    Fingerprinter fingerprinter(source.sampleRate(), pool);
+    const std::size_t blockFrames = 65536;
+    std::vector<float> buffer, mono;
+    for (std::uint64_t position = 0; position < source.frameCount();)
+    {
+        BasicPcmView<float> block = source.read(position, blockFrames, buffer);
+        if (block.frames == 0)
+            break;
+        mono.resize(static_cast<std::size_t>(block.frames));
+        for (std::size_t i = 0; i < mono.size(); ++i)
+        {
+            float sum = 0.0f;
+            for (unsigned int c = 0; c < channels; ++c)
+                sum += block.at(i, c);
+            mono[i] = sum / channels;
+        }
+        fingerprinter.feed(mono.data(), mono.size());
+        position += block.frames;
+    }
+    fingerprinter.finish();
+    hashes = fingerprinter.hashes();
+    return true;
+}
+
+bool FingerprintIndex::addFile(const std::string &path, double seconds, const std::vector<FingerprintHash> &hashes)
+{
+    if (paths.size() == maxFiles)
+        return false;
+    const std::uint64_t file = paths.size();
+    paths.push_back(path);
+    durations.push_back(seconds);
+    for (const FingerprintHash &landmark : hashes)
+    {
+        if (landmark.frame >> frameBits)
+            continue;
+        postings.push_back((static_cast<std::uint64_t>(landmark.hash) << hashShift) | (file << frameBits) | landmark.frame);
+    }
+    return true;
+}
+
+void FingerprintIndex::build()
+{
+    std::sort(postings.begin(), postings.end());
+    directory.assign((std::size_t(1) << directoryBits) + 1, 0);
+    std::size_t i = 0;
+    for (std::size_t bucket = 0; bucket < directory.size(); ++bucket)
+    {
+        while (i < postings.size() && (postings[i] >> bucketShift) < bucket)
+            i++;
+        directory[bucket] = i;
+    }
+}
+
+double FingerprintIndex::audioSeconds() const
+{
+    double seconds = 0.0;
+    for (double duration : durations)
+        seconds += duration;
+    return seconds;
+}
+
+std::uint64_t FingerprintIndex::sizeBytes() const
+{
+    std::uint64_t bytes = headerBytes;
+    for (const std::string &path : paths)
+        bytes += 4 + path.size() + 8;
+    return bytes + (directory.size() + postings.size()) * sizeof(std::uint64_t);
+}
+
+bool FingerprintIndex::save(const std::string &filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    std::uint32_t version = 1;
+    std::uint32_t files = static_cast<std::uint32_t>(paths.size());
+    std::uint64_t count = postings.size();
+    std::uint32_t framing[3] = {Fingerprinter::rate, static_cast<std::uint32_t>(Fingerprinter::frameSize), static_cast<std::uint32_t>(Fingerprinter::hop)};
+    file.write("P2FP", 4);
+    file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char *>(&files), sizeof(files));
+    file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    file.write(reinterpret_cast<const char *>(framing), sizeof(framing));
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        std::uint32_t length = static_cast<std::uint32_t>(paths[i].size());
+        file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+        file.write(paths[i].data(), length);
+        file.write(reinterpret_cast<const char *>(&durations[i]), sizeof(double));
+    }
+    file.write(reinterpret_cast<const char *>(directory.data()), static_cast<std::streamsize>(directory.size() * sizeof(std::uint64_t)));
+    file.write(reinterpret_cast<const char *>(postings.data()), static_cast<std::streamsize>(postings.size() * sizeof(std::uint64_t)));
+    return static_cast<bool>(file);
+}
+
+bool FingerprintIndex::load(const std::string &filename, std::string &error)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        error = "Cannot open fingerprint index " + filename;
+        return false;
+    }
+
+    char magic[4];
+    std::uint32_t version = 0, files = 0;
+    std::uint64_t count = 0;
+    std::uint32_t framing[3] = {};
+    file.read(magic, 4);
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    file.read(reinterpret_cast<char *>(&files), sizeof(files));
+    file.read(reinterpret_cast<char *>(&count), sizeof(count));
+    file.read(reinterpret_cast<char *>(framing), sizeof(framing));
+    if (!file || std::memcmp(magic, "P2FP", 4) != 0 || version != 1 || files > maxFiles)
+    {
+        error = filename + " is not a fingerprint index";
+        return false;
+    }
+    if (framing[0] != Fingerprinter::rate || framing[1] != Fingerprinter::frameSize || framing[2] != Fingerprinter::hop)
+    {
+        error = filename + " was built with different fingerprint settings";
+        return false;
+    }
+
+    paths.resize(files);
+    durations.resize(files);
+    for (std::uint32_t i = 0; i < files && file; ++i)
+    {
+        std::uint32_t length = 0;
+        file.read(reinterpret_cast<char *>(&length), sizeof(length));
+        if (!file || length > 65536)
+            break;
+        paths[i].resize(length);
+        file.read(&paths[i][0], length);
+        file.read(reinterpret_cast<char *>(&durations[i]), sizeof(double));
+    }
+
+    // The postings must be all that is left of the file
+    std::streamoff start = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::uint64_t left = file ? static_cast<std::uint64_t>(file.tellg() - start) : 0;
+    std::uint64_t directoryBytes = ((std::uint64_t(1) << directoryBits) + 1) * sizeof(std::uint64_t);
+    if (!file || left != directoryBytes + count * sizeof(std::uint64_t))
+    {
+        error = filename + " is truncated";
+        return false;
+    }
+    file.seekg(start);
+    directory.resize((std::size_t(1) << directoryBits) + 1);
+    postings.resize(static_cast<std::size_t>(count));
+    file.read(reinterpret_cast<char *>(directory.data()), static_cast<std::streamsize>(directoryBytes));
+    file.read(reinterpret_cast<char *>(postings.data()), static_cast<std::streamsize>(count * sizeof(std::uint64_t)));
+    if (!file || directory.back() != count)
+    {
+        error = filename + " is corrupt";
+        return false;
+    }
+    return true;
+}
+
+std::vector<FingerprintMatch> FingerprintIndex::query(const std::vector<FingerprintHash> &hashes, std::size_t maxMatches, std::uint32_t minScore) const
+{
+    // Votes per (file, offset in frames), the offset biased to stay unsigned
+    std::unordered_map<std::uint64_t, std::uint32_t> votes;
+    const std::int64_t bias = std::int64_t(1) << 31;
+    for (const FingerprintHash &landmark : hashes)
+    {
+        std::uint64_t low = static_cast<std::uint64_t>(landmark.hash) << hashShift;
+        std::uint64_t high = static_cast<std::uint64_t>(landmark.hash + 1) << hashShift;
+        std::size_t bucket = landmark.hash >> (21 - directoryBits);
+        auto first = std::lower_bound(postings.begin() + static_cast<std::ptrdiff_t>(directory[bucket]),
+                                      postings.begin() + static_cast<std::ptrdiff_t>(directory[bucket + 1]), low);
+        for (auto it = first; it != postings.end() && *it < high; ++it)
+        {
+            std::uint64_t file = (*it >> frameBits) & ((std::uint64_t(1) << fileBits) - 1);
+            std::int64_t offset = static_cast<std::int64_t>(*it & ((std::uint64_t(1) << frameBits) - 1)) - landmark.frame;
+            votes[(file << 32) | static_cast<std::uint64_t>(offset + bias)]++;
+        }
+    }
+
+    // A clip rarely starts on the file's frame grid, so peaks land one frame
+    // either way: an offset also counts the votes of the next one
+    std::unordered_map<std::uint64_t, std::pair<std::uint32_t, std::int64_t>> best;
+    for (const auto &vote : votes)
+    {
+        auto next = votes.find(vote.first + 1);
+        std::uint32_t score = vote.second + (next != votes.end() ? next->second : 0);
+        std::uint64_t file = vote.first >> 32;
+        std::int64_t offset = static_cast<std::int64_t>(vote.first & 0xFFFFFFFFu) - bias;
+        auto &entry = best[file];
+        if (score > entry.first || (score == entry.first && offset < entry.second))
+            entry = {score, offset};
+    }
+
+    // Unrelated files always share a few chance alignments, more for longer clips
+    minScore = std::max<std::uint32_t>(minScore, static_cast<std::uint32_t>(hashes.size() / 20));
+    std::vector<FingerprintMatch> matches;
+    for (const auto &entry : best)
+    {
+        if (entry.second.first >= minScore)
+            matches.push_back({static_cast<std::size_t>(entry.first), entry.second.second * static_cast<double>(Fingerprinter::hop) / Fingerprinter::rate,
+                               entry.second.first});
+    }
+    std::sort(matches.begin(), matches.end(), [](const FingerprintMatch &a, const FingerprintMatch &b) {
+        return a.score != b.score ? a.score > b.score : a.file < b.file;
+    });
+    if (matches.size() > maxMatches)
+        matches.resize(maxMatches);
+    return matches;
+}
@@ -0,0 +1,118 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "resampler.h"
+#include "stft.h"
+#include "thread_pool.h"
+
+// One landmark: a 21-bit hash of a pair of spectral peaks (anchor bin, bin
+// difference, frame difference) and the frame of its anchor
+struct FingerprintHash
+{
+    std::uint32_t hash;
+    std::uint32_t frame;
+};
+
+// Landmark fingerprints of a mono signal, streamed. The signal is resampled
+// to 8 kHz and cut into 1024-sample Hann frames every 256 samples (32 ms).
+// Peaks are picked frame by frame: local maxima in frequency that rise above
+// a per-bin threshold which decays over time and is raised around every
+// accepted peak, at most a few per frame. Each peak is then paired with the
+// first peaks that follow it within a second and a few hundred Hz, and every
+// pair becomes one hash. Loudness does not matter, only where peaks are.
+class Fingerprinter
+{
+public:
+    static const unsigned int rate = 8000;
+    static const std::size_t frameSize = 1024;
+    static const std::size_t hop = 256;
+
+    Fingerprinter(unsigned int input_rate, ThreadPool &pool);
+
+    void feed(const float *samples, std::size_t count);
+    void finish();
+
+    const std::vector<FingerprintHash> &hashes() const { return landmarks; }
+
+private:
+    struct Peak
+    {
+        std::uint32_t frame;
+        std::uint32_t bin;
+        int pairs;
+    };
+
+    void consume(std::uint64_t firstFrame, const float *magnitudes, std::size_t frames);
+
+    std::unique_ptr<PolyphaseResampler> resampler; // only when the input is not at `rate`
+    StftEngine stft;
+    std::vector<float> resampled;
+    std::vector<double> block;
+    std::vector<float> threshold; // dB, per bin
+    std::vector<float> levels;    // scratch: dB of the current frame
+    std::vector<std::uint32_t> candidates;
+    std::deque<Peak> anchors; // peaks that may still get targets
+    std::vector<FingerprintHash> landmarks;
+};
+
+// Fingerprints a whole audio file (mixed down to mono); false with error set
+// if it cannot be opened
+bool fingerprintFile(const std::string &path, ThreadPool &pool, std::vector<FingerprintHash> &hashes, double &seconds, std::string &error);
+
+struct FingerprintMatch
+{
+    std::size_t file;    // index into the index's file table
+    double offset;       // where the clip starts in that file, in seconds
+    std::uint32_t score; // hashes that agree on that offset
+};
+
+// Inverted index from hash to (file, frame) postings. Postings are packed
+// into 64-bit keys (hash: 21 bits, file: 19 bits, frame: 24 bits) and kept
+// sorted, with a directory of where every 2^12 hashes start, so a lookup is
+// one short binary search. A query votes for (file, offset) pairs and a file
+// matches at the offset most of its hashes agree on. On disk:
+//   char[4] "P2FP", uint32 version (1), uint32 file count, uint64 postings,
+//   uint32 rate, uint32 frame size, uint32 hop,
+//   per file: uint32 path length, path bytes, float64 duration in seconds,
+//   then 2^12 + 1 uint64 directory offsets and the uint64 postings (host byte order)
+class FingerprintIndex
+{
+public:
+    static const std::size_t maxFiles = std::size_t(1) << 19;
+
+    // Adds a file, dropping landmarks past 2^24 frames (about 149 hours);
+    // returns false when the file table is full
+    bool addFile(const std::string &path, double seconds, const std::vector<FingerprintHash> &hashes);
+    // Sorts the postings; needed after addFile() before queries and save()
+    void build();
+
+    bool save(const std::string &filename) const;
+    bool load(const std::string &filename, std::string &error);
+
+    // Files sharing at least minScore aligned hashes, and 5% of its hashes,
+    // with the clip, best first
+    std::vector<FingerprintMatch> query(const std::vector<FingerprintHash> &hashes, std::size_t maxMatches = 5,
+                                        std::uint32_t minScore = 8) const;
+
+    std::size_t fileCount() const { return paths.size(); }
+    const std::string &filePath(std::size_t file) const { return paths[file]; }
+    double audioSeconds() const;
+    std::uint64_t postingCount() const { return postings.size(); }
+    // Bytes save() writes
+    std::uint64_t sizeBytes() const;
+
+private:
+    std::vector<std::string> paths;
+    std::vector<double> durations;
+    std::vector<std::uint64_t> postings;
+    std::vector<std::uint64_t> directory;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "frame_features.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+// Lower edges of the band energy columns, in Hz
+const double bandEdges[] = {0, 125, 250, 500, 1000, 2000, 4000, 8000, 16000};
+const std::size_t bandCount = sizeof(bandEdges) / sizeof(bandEdges[0]);
+const std::size_t fixedColumns = 5; // rms, zcr, centroid, rolloff, flatness
+const double rolloffFraction = 0.85;
+}
+
+FrameFeatures::FrameFeatures(const StftConfig &config, unsigned int sample_rate, ThreadPool &pool)
+    : config(config), sample_rate(sample_rate), pool(pool), window(makeWindow(config.window, config.size)),
+      columns(fixedColumns + bandCount)
+{
+    for (double w : window)
+        windowPower += w * w;
+    std::size_t bins = config.size / 2 + 1;
+    for (double edge : bandEdges)
+        bandStart.push_back(std::min(bins, static_cast<std::size_t>(std::ceil(edge * config.size / sample_rate))));
+    bandStart.push_back(bins);
+}
+
+const std::vector<std::string> &FrameFeatures::columnNames()
+{
+    static const std::vector<std::string> names = [] {
+        std::vector<std::string> list = {"rms", "zcr", "centroid", "rolloff", "flatness"};
+        for (double edge : bandEdges)
+            list.push_back("band_" + std::to_string(static_cast<int>(edge)));
+        return list;
+    }();
+    return names;
+}
+
+void FrameFeatures::consume(std::uint64_t firstFrame, const double *samples, const float *magnitudes, std::size_t count)
+{
+    const std::size_t size = config.size;
+    const std::size_t bins = size / 2 + 1;
+    const double binWidth = static_cast<double>(sample_rate) / size;
+    const std::size_t first = static_cast<std::size_t>(firstFrame);
+    frame_count = firstFrame + count;
+    for (std::vector<float> &column : columns)
+        column.resize(static_cast<std::size_t>(frame_count));
+
+    pool.parallelFor(0, count, 8, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t f = begin; f < end; ++f)
+        {
+            // Time domain: the raw frame
+            const double *frame = samples + f * config.hop;
+            double squares = 0.0;
+            std::size_t crossings = 0;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                squares += frame[i] * frame[i];
+                if (i > 0 && (frame[i] < 0.0) != (frame[i - 1] < 0.0))
+                    crossings++;
+            }
+
+            // Spectral: the magnitude row of the STFT
+            const float *row = magnitudes + f * bins;
+            double magnitudeSum = 0.0, weightedSum = 0.0, powerSum = 0.0, logPowerSum = 0.0;
+            for (std::size_t b = 0; b < bins; ++b)
+            {
+                double magnitude = row[b];
+                double power = std::max(magnitude * magnitude, 1e-20);
+                magnitudeSum += magnitude;
+                weightedSum += magnitude * b * binWidth;
+                powerSum += power;
+                logPowerSum += std::log(power);
+            }
+            double rolloff = 0.0;
+            double cumulative = 0.0;
+            for (std::size_t b = 0; b < bins; ++b)
+            {
+                cumulative += row[b];
+                if (cumulative >= rolloffFraction * magnitudeSum)
+                {
+                    rolloff = b * binWidth;
+                    break;
+                }
+            }
+
+            std::size_t index = first + f;
+            columns[0][index] = static_cast<float>(std::sqrt(squares / size));
+            columns[1][index] = size > 1 ? static_cast<float>(crossings) / (size - 1) : 0.0f;
+            columns[2][index] = magnitudeSum > 0.0 ? static_cast<float>(weightedSum / magnitudeSum) : 0.0f;
+            columns[3][index] = static_cast<float>(rolloff);
+            columns[4][index] = static_cast<float>(std::exp(logPowerSum / bins) / (powerSum / bins));
+
+            // Parseval: the bins between DC and Nyquist stand for two, and the
+            // window's power is divided out to get the signal's mean square
+            for (std::size_t band = 0; band < bandCount; ++band)
+            {
+                double energy = 0.0;
+                for (std::size_t b = bandStart[band]; b < bandStart[band + 1]; ++b)
+                {
+                    double power = static_cast<double>(row[b]) * row[b];
+                    energy += (b == 0 || 2 * b == size) ? power : 2.0 * power;
+                }
+                energy /= size * windowPower;
+                columns[fixedColumns + band][index] = static_cast<float>(10.0 * std::log10(std::max(energy, 1e-12)));
+            }
+        }
+    });
+}
+
+bool FrameFeatures::save(const std::string &filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    std::uint32_t version = 1;
+    std::uint32_t header[4] = {static_cast<std::uint32_t>(columns.size()), sample_rate, static_cast<std::uint32_t>(config.size),
+                               static_cast<std::uint32_t>(config.hop)};
+    file.write("FEAT", 4);
+    file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char *>(&frame_count), sizeof(frame_count));
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    for (const std::string &name : columnNames())
+    {
+        char field[16] = {};
+        std::memcpy(field, name.data(), std::min(name.size(), sizeof(field) - 1));
+        file.write(field, sizeof(field));
+    }
+    for (const std::vector<float> &column : columns)
+        file.write(reinterpret_cast<const char *>(column.data()), static_cast<std::streamsize>(column.size() * sizeof(float)));
+    return static_cast<bool>(file);
+}
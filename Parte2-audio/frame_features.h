@@ -0,0 +1,54 @@
+#ifndef FRAME_FEATURES_H
+#define FRAME_FEATURES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stft.h"
+#include "thread_pool.h"
+
+// Per-frame features of one channel, one column each:
+//   rms       root mean square of the frame's samples
+//   zcr       fraction of neighbouring samples that change sign
+//   centroid  magnitude-weighted mean frequency, in Hz
+//   rolloff   frequency below which 85% of the spectral magnitude lies, in Hz
+//   flatness  geometric over arithmetic mean of the power spectrum (1 for a flat spectrum, near 0 for a tone)
+//   band_<Hz> mean square of the band starting at that frequency, in dB (0 dB is
+//             a full-scale square wave); octave bands from 0, 125, ..., 16000 Hz,
+//             the last one up to Nyquist
+// Frames are those of the STFT they are fed from, so the spectral columns come
+// from the FFT the spectrum plots already use. Each batch of frames is split
+// over the pool.
+class FrameFeatures
+{
+public:
+    FrameFeatures(const StftConfig &config, unsigned int sample_rate, ThreadPool &pool);
+
+    // StftFrameSink
+    void consume(std::uint64_t firstFrame, const double *samples, const float *magnitudes, std::size_t frames);
+
+    static const std::vector<std::string> &columnNames();
+    std::uint64_t frames() const { return frame_count; }
+    const std::vector<float> &column(std::size_t index) const { return columns[index]; }
+
+    // Writes the table column by column:
+    //   char[4] "FEAT", uint32 version (1), uint64 frames, uint32 columns,
+    //   uint32 sample rate, uint32 frame size, uint32 hop,
+    //   columns x char[16] names (zero-padded),
+    //   then columns x frames float32 values, one column after another (host byte order)
+    bool save(const std::string &filename) const;
+
+private:
+    StftConfig config;
+    unsigned int sample_rate;
+    ThreadPool &pool;
+    std::vector<double> window;
+    double windowPower = 0.0;           // sum of window^2
+    std::vector<std::size_t> bandStart; // first bin of every band, then bins()
+    std::uint64_t frame_count = 0;
+    std::vector<std::vector<float>> columns;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "histogram.h"
+
+#include <limits>
+
+namespace
+{
+// Frames below which a block is not worth splitting
+const std::size_t minFramesPerPart = 16384;
+
+// One pass over the frames: every channel, then MID and SIDE from the first two
+// (a mono channel is its own MID, with zero SIDE)
+void countFrames(const sf::Int16 *samples, std::size_t frames, unsigned int channels,
+                 std::uint32_t *channelCounts, std::uint32_t *mid, std::uint32_t *side)
+{
+    if (channels == 2)
+    {
+        std::uint32_t *left = channelCounts;
+        std::uint32_t *right = channelCounts + 65536;
+        for (std::size_t i = 0; i < frames; ++i)
+        {
+            int l = samples[2 * i];
+            int r = samples[2 * i + 1];
+            left[l + 32768]++;
+            right[r + 32768]++;
+            mid[l + r + 65536]++;
+            side[l - r + 65535]++;
+        }
+        return;
+    }
+
+    for (std::size_t i = 0; i < frames; ++i)
+    {
+        const sf::Int16 *frame = samples + i * channels;
+        for (unsigned int c = 0; c < channels; ++c)
+            channelCounts[c * 65536 + frame[c] + 32768]++;
+        int l = frame[0];
+        int r = channels > 1 ? frame[1] : frame[0];
+        mid[l + r + 65536]++;
+        side[l - r + 65535]++;
+    }
+}
+}
+
+ChannelHistograms::ChannelHistograms(unsigned int channel_count, unsigned int max_parts)
+    : channel_count(channel_count),
+      channels(channel_count, HistogramAccumulator(-32768, 32767, 1.0 / 32768.0)),
+      midHistogram(-65536, 65534, 1.0 / 65536.0),
+      sideHistogram(-65535, 65535, 1.0 / 65536.0),
+      parts(std::max(1u, max_parts))
+{
+}
+
+void ChannelHistograms::add(const sf::Int16 *samples, std::size_t frames, ThreadPool &pool)
+{
+    std::size_t count = std::min<std::size_t>({parts.size(), pool.size(), std::max<std::size_t>(1, frames / minFramesPerPart)});
+
+    // 32-bit tables: fold them in before any count could wrap. Every part
+    // merges into the same accumulators, so this happens here, not in the
+    // parallel loop.
+    for (std::size_t p = 0; p < count; ++p)
+    {
+        std::size_t share = frames * (p + 1) / count - frames * p / count;
+        if (parts[p].frames + share > std::numeric_limits<std::uint32_t>::max())
+            flush(parts[p]);
+    }
+
+    pool.parallelFor(0, count, 1, [&](std::size_t first, std::size_t last) {
+        for (std::size_t p = first; p < last; ++p)
+        {
+            std::size_t begin = frames * p / count;
+            std::size_t end = frames * (p + 1) / count;
+            Part &part = parts[p];
+            if (part.mid.empty())
+            {
+                part.channels.assign(static_cast<std::size_t>(channel_count) * 65536, 0);
+                part.mid.assign(131071, 0);
+                part.side.assign(131071, 0);
+            }
+            countFrames(samples + begin * channel_count, end - begin, channel_count, part.channels.data(), part.mid.data(), part.side.data());
+            part.frames += end - begin;
+        }
+    });
+}
+
+void ChannelHistograms::finish()
+{
+    for (Part &part : parts)
+        flush(part);
+}
+
+void ChannelHistograms::flush(Part &part)
+{
+    if (part.frames == 0)
+        return;
+    for (unsigned int c = 0; c < channel_count; ++c)
+        channels[c].merge(part.channels.data() + static_cast<std::size_t>(c) * 65536);
+    midHistogram.merge(part.mid.data());
+    sideHistogram.merge(part.side.data());
+    std::fill(part.channels.begin(), part.channels.end(), 0);
+    std::fill(part.mid.begin(), part.mid.end(), 0);
+    std::fill(part.side.begin(), part.side.end(), 0);
+    part.frames = 0;
+}
@@ -0,0 +1,178 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <SFML/Config.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Summary of a histogram, in plotted amplitude units
+struct HistogramStats
+{
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    double entropy = 0.0; // bits per sample
+};
+
+// Exact counts of integer-valued samples (value * scale is the plotted amplitude).
+// The num_bins histogram over the observed [min, max] range is derived from the
+// counts at the end, so the samples never have to be kept or read twice.
+class HistogramAccumulator
+{
+public:
+    HistogramAccumulator(int min_value, int max_value, double scale)
+        : min_value(min_value), scale(scale), counts(max_value - min_value + 1, 0) {}
+
+    void add(int value)
+    {
+        counts[value - min_value]++;
+    }
+
+    bool empty() const
+    {
+        return std::all_of(counts.begin(), counts.end(), [](std::uint64_t c){ return c == 0; });
+    }
+
+    HistogramStats stats() const
+    {
+        HistogramStats stats;
+        std::uint64_t total = 0;
+        double sum = 0.0;
+        double sum_squares = 0.0;
+        bool first = true;
+        for (size_t i = 0; i < counts.size(); ++i){
+            if (counts[i] == 0)
+                continue;
+            double value = (static_cast<int>(i) + min_value) * scale;
+            if (first)
+                stats.min = value;
+            stats.max = value;
+            first = false;
+            total += counts[i];
+            sum += counts[i] * value;
+            sum_squares += counts[i] * value * value;
+        }
+        if (total == 0)
+            return stats;
+        stats.mean = sum / total;
+        stats.stddev = std::sqrt(std::max(0.0, sum_squares / total - stats.mean * stats.mean));
+        for (std::uint64_t c : counts){
+            if (c > 0){
+                double p = static_cast<double>(c) / total;
+                stats.entropy -= p * std::log2(p);
+            }
+        }
+        return stats;
+    }
+
+    int lowestValue() const
+    {
+        return min_value;
+    }
+
+    // counts[i] is the number of samples equal to lowestValue() + i
+    const std::vector<std::uint64_t> &valueCounts() const
+    {
+        return counts;
+    }
+
+    // Adds a table of partial counts laid out like valueCounts()
+    void merge(const std::uint32_t *partial)
+    {
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] += partial[i];
+    }
+
+    // One bin per representable value over the whole fixed range: no min / max
+    // scan and no rounding into bins
+    void exact(std::vector<double> &bin_centers, std::vector<std::uint64_t> &bins, double &bin_width) const
+    {
+        bin_centers.resize(counts.size());
+        for (size_t i = 0; i < counts.size(); ++i)
+            bin_centers[i] = (static_cast<int>(i) + min_value) * scale;
+        bins = counts;
+        bin_width = scale;
+    }
+
+    void binned(int num_bins, std::vector<double> &bin_centers, std::vector<std::uint64_t> &bins, double &bin_width) const
+    {
+        // Find the range of the data
+        size_t first = 0;
+        while (first < counts.size() && counts[first] == 0)
+            first++;
+        size_t last = counts.size() - 1;
+        while (last > first && counts[last] == 0)
+            last--;
+        double min_val = (static_cast<int>(first) + min_value) * scale;
+        double max_val = (static_cast<int>(last) + min_value) * scale;
+
+        // Fill the bins
+        bins.assign(num_bins, 0);
+        bin_width = (max_val - min_val) / num_bins;
+        for (size_t i = first; i <= last; ++i){
+            if (counts[i] == 0)
+                continue;
+            double value = (static_cast<int>(i) + min_value) * scale;
+            int bin = bin_width > 0 ? static_cast<int>((value - min_val) / bin_width) : 0;
+            if (bin == num_bins)
+                bin--; // Handle edge case for maximum value
+            bins[bin] += counts[i];
+        }
+
+        // Create x-axis values (bin centers)
+        bin_centers.resize(num_bins);
+        for (int i = 0; i < num_bins; i++){
+            bin_centers[i] = min_val + (i + 0.5) * bin_width;
+        }
+    }
+
+private:
+    int min_value;
+    double scale;
+    std::vector<std::uint64_t> counts;
+};
+
+// Histograms of every channel plus MID (l + r) and SIDE (l - r) of interleaved
+// int16 frames, filled by one fused pass over the samples. Large blocks are split
+// over the pool; every part counts into its own 32-bit tables, which are folded
+// into the exact 64-bit accumulators only when they could overflow or when the
+// results are read, so the parts never share a cache line.
+class ChannelHistograms
+{
+public:
+    explicit ChannelHistograms(unsigned int channel_count, unsigned int max_parts = 8);
+
+    void add(const sf::Int16 *samples, std::size_t frames, ThreadPool &pool);
+
+    // Fold the per-part tables into the accumulators before reading them
+    void finish();
+
+    const HistogramAccumulator &channel(unsigned int c) const { return channels[c]; }
+    const HistogramAccumulator &mid() const { return midHistogram; }
+    const HistogramAccumulator &side() const { return sideHistogram; }
+
+private:
+    struct Part
+    {
+        std::vector<std::uint32_t> channels; // channel_count x 65536
+        std::vector<std::uint32_t> mid;      // 131071
+        std::vector<std::uint32_t> side;     // 131071
+        std::uint64_t frames = 0;
+    };
+
+    void flush(Part &part);
+
+    unsigned int channel_count;
+    std::vector<HistogramAccumulator> channels;
+    HistogramAccumulator midHistogram;
+    HistogramAccumulator sideHistogram;
+    std::vector<Part> parts;
+};
+
+#endif
@@ -0,0 +1,472 @@
+#include "lossless.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include "bitstream.h"
+
+namespace
+{
+// Stream header: magic, version, channels, sample rate, frames, block frames,
+// block count; then the byte size of every block and the blocks themselves
+const std::uint8_t magic[4] = {'P', '2', 'L', 'A'};
+const std::uint8_t formatVersion = 1;
+const std::size_t headerBytes = 26;
+// Block sizes the encoder clamps LosslessOptions::blockFrames to
+const std::size_t minBlockFrames = 16;
+const std::size_t maxBlockFrames = std::size_t(1) << 20;
+
+const int maxFixedOrder = 4;
+const unsigned int orderBits = 3;
+const unsigned int partitionOrderBits = 4;
+const unsigned int riceParameterBits = 5;
+const unsigned int maxRiceParameter = 30;
+
+enum SubframeType : std::uint32_t
+{
+    Constant = 0,
+    Fixed = 1,
+    Verbatim = 2
+};
+
+// How a stereo pair is coded; side = left - right, mid = (left + right) >> 1
+enum StereoMode : std::uint32_t
+{
+    LeftRight = 0,
+    LeftSide = 1,
+    SideRight = 2,
+    MidSide = 3
+};
+
+// Working buffers of one thread, reused from block to block
+struct Scratch
+{
+    std::vector<std::int32_t> planes[4];
+    std::vector<std::uint32_t> residuals;
+};
+
+void putLittleEndian(std::vector<std::uint8_t> &out, std::uint64_t value, int bytes)
+{
+    for (int b = 0; b < bytes; ++b)
+        out.push_back(static_cast<std::uint8_t>(value >> (8 * b)));
+}
+
+std::uint64_t getLittleEndian(const std::uint8_t *data, int bytes)
+{
+    std::uint64_t value = 0;
+    for (int b = bytes - 1; b >= 0; --b)
+        value = (value << 8) | data[b];
+    return value;
+}
+
+// Picks the fixed predictor order with the smallest sum of |residual|, measured
+// over the samples every order can predict; cost receives that sum
+int chooseFixedOrder(const std::int32_t *s, std::size_t n, std::uint64_t &cost)
+{
+    std::uint64_t sums[maxFixedOrder + 1] = {};
+    for (std::size_t i = maxFixedOrder; i < n; ++i)
+    {
+        std::int32_t d1 = s[i] - s[i - 1], d1a = s[i - 1] - s[i - 2], d1b = s[i - 2] - s[i - 3], d1c = s[i - 3] - s[i - 4];
+        std::int32_t e2 = d1 - d1a, e2a = d1a - d1b, e2b = d1b - d1c;
+        std::int32_t e3 = e2 - e2a, e3a = e2a - e2b;
+        std::int32_t e4 = e3 - e3a;
+        sums[0] += static_cast<std::uint32_t>(std::abs(s[i]));
+        sums[1] += static_cast<std::uint32_t>(std::abs(d1));
+        sums[2] += static_cast<std::uint32_t>(std::abs(e2));
+        sums[3] += static_cast<std::uint32_t>(std::abs(e3));
+        sums[4] += static_cast<std::uint32_t>(std::abs(e4));
+    }
+    int order = 0;
+    for (int o = 1; o <= maxFixedOrder; ++o)
+    {
+        if (sums[o] < sums[order])
+            order = o;
+    }
+    cost = sums[order];
+    return n > maxFixedOrder ? order : 0;
+}
+
+// Zigzagged residuals of the fixed predictor, from index `order` on
+void fixedResiduals(const std::int32_t *s, std::size_t n, int order, std::uint32_t *residuals)
+{
+    switch (order)
+    {
+    case 0:
+        for (std::size_t i = 0; i < n; ++i)
+            residuals[i] = zigzagEncode(s[i]);
+        break;
+    case 1:
+        for (std::size_t i = 1; i < n; ++i)
+            residuals[i] = zigzagEncode(s[i] - s[i - 1]);
+        break;
+    case 2:
+        for (std::size_t i = 2; i < n; ++i)
+            residuals[i] = zigzagEncode(s[i] - 2 * s[i - 1] + s[i - 2]);
+        break;
+    case 3:
+        for (std::size_t i = 3; i < n; ++i)
+            residuals[i] = zigzagEncode(s[i] - 3 * s[i - 1] + 3 * s[i - 2] - s[i - 3]);
+        break;
+    default:
+        for (std::size_t i = 4; i < n; ++i)
+            residuals[i] = zigzagEncode(s[i] - 4 * s[i - 1] + 6 * s[i - 2] - 4 * s[i - 3] + s[i - 4]);
+        break;
+    }
+}
+
+// Undoes fixedResiduals in place: s holds the warm-up samples followed by residuals
+void restoreFixed(std::int32_t *s, std::size_t n, int order)
+{
+    switch (order)
+    {
+    case 0:
+        break;
+    case 1:
+        for (std::size_t i = 1; i < n; ++i)
+            s[i] += s[i - 1];
+        break;
+    case 2:
+        for (std::size_t i = 2; i < n; ++i)
+            s[i] += 2 * s[i - 1] - s[i - 2];
+        break;
+    case 3:
+        for (std::size_t i = 3; i < n; ++i)
+            s[i] += 3 * s[i - 1] - 3 * s[i - 2] + s[i - 3];
+        break;
+    default:
+        for (std::size_t i = 4; i < n; ++i)
+            s[i] += 4 * s[i - 1] - 6 * s[i - 2] + 4 * s[i - 3] - s[i - 4];
+        break;
+    }
+}
+
+// Residual range of partition p out of 2^partitionOrder: the first one starts
+// after the warm-up samples
+void partitionRange(std::size_t n, unsigned int partitionOrder, std::size_t p, int order, std::size_t &begin, std::size_t &end)
+{
+    std::size_t size = n >> partitionOrder;
+    begin = p == 0 ? static_cast<std::size_t>(order) : p * size;
+    end = (p + 1) * size;
+}
+
+// Partition order with the fewest residual bits (parameters included)
+unsigned int choosePartitionOrder(const std::uint32_t *residuals, std::size_t n, int order, int maxPartitionOrder, std::uint64_t &bits)
+{
+    unsigned int finest = 0;
+    while (static_cast<int>(finest) < maxPartitionOrder && n % (std::size_t(2) << finest) == 0 && (n >> (finest + 1)) >= static_cast<std::size_t>(order))
+        ++finest;
+
+    // Sums of the finest partitions; coarser orders merge neighbouring pairs
+    std::vector<std::uint64_t> sums(std::size_t(1) << finest, 0);
+    for (std::size_t p = 0; p < sums.size(); ++p)
+    {
+        std::size_t begin, end;
+        partitionRange(n, finest, p, order, begin, end);
+        for (std::size_t i = begin; i < end; ++i)
+            sums[p] += residuals[i];
+    }
+
+    unsigned int best = finest;
+    bits = ~std::uint64_t(0);
+    for (int partitionOrder = static_cast<int>(finest); partitionOrder >= 0; --partitionOrder)
+    {
+        std::size_t parts = std::size_t(1) << partitionOrder;
+        std::uint64_t total = parts * riceParameterBits;
+        for (std::size_t p = 0; p < parts; ++p)
+        {
+            std::size_t count = (n >> partitionOrder) - (p == 0 ? order : 0);
+            total += riceBits(sums[p], count, riceParameter(sums[p], count, maxRiceParameter));
+        }
+        if (total < bits)
+        {
+            bits = total;
+            best = static_cast<unsigned int>(partitionOrder);
+        }
+        for (std::size_t p = 0; p < parts / 2; ++p)
+            sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+    return best;
+}
+
+// Codes one channel of a block as a constant, fixed-predictor or verbatim subframe
+void encodeSubframe(BitWriter &out, const std::int32_t *s, std::size_t n, unsigned int sampleBits, int order, int maxPartitionOrder, Scratch &scratch)
+{
+    if (std::all_of(s + 1, s + n, [&](std::int32_t value) { return value == s[0]; }))
+    {
+        out.put(Constant, 2);
+        out.putSigned(s[0], sampleBits);
+        return;
+    }
+
+    scratch.residuals.resize(n);
+    std::uint32_t *residuals = scratch.residuals.data();
+    fixedResiduals(s, n, order, residuals);
+    std::uint64_t riceTotal;
+    unsigned int partitionOrder = choosePartitionOrder(residuals, n, order, maxPartitionOrder, riceTotal);
+
+    if (orderBits + order * sampleBits + partitionOrderBits + riceTotal >= n * sampleBits)
+    {
+        out.put(Verbatim, 2);
+        for (std::size_t i = 0; i < n; ++i)
+            out.putSigned(s[i], sampleBits);
+        return;
+    }
+
+    out.put(Fixed, 2);
+    out.put(static_cast<std::uint32_t>(order), orderBits);
+    for (int i = 0; i < order; ++i)
+        out.putSigned(s[i], sampleBits);
+    out.put(partitionOrder, partitionOrderBits);
+    for (std::size_t p = 0; p < (std::size_t(1) << partitionOrder); ++p)
+    {
+        std::size_t begin, end;
+        partitionRange(n, partitionOrder, p, order, begin, end);
+        std::uint64_t sum = 0;
+        for (std::size_t i = begin; i < end; ++i)
+            sum += residuals[i];
+        unsigned int k = riceParameter(sum, end - begin, maxRiceParameter);
+        out.put(k, riceParameterBits);
+        for (std::size_t i = begin; i < end; ++i)
+            out.putRice(residuals[i], k);
+    }
+}
+
+bool decodeSubframe(BitReader &in, std::int32_t *s, std::size_t n, unsigned int sampleBits)
+{
+    std::uint32_t type = in.get(2);
+    if (type == Constant)
+    {
+        std::fill(s, s + n, in.getSigned(sampleBits));
+    }
+    else if (type == Verbatim)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            s[i] = in.getSigned(sampleBits);
+    }
+    else if (type == Fixed)
+    {
+        int order = static_cast<int>(in.get(orderBits));
+        if (order > maxFixedOrder || static_cast<std::size_t>(order) > n)
+            return false;
+        for (int i = 0; i < order; ++i)
+            s[i] = in.getSigned(sampleBits);
+        unsigned int partitionOrder = in.get(partitionOrderBits);
+        if (n % (std::size_t(1) << partitionOrder) != 0 || (n >> partitionOrder) < static_cast<std::size_t>(order))
+            return false;
+        for (std::size_t p = 0; p < (std::size_t(1) << partitionOrder); ++p)
+        {
+            std::size_t begin, end;
+            partitionRange(n, partitionOrder, p, order, begin, end);
+            unsigned int k = in.get(riceParameterBits);
+            if (k > maxRiceParameter)
+                return false;
+            for (std::size_t i = begin; i < end; ++i)
+                s[i] = zigzagDecode(in.getRice(k));
+            if (in.overrun())
+                return false;
+        }
+        restoreFixed(s, n, order);
+    }
+    else
+        return false;
+    return !in.overrun();
+}
+
+void encodeBlock(BitWriter &out, const sf::Int16 *samples, std::size_t n, unsigned int channels, const LosslessOptions &options, Scratch &scratch)
+{
+    for (auto &plane : scratch.planes)
+        plane.resize(n);
+
+    if (channels == 2)
+    {
+        std::int32_t *left = scratch.planes[0].data();
+        std::int32_t *right = scratch.planes[1].data();
+        std::int32_t *mid = scratch.planes[2].data();
+        std::int32_t *side = scratch.planes[3].data();
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            left[i] = samples[2 * i];
+            right[i] = samples[2 * i + 1];
+            mid[i] = (left[i] + right[i]) >> 1;
+            side[i] = left[i] - right[i];
+        }
+
+        // Keep the pair with the smallest predicted residuals
+        std::uint64_t cost[4];
+        int order[4];
+        for (int p = 0; p < 4; ++p)
+            order[p] = chooseFixedOrder(scratch.planes[p].data(), n, cost[p]);
+        const int pairs[4][2] = {{0, 1}, {0, 3}, {3, 1}, {2, 3}};
+        std::uint32_t mode = LeftRight;
+        for (std::uint32_t m = 1; m < 4; ++m)
+        {
+            if (cost[pairs[m][0]] + cost[pairs[m][1]] < cost[pairs[mode][0]] + cost[pairs[mode][1]])
+                mode = m;
+        }
+
+        out.put(mode, 2);
+        for (int part = 0; part < 2; ++part)
+        {
+            int plane = pairs[mode][part];
+            encodeSubframe(out, scratch.planes[plane].data(), n, plane == 3 ? 17 : 16, order[plane], options.maxPartitionOrder, scratch);
+        }
+        return;
+    }
+
+    std::int32_t *plane = scratch.planes[0].data();
+    for (unsigned int c = 0; c < channels; ++c)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            plane[i] = samples[i * channels + c];
+        std::uint64_t cost;
+        int order = chooseFixedOrder(plane, n, cost);
+        encodeSubframe(out, plane, n, 16, order, options.maxPartitionOrder, scratch);
+    }
+}
+
+bool decodeBlock(BitReader &in, sf::Int16 *samples, std::size_t n, unsigned int channels, Scratch &scratch)
+{
+    for (int p = 0; p < 2; ++p)
+        scratch.planes[p].resize(n);
+    std::int32_t *a = scratch.planes[0].data();
+    std::int32_t *b = scratch.planes[1].data();
+
+    if (channels == 2)
+    {
+        std::uint32_t mode = in.get(2);
+        unsigned int firstBits = mode == SideRight ? 17 : 16;
+        unsigned int secondBits = mode == LeftSide || mode == MidSide ? 17 : 16;
+        if (!decodeSubframe(in, a, n, firstBits) || !decodeSubframe(in, b, n, secondBits))
+            return false;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::int32_t left, right;
+            switch (mode)
+            {
+            case LeftRight:
+                left = a[i];
+                right = b[i];
+                break;
+            case LeftSide:
+                left = a[i];
+                right = a[i] - b[i];
+                break;
+            case SideRight:
+                left = a[i] + b[i];
+                right = b[i];
+                break;
+            default:
+            {
+                // The bit mid lost to the shift is the low bit of side
+                std::int32_t sum = a[i] * 2 + (b[i] & 1);
+                left = (sum + b[i]) >> 1;
+                right = (sum - b[i]) >> 1;
+                break;
+            }
+            }
+            samples[2 * i] = static_cast<sf::Int16>(left);
+            samples[2 * i + 1] = static_cast<sf::Int16>(right);
+        }
+        return true;
+    }
+
+    for (unsigned int c = 0; c < channels; ++c)
+    {
+        if (!decodeSubframe(in, a, n, 16))
+            return false;
+        for (std::size_t i = 0; i < n; ++i)
+            samples[i * channels + c] = static_cast<sf::Int16>(a[i]);
+    }
+    return true;
+}
+}
+
+std::vector<std::uint8_t> encodeLossless(const sf::Int16 *samples, std::uint64_t frames, unsigned int channels, unsigned int sampleRate,
+                                         ThreadPool &pool, const LosslessOptions &options)
+{
+    std::size_t blockFrames = std::clamp<std::size_t>(options.blockFrames, minBlockFrames, maxBlockFrames);
+    std::size_t blocks = static_cast<std::size_t>((frames + blockFrames - 1) / blockFrames);
+
+    std::vector<std::vector<std::uint8_t>> payloads(blocks);
+    pool.parallelFor(0, blocks, 8, [&](std::size_t first, std::size_t last) {
+        Scratch scratch;
+        for (std::size_t b = first; b < last; ++b)
+        {
+            std::uint64_t start = static_cast<std::uint64_t>(b) * blockFrames;
+            std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(blockFrames, frames - start));
+            payloads[b].reserve(n * channels * 2);
+            BitWriter out(payloads[b]);
+            encodeBlock(out, samples + start * channels, n, channels, options, scratch);
+            out.flush();
+        }
+    });
+
+    std::size_t total = headerBytes + 4 * blocks;
+    for (const auto &payload : payloads)
+        total += payload.size();
+    std::vector<std::uint8_t> stream;
+    stream.reserve(total);
+    stream.insert(stream.end(), magic, magic + 4);
+    stream.push_back(formatVersion);
+    stream.push_back(static_cast<std::uint8_t>(channels));
+    putLittleEndian(stream, sampleRate, 4);
+    putLittleEndian(stream, frames, 8);
+    putLittleEndian(stream, blockFrames, 4);
+    putLittleEndian(stream, blocks, 4);
+    for (const auto &payload : payloads)
+        putLittleEndian(stream, payload.size(), 4);
+    for (const auto &payload : payloads)
+        stream.insert(stream.end(), payload.begin(), payload.end());
+    return stream;
+}
+
+bool decodeLossless(const std::uint8_t *data, std::size_t size, LosslessAudio &audio, ThreadPool &pool)
+{
+    if (size < headerBytes || std::memcmp(data, magic, 4) != 0 || data[4] != formatVersion)
+        return false;
+    unsigned int channels = data[5];
+    unsigned int sampleRate = static_cast<unsigned int>(getLittleEndian(data + 6, 4));
+    std::uint64_t frames = getLittleEndian(data + 10, 8);
+    std::uint64_t blockFrames = getLittleEndian(data + 18, 4);
+    std::uint64_t blocks = getLittleEndian(data + 22, 4);
+    // The block size is within the encoder's clamp and every block needs at
+    // least its constant subframes (2 + 16 bits per channel), so the blocks,
+    // and with them frames * channels, are bounded by the size of the stream
+    // before anything is allocated. frames must need exactly `blocks` blocks;
+    // this is checked without rounding frames up, which could wrap.
+    const std::size_t minBlockBytes = (channels * 18 + 7) / 8;
+    if (channels == 0 || blockFrames < minBlockFrames || blockFrames > maxBlockFrames || (size - headerBytes) / (4 + minBlockBytes) < blocks ||
+        frames > blocks * blockFrames || (blocks > 0 && frames <= (blocks - 1) * blockFrames))
+        return false;
+
+    std::vector<std::size_t> offsets(blocks + 1);
+    offsets[0] = headerBytes + 4 * blocks;
+    for (std::size_t b = 0; b < blocks; ++b)
+    {
+        std::size_t payload = static_cast<std::size_t>(getLittleEndian(data + headerBytes + 4 * b, 4));
+        if (payload < minBlockBytes)
+            return false;
+        offsets[b + 1] = offsets[b] + payload;
+    }
+    if (offsets[blocks] > size)
+        return false;
+
+    audio.channels = channels;
+    audio.sampleRate = sampleRate;
+    audio.samples.resize(frames * channels);
+    std::atomic<bool> failed{false};
+    pool.parallelFor(0, blocks, 8, [&](std::size_t first, std::size_t last) {
+        Scratch scratch;
+        for (std::size_t b = first; b < last && !failed; ++b)
+        {
+            std::uint64_t start = b * blockFrames;
+            std::size_t n = static_cast<std::size_t>(std::min(blockFrames, frames - start));
+            BitReader in(data + offsets[b], offsets[b + 1] - offsets[b]);
+            if (!decodeBlock(in, audio.samples.data() + start * channels, n, channels, scratch))
+                failed = true;
+        }
+    });
+    return !failed;
+}
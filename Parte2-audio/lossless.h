@@ -0,0 +1,38 @@
+#ifndef LOSSLESS_H
+#define LOSSLESS_H
+
+#include <SFML/Config.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Lossless codec for 16-bit PCM, in the spirit of FLAC's fixed subframes.
+// The signal is cut into independent blocks; in each block a stereo pair is
+// coded as whichever of left/right, left/side, side/right or mid/side is
+// cheapest, every channel is predicted by the fixed polynomial (order 0 - 4)
+// with the smallest residuals, and the residuals are Rice coded in 2^p
+// partitions, each with its own parameter. Blocks are coded in parallel and
+// the stream stores their sizes, so decoding runs in parallel too.
+struct LosslessOptions
+{
+    std::size_t blockFrames = 4096;
+    int maxPartitionOrder = 6;
+};
+
+// Encoded stream of `frames` interleaved frames (at most 255 channels)
+std::vector<std::uint8_t> encodeLossless(const sf::Int16 *samples, std::uint64_t frames, unsigned int channels, unsigned int sampleRate,
+                                         ThreadPool &pool, const LosslessOptions &options = LosslessOptions());
+
+struct LosslessAudio
+{
+    unsigned int channels = 0;
+    unsigned int sampleRate = 0;
+    std::vector<sf::Int16> samples; // interleaved
+};
+
+// Decodes a stream from encodeLossless; false if it is malformed or truncated
+bool decodeLossless(const std::uint8_t *data, std::size_t size, LosslessAudio &audio, ThreadPool &pool);
+
+#endif
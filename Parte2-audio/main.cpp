@@ -4,259 +4,393 @@
 #include <string>
 #include <complex>
 #include <filesystem>
-
-#ifdef USE_PLOTTING
-#include "gnuplot-iostream.h"
-#else
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <tuple>
+#include <memory>
 #include <fstream>
 #include <iomanip>
-#endif
-
-#ifdef USE_FFT
-#include <fftw3.h>
-#endif
+#include <map>
+#include <set>
+#include <cstdio>
+#include <type_traits>
+
+#include "channels.h"
+#include "correlation.h"
+#include "error_metrics.h"
+#include "audio_source.h"
+#include "thread_pool.h"
+#include "frame_features.h"
+#include "fft.h"
+#include "fingerprint.h"
+#include "stft.h"
+#include "waveform.h"
+#include "histogram.h"
+#include "lossless.h"
+#include "mdct.h"
+#include "chart.h"
+#include "plot_output.h"
+#include "plot_session.h"
+#include "profiler.h"
+#include "quantize.h"
+#include "resampler.h"
+#include "sample_format.h"
+#include "pcm_stream.h"
+#include "ring_buffer.h"
+
+
+// Basic properties of an audio file, as reported by TASK 1
+struct AudioInfo
+{
+    unsigned int sampleRate = 0;
+    unsigned int channelCount = 0;
+    std::uint64_t sampleCount = 0;
+    float duration = 0.0f;
+    unsigned int bitsPerSample = 16;
+    bool floatingPoint = false;
 
+    // Bits the quantizer counts from: the sample size, or the 24-bit mantissa of float samples
+    int resolutionBits() const { return floatingPoint ? SampleTraits<float>::bits : static_cast<int>(bitsPerSample); }
+};
 
 // Function to print audio information
-void printAudioInfo(const sf::SoundBuffer &buffer)
+void printAudioInfo(const AudioInfo &info)
 {
     std::cout << "Audio File Information:" << std::endl;
-    std::cout << "Sample Rate: " << buffer.getSampleRate() << " Hz" << std::endl;
-    std::cout << "Channel Count: " << buffer.getChannelCount() << std::endl;
-    std::cout << "Duration: " << buffer.getDuration().asSeconds() << " seconds" << std::endl;
-    std::cout << "Sample Count: " << buffer.getSampleCount() << std::endl;
-    std::cout << "Sample Size: " << sizeof(sf::Int16) * 8 << " bits" << std::endl;
+    std::cout << "Sample Rate: " << info.sampleRate << " Hz" << std::endl;
+    std::cout << "Channel Count: " << info.channelCount << std::endl;
+    std::cout << "Duration: " << info.duration << " seconds" << std::endl;
+    std::cout << "Sample Count: " << info.sampleCount << std::endl;
+    std::cout << "Sample Size: " << info.bitsPerSample << " bits" << (info.floatingPoint ? " (float)" : "") << std::endl;
 }
 
 // Function to plot waveform data
-void plotWaveform(const std::vector<double> &data_vector, unsigned int sample_rate, const std::string &channel_name)
+void plotWaveform(const std::vector<double> &time, const std::vector<double> &data, const std::string &channel_name)
 {
-    const size_t target_max_samples = 10000;
+    // Ensure that the output directory exists
+    std::string output_directory = "../outputs/waveforms/";
+    std::filesystem::create_directory("../outputs/");
+    std::filesystem::create_directory(output_directory);
 
-    // Calculate the downsampling factor
-    size_t downsample_factor = 1;
-    if (data_vector.size() > target_max_samples){
-        downsample_factor = std::ceil(static_cast<double>(data_vector.size()) / target_max_samples);
+    if (plotBackend() == PlotBackend::Native)
+    {
+        Chart chart(900, 300, channel_name, "Time (s)", "Amplitude");
+        chart.addLines(time, data, channel_name);
+        saveChartAsync(std::move(chart), output_directory + channel_name + ".png");
+        return;
     }
+#ifdef USE_PLOTTING
+    if (plotBackend() == PlotBackend::Gnuplot)
+    {
+        OutputTimer timer(output_directory + channel_name + ".png");
+
+        // Queue the plot on the shared gnuplot session
+        submitPlot([&](Gnuplot &gp) {
+            // Save to PNG file
+            gp << "set terminal pngcairo size 900,300\n";
+            gp << "set output '" << output_directory << channel_name << ".png'\n";
+            gp << "set title '" << channel_name << "'\n";
+            gp << "set xlabel 'Time (s)'\n";
+            gp << "set ylabel 'Amplitude'\n";
+            // Send the points as raw doubles rather than text
+            auto points = boost::make_tuple(time, data);
+            gp << "plot '-' binary" << gp.binFmt1d(points, "record") << " with lines title '" << channel_name << "'\n";
+            gp.sendBinary1d(points);
+        });
+        return;
+    }
+#endif
 
-    // Create downsampled data and time vectors
-    std::vector<double> downsampled_data;
-    std::vector<double> time;
-    downsampled_data.reserve(std::min(data_vector.size(), target_max_samples));
-    time.reserve(std::min(data_vector.size(), target_max_samples));
+    // Save data to CSV file
+    std::string filename = output_directory + channel_name + ".csv";
+    OutputTimer timer(filename);
+    CsvWriter outfile(filename);
+
+    // Write header
+    outfile.text("Time (s),Amplitude\n");
 
-    for (size_t i = 0; i < data_vector.size(); i += downsample_factor){
-        downsampled_data.push_back(data_vector[i]);
-        time.push_back(static_cast<double>(i) / sample_rate);
+    // Write data
+    for (size_t i = 0; i < data.size(); ++i){
+        outfile.row(time[i], data[i]);
     }
 
+    timer.setBytes(outfile.close());
+}
+
+// Plots a min / max envelope as a filled band
+void plotWaveform(const WaveformEnvelope &envelope, const std::string &channel_name)
+{
     // Ensure that the output directory exists
     std::string output_directory = "../outputs/waveforms/";
     std::filesystem::create_directory("../outputs/");
     std::filesystem::create_directory(output_directory);
 
+    if (plotBackend() == PlotBackend::Native)
+    {
+        Chart chart(900, 300, channel_name, "Time (s)", "Amplitude");
+        chart.addBand(envelope.time, envelope.min, envelope.max, channel_name);
+        saveChartAsync(std::move(chart), output_directory + channel_name + ".png");
+        return;
+    }
 #ifdef USE_PLOTTING
-    // Create a Gnuplot object with persist option
-    Gnuplot gp;
-
-    // Save to PNG file
-    gp << "set terminal pngcairo size 900,300\n";
-    gp << "set output '" << output_directory << channel_name << ".png'\n";
-    gp << "set title '" << channel_name << "'\n";
-    gp << "set xlabel 'Time (s)'\n";
-    gp << "set ylabel 'Amplitude'\n";
-    gp << "plot '-' with lines title '" << channel_name << "'\n";
-    gp.send1d(boost::make_tuple(time, downsampled_data));
-#else
-    // Save data to CSV file
-    std::string filename = output_directory + channel_name + ".csv";
-    std::ofstream outfile(filename);
-    outfile << std::setprecision(10); // Set precision for floating-point numbers
-    
-    // Write header
-    outfile << "Time (s),Amplitude\n";
-    
-    // Write data
-    for (size_t i = 0; i < downsampled_data.size(); ++i){
-        outfile << time[i] << "," << downsampled_data[i] << "\n";
+    if (plotBackend() == PlotBackend::Gnuplot)
+    {
+        OutputTimer timer(output_directory + channel_name + ".png");
+        submitPlot([&](Gnuplot &gp) {
+            // Save to PNG file
+            gp << "set terminal pngcairo size 900,300\n";
+            gp << "set output '" << output_directory << channel_name << ".png'\n";
+            gp << "set title '" << channel_name << "'\n";
+            gp << "set xlabel 'Time (s)'\n";
+            gp << "set ylabel 'Amplitude'\n";
+            auto points = boost::make_tuple(envelope.time, envelope.min, envelope.max);
+            gp << "plot '-' binary" << gp.binFmt1d(points, "record") << " using 1:2:3 with filledcurves title '" << channel_name << "'\n";
+            gp.sendBinary1d(points);
+        });
+        return;
     }
-    
-    outfile.close();
 #endif
-}
 
-void plotHistogram(const std::vector<double> &data, const std::string &title, int num_bins)
-{
-    // Find the range of the data
-    auto [min_it, max_it] = std::minmax_element(data.begin(), data.end());
-    double min_val = *min_it;
-    double max_val = *max_it;
+    // Save envelope data to CSV file
+    std::string filename = output_directory + channel_name + ".csv";
+    OutputTimer timer(filename);
+    CsvWriter outfile(filename);
 
-    // Create bins
-    std::vector<int> bins(num_bins, 0);
-    double bin_width = (max_val - min_val) / num_bins;
+    // Write header
+    outfile.text("Time (s),Min,Max\n");
 
-    // Fill the bins
-    for (double value : data){
-        int bin = static_cast<int>((value - min_val) / bin_width);
-        if (bin == num_bins)
-            bin--; // Handle edge case for maximum value
-        bins[bin]++;
+    // Write data
+    for (size_t i = 0; i < envelope.time.size(); ++i)
+    {
+        outfile.row(envelope.time[i], envelope.min[i], envelope.max[i]);
     }
 
-    // Create x-axis values (bin centers)
-    std::vector<double> bin_centers(num_bins);
-    for (int i = 0; i < num_bins; i++){
-        bin_centers[i] = min_val + (i + 0.5) * bin_width;
-    }
+    timer.setBytes(outfile.close());
+}
+
+// num_bins <= 0 plots the exact histogram, one bin per sample value
+void plotHistogram(const HistogramAccumulator &histogram, const std::string &title, int num_bins)
+{
+    std::vector<double> bin_centers;
+    std::vector<std::uint64_t> bins;
+    double bin_width;
+    if (num_bins > 0)
+        histogram.binned(num_bins, bin_centers, bins, bin_width);
+    else
+        histogram.exact(bin_centers, bins, bin_width);
 
     // Ensure that the output directory exists
     std::string output_directory = "../outputs/histograms/";
     std::filesystem::create_directory("../outputs/");
     std::filesystem::create_directory(output_directory);
 
+    if (plotBackend() == PlotBackend::Native)
+    {
+        Chart chart(600, 450, title, "Amplitude", "Frequency");
+        chart.setXRange(-0.8, 0.8);
+        chart.addBoxes(bin_centers, std::vector<double>(bins.begin(), bins.end()), bin_width * 0.9);
+        saveChartAsync(std::move(chart), output_directory + title + ".png");
+        return;
+    }
 #ifdef USE_PLOTTING
-    // Plot the histogram
-    Gnuplot gp;
-
-    // Save to PNG file
-    gp << "set terminal pngcairo size 600,450\n";
-    gp << "set output '" << output_directory << title << ".png'\n";
-    gp << "set title '" << title << "'\n";
-    gp << "set xlabel 'Amplitude'\n";
-    gp << "set ylabel 'Frequency'\n";
-    gp << "set style fill solid 0.5\n";
-    gp << "set boxwidth " << bin_width * 0.9 << "\n";
-    gp << "set xrange [-0.8:0.8]\n";
-    gp << "plot '-' using 1:2 with boxes notitle\n";
-    gp.send1d(boost::make_tuple(bin_centers, bins));
-#else
+    if (plotBackend() == PlotBackend::Gnuplot)
+    {
+        OutputTimer timer(output_directory + title + ".png");
+
+        // Plot the histogram
+        submitPlot([&](Gnuplot &gp) {
+            // Save to PNG file
+            gp << "set terminal pngcairo size 600,450\n";
+            gp << "set output '" << output_directory << title << ".png'\n";
+            gp << "set title '" << title << "'\n";
+            gp << "set xlabel 'Amplitude'\n";
+            gp << "set ylabel 'Frequency'\n";
+            gp << "set style fill solid 0.5\n";
+            gp << "set boxwidth " << bin_width * 0.9 << "\n";
+            gp << "set xrange [-0.8:0.8]\n";
+            auto points = boost::make_tuple(bin_centers, bins);
+            gp << "plot '-' binary" << gp.binFmt1d(points, "record") << " using 1:2 with boxes notitle\n";
+            gp.sendBinary1d(points);
+        });
+        return;
+    }
+#endif
+
     // Save histogram data to CSV file
     std::string filename = output_directory + title + ".csv";
-    std::ofstream outfile(filename);
-    outfile << std::setprecision(10); // Set precision for floating-point numbers
-    
+    OutputTimer timer(filename);
+    CsvWriter outfile(filename);
+
     // Write header
-    outfile << "Bin Center,Frequency\n";
-    
+    outfile.text("Bin Center,Frequency\n");
+
     // Write histogram data
     for (size_t i = 0; i < bins.size(); ++i){
-        outfile << bin_centers[i] << "," << bins[i] << "\n";
+        outfile.row(bin_centers[i], bins[i]);
     }
-    
-    outfile.close();
-#endif
-}
 
+    timer.setBytes(outfile.close());
+}
 
-std::vector<sf::Int16> quantizeAudio(const std::vector<sf::Int16> &samples, int bitsToReduce)
+// One point of a rate-distortion curve (bits kept per sample)
+struct RatePoint
 {
-    std::vector<sf::Int16> quantizedSamples;
-    quantizedSamples.reserve(samples.size());
-
-    for (const auto &sample : samples)
+    int bits;
+    double mse;
+    double snr;
+};
+
+// MSE and SNR of truncating a channel to every bit depth from 1 to 16, derived
+// from its exact int16 histogram. Truncation keeps v & ~mask, so the error of a
+// value is v & mask: the whole sweep is one pass over the 65536 counts, and no
+// quantized samples are ever produced.
+std::vector<RatePoint> rateDistortionSweep(const HistogramAccumulator &histogram)
+{
+    std::uint64_t errorEnergy[16] = {};
+    std::uint64_t signalEnergy = 0;
+    std::uint64_t samples = 0;
+    const std::vector<std::uint64_t> &counts = histogram.valueCounts();
+    for (size_t i = 0; i < counts.size(); ++i)
     {
-        // Shift right to remove least significant bits
-        sf::Int16 quantizedSample = sample >> bitsToReduce;
-        // Shift left to restore the original scale
-        quantizedSample = quantizedSample << bitsToReduce;
-        quantizedSamples.push_back(quantizedSample);
+        if (counts[i] == 0)
+            continue;
+        std::int64_t value = histogram.lowestValue() + static_cast<std::int64_t>(i);
+        samples += counts[i];
+        signalEnergy += counts[i] * static_cast<std::uint64_t>(value * value);
+        for (int bitsToReduce = 0; bitsToReduce < 16; ++bitsToReduce)
+        {
+            std::uint64_t error = static_cast<std::uint64_t>(value & ((1 << bitsToReduce) - 1));
+            errorEnergy[bitsToReduce] += counts[i] * error * error;
+        }
     }
 
-    return quantizedSamples;
+    std::vector<RatePoint> curve;
+    for (int bits = 1; bits <= 16; ++bits)
+    {
+        int bitsToReduce = 16 - bits;
+        double mse = samples ? errorEnergy[bitsToReduce] / (32768.0 * 32768.0) / samples : 0.0;
+        double snr = 10 * std::log10(static_cast<double>(signalEnergy) / errorEnergy[bitsToReduce]);
+        curve.push_back({bits, mse, snr});
+    }
+    return curve;
 }
 
-void saveQuantizedWav(const std::vector<sf::Int16> &samples, unsigned int sampleRate, unsigned int channelCount, const std::string &filename)
+// Saves the SNR-per-bit-depth curve of every channel
+void plotRateDistortion(const std::vector<std::vector<RatePoint>> &curves, const std::vector<std::string> &names, const std::string &title)
 {
-    sf::SoundBuffer buffer;
-    buffer.loadFromSamples(samples.data(), samples.size(), channelCount, sampleRate);
-
     // Ensure that the output directory exists
-    std::string output_directory = "../outputs/audio/";
+    std::string output_directory = "../outputs/sweep/";
     std::filesystem::create_directory("../outputs/");
     std::filesystem::create_directory(output_directory);
 
-    if (!buffer.saveToFile(output_directory + filename))
+    if (plotBackend() == PlotBackend::Native)
     {
-        std::cerr << "Failed to save WAV file: " << filename << std::endl;
+        Chart chart(800, 600, title + " - Rate-Distortion", "Bits per sample", "SNR (dB)");
+        chart.setXRange(1, curves.empty() ? 16 : curves.front().size());
+        chart.setGrid(true);
+        for (size_t c = 0; c < curves.size(); ++c)
+        {
+            std::vector<double> bits, snr;
+            for (const RatePoint &point : curves[c])
+            {
+                // The lossless point has no finite SNR
+                if (std::isfinite(point.snr))
+                {
+                    bits.push_back(point.bits);
+                    snr.push_back(point.snr);
+                }
+            }
+            chart.addLines(bits, snr, names[c], true);
+        }
+        saveChartAsync(std::move(chart), output_directory + title + " - Rate-Distortion.png");
+        return;
     }
-}
-
-std::pair<double, double> calculateMSEAndSNR(const std::vector<double> &original, const std::vector<double> &processed)
-{
-    if (original.size() != processed.size())
+#ifdef USE_PLOTTING
+    if (plotBackend() == PlotBackend::Gnuplot)
     {
-        throw std::runtime_error("Signal lengths do not match");
+        OutputTimer timer(output_directory + title + " - Rate-Distortion.png");
+        submitPlot([&](Gnuplot &gp) {
+            // Save to PNG file
+            gp << "set terminal pngcairo size 800,600\n";
+            gp << "set output '" << output_directory << title << " - Rate-Distortion.png'\n";
+            gp << "set title '" << title << " - Rate-Distortion'\n";
+            gp << "set xlabel 'Bits per sample'\n";
+            gp << "set ylabel 'SNR (dB)'\n";
+            gp << "set xrange [1:" << (curves.empty() ? 16 : curves.front().size()) << "]\n";
+            gp << "set grid\n";
+            std::vector<boost::tuple<std::vector<double>, std::vector<double>>> points;
+            for (const auto &curve : curves)
+            {
+                std::vector<double> bits, snr;
+                for (const RatePoint &point : curve)
+                {
+                    // The lossless point has no finite SNR
+                    if (std::isfinite(point.snr))
+                    {
+                        bits.push_back(point.bits);
+                        snr.push_back(point.snr);
+                    }
+                }
+                points.push_back(boost::make_tuple(bits, snr));
+            }
+            gp << "plot ";
+            for (size_t c = 0; c < curves.size(); ++c)
+                gp << (c ? ", " : "") << "'-' binary" << gp.binFmt1d(points[c], "record") << " using 1:2 with linespoints title '" << names[c] << "'";
+            gp << "\n";
+            for (const auto &curve : points)
+                gp.sendBinary1d(curve);
+        });
+        return;
     }
+#endif
 
-    double mse = 0.0;
-    double signal_power = 0.0;
+    // Save the table to a CSV file
+    std::string filename = output_directory + title + " - Rate-Distortion.csv";
+    OutputTimer timer(filename);
+    CsvWriter outfile(filename);
+
+    // Write header
+    outfile.text("Bits");
+    for (const std::string &name : names)
+        outfile.text(",").text(name).text(" MSE,").text(name).text(" SNR (dB)");
+    outfile.text("\n");
 
-    for (size_t i = 0; i < original.size(); ++i)
+    // Write one row per bit depth
+    for (size_t p = 0; p < curves.front().size(); ++p)
     {
-        double error = original[i] - processed[i];
-        mse += error * error;
-        signal_power += original[i] * original[i];
+        outfile.number(curves.front()[p].bits);
+        for (const auto &curve : curves)
+            outfile.text(",").number(curve[p].mse).text(",").number(curve[p].snr);
+        outfile.text("\n");
     }
 
-    mse /= original.size();
-    signal_power /= original.size();
-
-    double snr = 10 * std::log10(signal_power / mse);
-
-    return {mse, snr};
+    timer.setBytes(outfile.close());
 }
 
-#ifdef USE_FFT
-std::vector<std::complex<double>> computeFFT(const std::vector<double> &signal)
+bool openQuantizedWav(sf::OutputSoundFile &file, unsigned int sampleRate, unsigned int channelCount, const std::string &filename)
 {
-    int n = signal.size();
-
-    // Allocate input and output arrays for FFTW
-    fftw_complex *in = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * n);
-    fftw_complex *out = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * n);
-
-    // Create FFTW plan
-    fftw_plan plan = fftw_plan_dft_1d(n, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
-
-    // Copy input data
-    for (int i = 0; i < n; i++)
-    {
-        in[i][0] = signal[i];
-        in[i][1] = 0.0;
-    }
-
-    // Execute FFT
-    fftw_execute(plan);
+    // Ensure that the output directory exists
+    std::string output_directory = "../outputs/audio/";
+    std::filesystem::create_directory("../outputs/");
+    std::filesystem::create_directory(output_directory);
 
-    // Copy output data
-    std::vector<std::complex<double>> result(n);
-    for (int i = 0; i < n; i++)
+    if (!file.openFromFile(output_directory + filename, sampleRate, channelCount))
     {
-        result[i] = std::complex<double>(out[i][0], out[i][1]);
+        std::cerr << "Failed to save WAV file: " << filename << std::endl;
+        return false;
     }
-
-    // Clean up
-    fftw_destroy_plan(plan);
-    fftw_free(in);
-    fftw_free(out);
-
-    return result;
+    return true;
 }
 
-void plotFrequencySpectrum(const std::vector<std::complex<double>> &fft_result, double sample_rate, const std::string &title)
+void plotFrequencySpectrum(const std::vector<double> &magnitudes, double sample_rate, std::size_t fft_size, const std::string &title)
 {
-    std::vector<double> magnitudes;
-    std::vector<double> frequencies;
-
-    int n = fft_result.size();
-    for (int i = 0; i < n / 2; i++)
+    std::vector<double> frequencies(magnitudes.size());
+    for (size_t i = 0; i < magnitudes.size(); i++)
     {
-        double magnitude = std::abs(fft_result[i]);
-        double frequency = i * sample_rate / n;
-
-        magnitudes.push_back(magnitude);
-        frequencies.push_back(frequency);
+        frequencies[i] = i * sample_rate / fft_size;
     }
 
     // Ensure that the output directory exists
@@ -264,242 +398,1949 @@ void plotFrequencySpectrum(const std::vector<std::complex<double>> &fft_result,
     std::filesystem::create_directory("../outputs/");
     std::filesystem::create_directory(output_directory);
 
+    if (plotBackend() == PlotBackend::Native)
+    {
+        Chart chart(800, 600, title, "Frequency (Hz)", "Magnitude");
+        chart.setXRange(20, 10000);
+        chart.setYMin(0);
+        chart.setLogX(true);
+        chart.addLines(frequencies, magnitudes, "Magnitude Spectrum");
+        saveChartAsync(std::move(chart), output_directory + title + ".png");
+        return;
+    }
 #ifdef USE_PLOTTING
-    // Create a Gnuplot object
-    Gnuplot gp;
-
-    // Save to png
-    gp << "set terminal pngcairo size 800,600\n";
-    gp << "set output '" << output_directory << title << ".png'\n";
-    gp << "set title '" << title << "'\n";
-    gp << "set xlabel 'Frequency (Hz)'\n";
-    gp << "set ylabel 'Magnitude'\n";
-    gp << "set xrange [20:10000]\n";
-    gp << "set yrange [0:*]\n";
-    gp << "set logscale x\n";
-    gp << "plot '-' using 1:2 with lines title 'Magnitude Spectrum'\n";
-    gp.send1d(boost::make_tuple(frequencies, magnitudes));
-#else
+    if (plotBackend() == PlotBackend::Gnuplot)
+    {
+        OutputTimer timer(output_directory + title + ".png");
+
+        // Queue the plot on the shared gnuplot session
+        submitPlot([&](Gnuplot &gp) {
+            // Save to png
+            gp << "set terminal pngcairo size 800,600\n";
+            gp << "set output '" << output_directory << title << ".png'\n";
+            gp << "set title '" << title << "'\n";
+            gp << "set xlabel 'Frequency (Hz)'\n";
+            gp << "set ylabel 'Magnitude'\n";
+            gp << "set xrange [20:10000]\n";
+            gp << "set yrange [0:*]\n";
+            gp << "set logscale x\n";
+            auto points = boost::make_tuple(frequencies, magnitudes);
+            gp << "plot '-' binary" << gp.binFmt1d(points, "record") << " using 1:2 with lines title 'Magnitude Spectrum'\n";
+            gp.sendBinary1d(points);
+        });
+        return;
+    }
+#endif
+
     // Save frequency spectrum data to CSV file
     std::string filename = output_directory + title + ".csv";
-    std::ofstream outfile(filename);
-    outfile << std::setprecision(10);
-    
+    OutputTimer timer(filename);
+    CsvWriter outfile(filename);
+
     // Write header
-    outfile << "Frequency (Hz),Magnitude\n";
-    
+    outfile.text("Frequency (Hz),Magnitude\n");
+
     // Write frequency spectrum data
     for (size_t i = 0; i < frequencies.size(); ++i)
     {
-        outfile << frequencies[i] << "," << magnitudes[i] << "\n";
+        outfile.row(frequencies[i], magnitudes[i]);
     }
-    
-    outfile.close();
-#endif
+
+    timer.setBytes(outfile.close());
 }
-#endif
 
-int main(int argc, char *argv[])
+// Options shared by the single-file and batch modes
+struct AnalysisOptions
 {
-    /***************************************
-     *           PARSING ARGUMENTS         *
-     ***************************************/
-
-    // Default values
-    int sampleNumber = 1;
     int bitsToReduce = 10;
+    QuantizerKind quantizer = QuantizerKind::Truncate;
+    std::size_t blockFrames = 65536;
     bool generateWaveform = false;
     bool generateHistograms = false;
     bool generateQuantizedWaveform = false;
     bool generateAudioFile = false;
     bool generateFFT = false;
+    bool generateSweep = false;
+    bool generateSpectrogram = false;
+    bool generateFeatures = false;
+    bool generateChannelDelay = false;
+    double maxLag = 0.01; // seconds searched either way by the delay estimates
+    bool generateTransformCoding = false;
+    int histogramBins = 64; // 0 for exact histograms
+    bool memoryMap = true; // map WAV files instead of decoding them with SFML
+    unsigned int targetRate = 0; // resample every file to this rate before the analysis; 0 keeps its own rate
+    ResamplerConfig resampler;
+    std::int64_t zoomOffset = -1; // frames; -1 skips the first second (may be silence)
+    std::uint64_t zoomFrames = 500;
+    StftConfig stft;
+};
+
+// Results of analysing one file. channels holds one entry per audio channel
+// followed by MID and SIDE, which only have histogram statistics.
+struct ChannelReport
+{
+    std::string name;
+    bool hasQuality = true;
+    double mse = 0.0;
+    double snr = 0.0;
+    double peakError = 0.0;
+    double segmentalSnr = 0.0;
+    HistogramStats histogram;
+};
+
+// Sample-rate conversion done before the analysis (only with --rate)
+struct ResampleReport
+{
+    unsigned int inputRate = 0;
+    unsigned int outputRate = 0; // 0 when the file was analysed at its own rate
+    std::size_t phases = 0;
+    std::size_t taps = 0; // per phase
+    ResamplerQuality quality;
+    double seconds = 0.0; // time spent resampling
+};
+
+// One quantizer run over the whole file next to the selected one (only with -s)
+struct QuantizerReport
+{
+    QuantizerKind kind;
+    int bits = 0;                      // kept per sample
+    double seconds = 0.0;              // in the kernel, on one thread
+    std::uint64_t samples = 0;
+    std::vector<ErrorResult> channels;
+};
+
+// Right channel against the left over one block (only with --lr-delay)
+struct BlockDelay
+{
+    double start; // seconds
+    DelayEstimate estimate;
+};
 
-    // Parse command line arguments
-    if (argc > 1)
-        sampleNumber = std::stoi(argv[1]);
-    if (argc > 2)
-        bitsToReduce = std::stoi(argv[2]);
+struct FileReport
+{
+    std::string filePath;
+    std::string fileName;
+    AudioInfo info;
+    ResampleReport resampling;
+    std::vector<ChannelReport> channels;
+    std::vector<std::vector<RatePoint>> sweep; // per channel, bits 1 .. resolution, only with -s
+    std::vector<QuantizerReport> quantizers;   // every quantizer at the analysed depth, only with -s
+    std::vector<BlockDelay> channelDelay;
+    std::string error;
+};
+
+// Saves the per-block delay and gain of the right channel against the left
+void saveChannelDelay(const std::vector<BlockDelay> &blocks, unsigned int sampleRate, const std::string &title)
+{
+    std::string output_directory = "../outputs/delay/";
+    std::filesystem::create_directory("../outputs/");
+    std::filesystem::create_directory(output_directory);
 
-    // Parse command line arguments
-    for (int i = 3; i < argc; ++i)
+    std::string filename = output_directory + title + ".csv";
+    OutputTimer timer(filename);
+    CsvWriter outfile(filename);
+    outfile.text("Time (s),Delay (samples),Delay (ms),Gain (dB),Correlation\n");
+    for (const BlockDelay &block : blocks)
     {
-        std::string arg = argv[i];
-        if (arg == "-w")
-            generateWaveform = true;
-        else if (arg == "-h")
-            generateHistograms = true;
-        else if (arg == "-q")
-            generateQuantizedWaveform = true;
-        else if (arg == "-a")
-            generateAudioFile = true;
-        else if (arg == "-f")
-            generateFFT = true;
+        // Silent blocks have no delay
+        if (!block.estimate.valid)
+            continue;
+        const DelayEstimate &estimate = block.estimate;
+        outfile.row(block.start, estimate.delay, estimate.delay * 1e3 / sampleRate, 20.0 * std::log10(std::abs(estimate.gain)), estimate.correlation);
     }
+    timer.setBytes(outfile.close());
+}
 
-    // If no specific outputs are requested, generate all
-    if (!(generateWaveform || generateHistograms || generateQuantizedWaveform || generateAudioFile || generateFFT))
+// Plot / report name of channel c
+std::string channelName(unsigned int c, unsigned int channelCount)
+{
+    if (channelCount == 1)
+        return "Mono Channel";
+    if (channelCount == 2)
+        return c == 0 ? "Left Channel" : "Right Channel";
+    return "Channel " + std::to_string(c + 1);
+}
+
+// The streaming stages of analyzeFile for samples of type T. Quantization,
+// error metrics and the spectra run on T itself; the histograms and the
+// waveform pyramid, which are plotted, count the top 16 bits of each sample.
+template <typename T>
+void analyzeSamples(AudioSource &source, const AnalysisOptions &options, ThreadPool &pool, FileReport &report)
+{
+    const std::string &fileName = report.fileName;
+    const int bitsToReduce = options.bitsToReduce;
+    const std::size_t blockFrames = options.blockFrames;
+    unsigned int sampleRate = source.sampleRate();
+    unsigned int channelCount = source.channelCount();
+    std::uint64_t frameCount = source.frameCount();
+
+    // Optional rate conversion ahead of every stage; from here on sampleRate
+    // and frameCount describe the resampled signal
+    std::unique_ptr<PolyphaseResampler> resampler;
+    if (options.targetRate && options.targetRate != sampleRate)
     {
-        generateWaveform = generateHistograms = generateQuantizedWaveform = generateAudioFile = generateFFT = true;
+        resampler = std::make_unique<PolyphaseResampler>(sampleRate, options.targetRate, channelCount, options.resampler);
+        ResampleReport &resampling = report.resampling;
+        resampling.inputRate = sampleRate;
+        resampling.outputRate = options.targetRate;
+        resampling.phases = resampler->phases();
+        resampling.taps = resampler->tapsPerPhase();
+        resampling.quality = resampler->measureQuality();
+        sampleRate = options.targetRate;
+        frameCount = resampler->outputFrames(frameCount);
     }
+    const std::size_t maxBlockFrames = resampler ? resampler->maxOutputFrames(blockFrames) : blockFrames;
+
+    // bitsToReduce counts from the resolution of the file; T may be wider
+    // (24-bit samples sit at the top of an int32) and the 16-bit display
+    // values narrower
+    const int keptBits = report.info.resolutionBits() - bitsToReduce;
+    const int sampleBitsToReduce = SampleTraits<T>::bits - keptBits;
+    const int displayBitsToReduce = std::max(0, 16 - keptBits);
+    constexpr bool int16Samples = std::is_same_v<T, sf::Int16>;
+    // Truncation, the default, keeps the names of the quantized outputs as they were
+    const QuantizerKind quantizer = options.quantizer;
+    const std::string quantizerLabel = quantizer == QuantizerKind::Truncate ? "" : std::string(", ") + quantizerName(quantizer);
+
+    // Plot / report names of each channel
+    std::vector<std::string> channelNames(channelCount);
+    for (unsigned int c = 0; c < channelCount; ++c)
+        channelNames[c] = channelName(c, channelCount);
 
     /***************************************
-     *                TASK 1               *
+     *           STREAMING STAGES          *
      ***************************************/
 
-    std::string filePath = "../datasets/";
-    std::string fileName = "sample";
-    if (sampleNumber < 10)
-        fileName += "0";
-    fileName += std::to_string(sampleNumber) + ".wav";
-    filePath += fileName;
+    // TASK 2 / 4: min / max pyramid of every channel, for the full and zoomed waveforms
+    const std::size_t waveformColumns = 1800; // two per pixel of the 900 px wide plot
+    WaveformPyramid pyramid(channelCount, sampleRate);
+    bool buildPyramid = options.generateWaveform || options.generateQuantizedWaveform;
 
-    // Load the WAV file
-    sf::SoundBuffer buffer;
-    if (!buffer.loadFromFile(filePath))
+    // TASK 3: exact histograms of the 16-bit values of every channel plus MID
+    // and SIDE. MID and SIDE are kept as l + r and l - r, i.e. in units of 1 / 65536
+    int num_bins = options.histogramBins;
+    ChannelHistograms histograms(channelCount);
+
+    // TASK 4: quantized WAV file and zoomed-in waveforms
+    sf::OutputSoundFile quantizedFile;
+    bool generateAudioFile = options.generateAudioFile;
+    if (generateAudioFile)
     {
-        std::cerr << "Failed to load WAV file: " << filePath << std::endl;
-        return 1;
+        std::string quantizedFileName = std::filesystem::path(fileName).stem().string() + "_" + std::to_string(keptBits) + "bits" +
+                                        (quantizer == QuantizerKind::Truncate ? "" : std::string("_") + quantizerName(quantizer)) + ".wav";
+        if (!openQuantizedWav(quantizedFile, sampleRate, channelCount, quantizedFileName))
+            generateAudioFile = false;
+        // SFML writes 16-bit files, which hold the quantized samples exactly up to 16 kept bits
+        else if (keptBits > 16)
+            std::cerr << "Note: " << quantizedFileName << " is written with the top 16 of its " << keptBits << " bits" << std::endl;
     }
 
-    // Print audio file information
-    printAudioInfo(buffer);
+    // TASK 5: running MSE, SNR, peak error and segmental SNR, straight from the sample blocks
+    BasicErrorMetrics<T> errors(channelCount);
 
-    /***************************************
-     *                TASK 2               *
-     ***************************************/
+    // Sweep: every quantizer over the same blocks, for their SNR and speed at this depth
+    std::vector<BasicErrorMetrics<T>> quantizerErrors;
+    std::vector<T> sweepBlock;
+    if (options.generateSweep)
+    {
+        for (QuantizerKind kind : quantizerKinds)
+        {
+            report.quantizers.push_back({kind, keptBits, 0.0, 0, {}});
+            quantizerErrors.emplace_back(channelCount);
+            // Builds the int16 compander tables ahead of the timings
+            quantizeAudio<T>(nullptr, nullptr, 0, sampleBitsToReduce, kind);
+        }
+        sweepBlock.resize(maxBlockFrames * channelCount);
+    }
+    // Wider samples are truncated to every depth for real: the histograms
+    // only see their top 16 bits
+    std::vector<BasicErrorMetrics<T>> depthErrors;
+    if (options.generateSweep && !int16Samples)
+    {
+        for (int bits = 1; bits <= report.info.resolutionBits(); ++bits)
+            depthErrors.emplace_back(channelCount);
+    }
 
-    // Read audio samples into a vector and get basic info
-    const sf::Int16 *samples = buffer.getSamples();
-    std::size_t sampleCount = buffer.getSampleCount();
-    std::vector<sf::Int16> sampleVector(samples, samples + sampleCount);
+    // Extra: delay and gain of R against L in every block, by FFT cross-correlation
+    std::unique_ptr<CrossCorrelator> correlator;
+    std::vector<float> leftChannel, rightChannel;
+    if (options.generateChannelDelay && channelCount >= 2)
+    {
+        std::size_t lagFrames = static_cast<std::size_t>(std::ceil(options.maxLag * sampleRate));
+        correlator = std::make_unique<CrossCorrelator>(maxBlockFrames, lagFrames);
+        leftChannel.resize(maxBlockFrames);
+        rightChannel.resize(maxBlockFrames);
+    }
 
-    // Split the samples into left and right channels
-    std::vector<double> leftChannel;
-    std::vector<double> rightChannel;
-    for (std::size_t i = 0; i < sampleCount; i += 2)
+    // Extra: short-time spectra of the original and quantized mid channel, averaged
+    // for the spectrum plots and optionally kept as spectrograms
+    std::unique_ptr<StftEngine> midStft, quantizedMidStft;
+    std::unique_ptr<AverageSpectrum> midSpectrum, quantizedMidSpectrum;
+    std::unique_ptr<SpectrogramImage> midImage, quantizedMidImage;
+    SpectrogramWriter midWriter, quantizedMidWriter;
+    std::string spectrogramTitle = fileName + " - Mid Channel Spectrogram";
+    std::string quantizedSuffix = " (Quantized " + std::to_string(keptBits) + " bits" + quantizerLabel + ")";
+    std::string spectrogram_directory = "../outputs/spectrograms/";
+    if (options.generateFFT || options.generateSpectrogram || options.generateFeatures)
+        midStft = std::make_unique<StftEngine>(options.stft, pool);
+    if (options.generateFFT || options.generateSpectrogram)
     {
-        leftChannel.push_back(static_cast<double>(sampleVector[i]) / 32768.0);
-        rightChannel.push_back(static_cast<double>(sampleVector[i + 1]) / 32768.0);
+        quantizedMidStft = std::make_unique<StftEngine>(options.stft, pool);
+        std::size_t bins = midStft->bins();
+        std::uint64_t stftFrames = stftFrameCount(frameCount, options.stft);
+
+        if (options.generateFFT)
+        {
+            midSpectrum = std::make_unique<AverageSpectrum>(bins);
+            quantizedMidSpectrum = std::make_unique<AverageSpectrum>(bins);
+            midStft->addSink([&](std::uint64_t first, const float *rows, std::size_t n) { midSpectrum->consume(first, rows, n); });
+            quantizedMidStft->addSink([&](std::uint64_t first, const float *rows, std::size_t n) { quantizedMidSpectrum->consume(first, rows, n); });
+        }
+        if (options.generateSpectrogram)
+        {
+            std::filesystem::create_directory("../outputs/");
+            std::filesystem::create_directory(spectrogram_directory);
+            midImage = std::make_unique<SpectrogramImage>(stftFrames, bins);
+            quantizedMidImage = std::make_unique<SpectrogramImage>(stftFrames, bins);
+            midWriter.open(spectrogram_directory + spectrogramTitle + " (Original).bin", options.stft, bins, sampleRate);
+            quantizedMidWriter.open(spectrogram_directory + spectrogramTitle + quantizedSuffix + ".bin", options.stft, bins, sampleRate);
+            midStft->addSink([&](std::uint64_t first, const float *rows, std::size_t n) {
+                midImage->consume(first, rows, n);
+                midWriter.consume(first, rows, n);
+            });
+            quantizedMidStft->addSink([&](std::uint64_t first, const float *rows, std::size_t n) {
+                quantizedMidImage->consume(first, rows, n);
+                quantizedMidWriter.consume(first, rows, n);
+            });
+        }
     }
 
-    // Plot the left and right channel waveforms
-    if (generateWaveform)
+    // Extra: per-frame features of the original mid channel, from the same STFT frames
+    std::unique_ptr<FrameFeatures> midFeatures;
+    if (options.generateFeatures)
     {
-        plotWaveform(leftChannel, buffer.getSampleRate(), fileName + " - Left Channel");
-        plotWaveform(rightChannel, buffer.getSampleRate(), fileName + " - Right Channel");
+        midFeatures = std::make_unique<FrameFeatures>(options.stft, sampleRate, pool);
+        midStft->addFrameSink([&](std::uint64_t first, const double *samples, const float *rows, std::size_t n) {
+            midFeatures->consume(first, samples, rows, n);
+        });
     }
 
     /***************************************
-     *                TASK 3               *
+     *        BLOCK PROCESSING LOOP        *
      ***************************************/
 
-    // Calculate MID and SIDE channels
-    std::vector<double> midChannel(leftChannel.size());
-    std::vector<double> sideChannel(leftChannel.size());
-    for (size_t i = 0; i < leftChannel.size(); ++i)
+    // Block buffers, reused for every block. sampleBlock is only filled when
+    // the file is not mapped as T; mapped blocks are views into the file
+    // itself. The 16-bit display blocks are only needed when T is wider. The
+    // normalized planes only feed the STFT (for its MID channel).
+    std::vector<T> sampleBlock;
+    std::vector<T> resampledBlock;
+    std::vector<T> quantizedBlock(maxBlockFrames * channelCount);
+    std::vector<sf::Int16> displayBlock(int16Samples ? 0 : maxBlockFrames * channelCount);
+    std::vector<sf::Int16> quantizedDisplayBlock(int16Samples || !generateAudioFile ? 0 : maxBlockFrames * channelCount);
+    std::size_t planeFrames = midStft ? maxBlockFrames : 0;
+    std::vector<std::vector<double>> channels(channelCount, std::vector<double>(planeFrames));
+    std::size_t quantizedPlaneFrames = quantizedMidStft ? planeFrames : 0;
+    std::vector<std::vector<double>> quantizedChannels(channelCount, std::vector<double>(quantizedPlaneFrames));
+    std::vector<double> midChannel(planeFrames), quantizedMidChannel(quantizedPlaneFrames);
+    std::vector<double *> channelPlanes(channelCount), quantizedChannelPlanes(channelCount);
+    for (unsigned int c = 0; c < channelCount; ++c)
     {
-        midChannel[i] = (leftChannel[i] + rightChannel[i]) / 2.0;
-        sideChannel[i] = (leftChannel[i] - rightChannel[i]) / 2.0;
+        channelPlanes[c] = channels[c].data();
+        quantizedChannelPlanes[c] = quantizedChannels[c].data();
     }
 
-    // Plot histograms
-    int num_bins = 64;
-    if (generateHistograms)
+    // The narrow zoom shows every sample: its frames are kept as they pass
+    const std::uint64_t zoomOffset = options.zoomOffset < 0 ? sampleRate : static_cast<std::uint64_t>(options.zoomOffset);
+    const std::uint64_t zoomEnd = std::min(frameCount, zoomOffset + options.zoomFrames);
+    const bool narrowZoom = options.generateQuantizedWaveform && options.zoomFrames / waveformColumns < pyramid.baseBucket();
+    std::vector<T> zoomSamples;
+
+    BasicPcmView<T> block;
+    bool sourceDone = false;
+    for (std::uint64_t position = 0, analysed = 0; !sourceDone; analysed += block.frames)
     {
-        plotHistogram(leftChannel, fileName + " - Left Channel Histogram", num_bins);
-        plotHistogram(rightChannel, fileName + " - Right Channel Histogram", num_bins);
-        plotHistogram(midChannel, fileName + " - MID Channel Histogram", num_bins);
-        plotHistogram(sideChannel, fileName + " - SIDE Channel Histogram", num_bins);
+        {
+            StageTimer timer("load", &fileName);
+            block = source.read(position, blockFrames, sampleBlock);
+        }
+        position += block.frames;
+        sourceDone = block.frames == 0;
+        if (resampler)
+        {
+            // The last call drains the frames the filter still holds back
+            StageTimer timer("resample", &fileName);
+            auto start = std::chrono::steady_clock::now();
+            std::size_t resampled = sourceDone ? resampler->flush(resampledBlock)
+                                               : resampler->process(block.samples, static_cast<std::size_t>(block.frames), resampledBlock);
+            block = BasicPcmView<T>{resampledBlock.data(), resampled, channelCount, channelCount};
+            report.resampling.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (block.frames == 0)
+            continue;
+        std::size_t frames = static_cast<std::size_t>(block.frames);
+        std::size_t sampleCount = frames * channelCount;
+
+        std::uint64_t zoomFirst = std::max(analysed, zoomOffset), zoomLast = std::min(analysed + frames, zoomEnd);
+        if (narrowZoom && zoomFirst < zoomLast)
+            zoomSamples.insert(zoomSamples.end(), block.samples + (zoomFirst - analysed) * channelCount, block.samples + (zoomLast - analysed) * channelCount);
+
+        const sf::Int16 *displaySamples;
+        if constexpr (int16Samples)
+            displaySamples = block.samples;
+        else
+        {
+            StageTimer timer("convert", &fileName);
+            convertToInt16(block.samples, displayBlock.data(), sampleCount);
+            displaySamples = displayBlock.data();
+        }
+
+        {
+            StageTimer timer("histogram", &fileName);
+            histograms.add(displaySamples, frames, pool);
+        }
+
+        if (buildPyramid)
+        {
+            StageTimer timer("waveform", &fileName);
+            pyramid.feed(displaySamples, frames, pool);
+        }
+
+        // Quantize the audio block
+        {
+            StageTimer timer("quantize", &fileName);
+            quantizeAudio(block.samples, quantizedBlock.data(), sampleCount, sampleBitsToReduce, quantizer, analysed * channelCount, pool);
+        }
+        if (generateAudioFile)
+        {
+            StageTimer timer("write", &fileName);
+            if constexpr (int16Samples)
+                quantizedFile.write(quantizedBlock.data(), sampleCount);
+            else
+            {
+                convertToInt16(quantizedBlock.data(), quantizedDisplayBlock.data(), sampleCount);
+                quantizedFile.write(quantizedDisplayBlock.data(), sampleCount);
+            }
+        }
+
+        {
+            StageTimer timer("metrics", &fileName);
+            errors.feed(block.samples, quantizedBlock.data(), frames, pool);
+        }
+
+        if (options.generateSweep)
+        {
+            // Kernels timed on one thread, so their speeds compare
+            StageTimer timer("sweep", &fileName);
+            for (std::size_t k = 0; k < report.quantizers.size(); ++k)
+            {
+                QuantizerReport &run = report.quantizers[k];
+                auto start = std::chrono::steady_clock::now();
+                quantizeAudio(block.samples, sweepBlock.data(), sampleCount, sampleBitsToReduce, run.kind, analysed * channelCount);
+                run.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                run.samples += sampleCount;
+                quantizerErrors[k].feed(block.samples, sweepBlock.data(), frames, pool);
+            }
+            for (std::size_t d = 0; d < depthErrors.size(); ++d)
+            {
+                int depthBitsToReduce = SampleTraits<T>::bits - static_cast<int>(d + 1);
+                quantizeAudio(block.samples, sweepBlock.data(), sampleCount, depthBitsToReduce, QuantizerKind::Truncate, 0, pool);
+                depthErrors[d].feed(block.samples, sweepBlock.data(), frames, pool);
+            }
+        }
+
+        if (correlator)
+        {
+            StageTimer timer("correlate", &fileName);
+            const float scale = static_cast<float>(SampleTraits<T>::scale);
+            for (std::size_t i = 0; i < frames; ++i)
+            {
+                leftChannel[i] = block.at(i, 0) * scale;
+                rightChannel[i] = block.at(i, 1) * scale;
+            }
+            report.channelDelay.push_back({static_cast<double>(analysed) / sampleRate, correlator->estimate(leftChannel.data(), rightChannel.data(), frames)});
+        }
+
+        if (midStft)
+        {
+            // Split both versions into normalized channels, with MID in the same pass
+            {
+                StageTimer timer("split", &fileName);
+                deinterleave(block.samples, frames, channelCount, channelPlanes.data(), midChannel.data());
+                if (quantizedMidStft)
+                    deinterleave(quantizedBlock.data(), frames, channelCount, quantizedChannelPlanes.data(), quantizedMidChannel.data());
+            }
+            StageTimer timer("fft", &fileName);
+            midStft->feed(midChannel.data(), frames);
+            if (quantizedMidStft)
+                quantizedMidStft->feed(quantizedMidChannel.data(), frames);
+        }
     }
 
     /***************************************
-     *                TASK 4               *
+     *                TASK 2               *
      ***************************************/
 
-    // Quantize the audio (reduce by 4 bits)
-    std::vector<sf::Int16> quantizedSamples = quantizeAudio(sampleVector, bitsToReduce);
-    if (generateAudioFile)
+    if (buildPyramid)
     {
-        // Save the quantized audio to a new WAV file
-        std::string quantizedFileName = "sample";
-        if (sampleNumber < 10)
-            quantizedFileName += "0";
-        quantizedFileName += std::to_string(sampleNumber) + "_" + std::to_string(16 - bitsToReduce) + "bits.wav";
-        saveQuantizedWav(quantizedSamples, buffer.getSampleRate(), buffer.getChannelCount(), quantizedFileName);
+        StageTimer timer("waveform", &fileName);
+        pyramid.finish();
     }
 
-    // Split the quantized samples into left and right channels
-    std::vector<double> quantizedLeftChannel;
-    std::vector<double> quantizedRightChannel;
-    for (std::size_t i = 0; i < sampleCount; i += 2)
+    // Plot the channel waveforms
+    if (options.generateWaveform)
     {
-        quantizedLeftChannel.push_back(static_cast<double>(quantizedSamples[i]) / 32768.0);
-        quantizedRightChannel.push_back(static_cast<double>(quantizedSamples[i + 1]) / 32768.0);
+        StageTimer timer("plot", &fileName);
+        for (unsigned int c = 0; c < channelCount; ++c)
+            plotWaveform(pyramid.envelope(c, 0, frameCount, waveformColumns), fileName + " - " + channelNames[c]);
     }
 
-    if (generateQuantizedWaveform)
+    /***************************************
+     *                TASK 3               *
+     ***************************************/
+
     {
-        // Create vectors for the first few samples
-        int initialOffset = 44100; // skip the first second (may be silence)
-        int samplesToDisplay = 500;
-        std::vector<double> leftChannelZoomIn(leftChannel.begin() + initialOffset, leftChannel.begin() + samplesToDisplay + initialOffset);
-        std::vector<double> rightChannelZoomIn(rightChannel.begin() + initialOffset, rightChannel.begin() + samplesToDisplay + initialOffset);
-        std::vector<double> quantizedLeftChannelZoomIn(quantizedLeftChannel.begin() + initialOffset, quantizedLeftChannel.begin() + samplesToDisplay + initialOffset);
-        std::vector<double> quantizedRightChannelZoomIn(quantizedRightChannel.begin() + initialOffset, quantizedRightChannel.begin() + samplesToDisplay + initialOffset);
+        StageTimer timer("histogram", &fileName);
+        histograms.finish();
+    }
 
-        // Plot the original and quantized waveforms
-        plotWaveform(leftChannelZoomIn, buffer.getSampleRate(), fileName + " - Left Channel (zoom)");
-        plotWaveform(rightChannelZoomIn, buffer.getSampleRate(), fileName + " - Right Channel (zoom)");
-        plotWaveform(quantizedLeftChannelZoomIn, buffer.getSampleRate(), fileName + " - Left Channel (" + std::to_string(16 - bitsToReduce) + " bits) (zoom)");
-        plotWaveform(quantizedRightChannelZoomIn, buffer.getSampleRate(), fileName + " - Right Channel (" + std::to_string(16 - bitsToReduce) + " bits) (zoom)");
+    // Plot histograms
+    if (options.generateHistograms && !histograms.mid().empty())
+    {
+        StageTimer timer("plot", &fileName);
+        for (unsigned int c = 0; c < channelCount; ++c)
+            plotHistogram(histograms.channel(c), fileName + " - " + channelNames[c] + " Histogram", num_bins);
+        plotHistogram(histograms.mid(), fileName + " - MID Channel Histogram", num_bins);
+        plotHistogram(histograms.side(), fileName + " - SIDE Channel Histogram", num_bins);
     }
 
     /***************************************
-     *                TASK 5               *
+     *                TASK 4               *
      ***************************************/
 
-    // Calculate MSE and SNR for left and right channels
-    auto [leftMSE, leftSNR] = calculateMSEAndSNR(leftChannel, quantizedLeftChannel);
-    auto [rightMSE, rightSNR] = calculateMSEAndSNR(rightChannel, quantizedRightChannel);
+    if (options.generateQuantizedWaveform)
+    {
+        StageTimer timer("plot", &fileName);
+        std::string quantizedLabel = " (" + std::to_string(keptBits) + " bits" + quantizerLabel + ") (zoom)";
+        if (!narrowZoom)
+        {
+            // Wide zoom: envelopes straight from the pyramid
+            for (unsigned int c = 0; c < channelCount; ++c)
+                plotWaveform(pyramid.envelope(c, zoomOffset, zoomEnd, waveformColumns), fileName + " - " + channelNames[c] + " (zoom)");
+            for (unsigned int c = 0; c < channelCount; ++c)
+                plotWaveform(pyramid.envelope(c, zoomOffset, zoomEnd, waveformColumns, displayBitsToReduce, quantizer), fileName + " - " + channelNames[c] + quantizedLabel);
+        }
+        else
+        {
+            // Narrow zoom: every sample is visible, from the frames kept while streaming
+            std::size_t zoomCount = zoomSamples.size() / channelCount;
+            std::vector<T> quantizedZoomSamples(zoomSamples.size());
+            quantizeAudio(zoomSamples.data(), quantizedZoomSamples.data(), quantizedZoomSamples.size(), sampleBitsToReduce, quantizer,
+                          zoomOffset * channelCount);
+            std::vector<double> time(zoomCount), data(zoomCount), quantizedData(zoomCount);
+            for (size_t i = 0; i < zoomCount; ++i)
+                time[i] = static_cast<double>(i) / sampleRate;
+
+            // Plot the original and quantized waveforms
+            for (unsigned int c = 0; c < channelCount; ++c)
+            {
+                for (size_t i = 0; i < zoomCount; ++i)
+                    data[i] = zoomSamples[i * channelCount + c] * SampleTraits<T>::scale;
+                plotWaveform(time, data, fileName + " - " + channelNames[c] + " (zoom)");
+            }
+            for (unsigned int c = 0; c < channelCount; ++c)
+            {
+                for (size_t i = 0; i < zoomCount; ++i)
+                    quantizedData[i] = quantizedZoomSamples[i * channelCount + c] * SampleTraits<T>::scale;
+                plotWaveform(time, quantizedData, fileName + " - " + channelNames[c] + quantizedLabel);
+            }
+        }
+    }
 
-    // Print the results
-    std::cout << "\nQuantization Quality Metrics for " << fileName << " (" << std::to_string(16 - bitsToReduce) << " bit):" << std::endl;
-    std::cout << "Left Channel:" << std::endl;
-    std::cout << "  MSE: " << leftMSE << std::endl;
-    std::cout << "  SNR: " << leftSNR << " dB" << std::endl;
-    std::cout << "Right Channel:" << std::endl;
-    std::cout << "  MSE: " << rightMSE << std::endl;
-    std::cout << "  SNR: " << rightSNR << " dB" << std::endl;
+    /***************************************
+     *                TASK 5               *
+     ***************************************/
 
-    // Calculate average MSE and SNR across both channels
-    double avgMSE = (leftMSE + rightMSE) / 2.0;
-    double avgSNR = (leftSNR + rightSNR) / 2.0;
+    // Error metrics for every channel, plus the histogram statistics
+    StageTimer metricsTimer("metrics", &fileName);
+    for (unsigned int c = 0; c < channelCount; ++c)
+    {
+        ChannelReport channel;
+        channel.name = channelNames[c];
+        ErrorResult quality = errors.result(c);
+        channel.mse = quality.mse;
+        channel.snr = quality.snr;
+        channel.peakError = quality.peakError;
+        channel.segmentalSnr = quality.segmentalSnr;
+        channel.histogram = histograms.channel(c).stats();
+        report.channels.push_back(channel);
+    }
+    ChannelReport mid, side;
+    mid.name = "MID Channel";
+    side.name = "SIDE Channel";
+    mid.hasQuality = side.hasQuality = false;
+    mid.histogram = histograms.mid().stats();
+    side.histogram = histograms.side().stats();
+    report.channels.push_back(mid);
+    report.channels.push_back(side);
+    metricsTimer.stop();
+
+    if (correlator)
+    {
+        StageTimer timer("plot", &fileName);
+        saveChannelDelay(report.channelDelay, sampleRate, fileName + " - Channel Delay");
+    }
 
-    std::cout << "Average across both channels:" << std::endl;
-    std::cout << "  MSE: " << avgMSE << std::endl;
-    std::cout << "  SNR: " << avgSNR << " dB" << std::endl;
+    // Rate-distortion sweep over every bit depth: from the same histograms for
+    // int16, from the truncated blocks for wider samples
+    if (options.generateSweep)
+    {
+        {
+            StageTimer timer("sweep", &fileName);
+            for (unsigned int c = 0; c < channelCount; ++c)
+            {
+                if constexpr (int16Samples)
+                    report.sweep.push_back(rateDistortionSweep(histograms.channel(c)));
+                else
+                {
+                    std::vector<RatePoint> curve;
+                    for (std::size_t d = 0; d < depthErrors.size(); ++d)
+                    {
+                        ErrorResult result = depthErrors[d].result(c);
+                        curve.push_back({static_cast<int>(d + 1), result.mse, result.snr});
+                    }
+                    report.sweep.push_back(curve);
+                }
+            }
+            for (std::size_t k = 0; k < report.quantizers.size(); ++k)
+            {
+                for (unsigned int c = 0; c < channelCount; ++c)
+                    report.quantizers[k].channels.push_back(quantizerErrors[k].result(c));
+            }
+        }
+        StageTimer timer("plot", &fileName);
+        plotRateDistortion(report.sweep, channelNames, fileName);
+    }
 
-#ifdef USE_FFT
     /***************************************
      *         Extra: FFT comparison       *
      ***************************************/
-    if (generateFFT)
+    if (midStft)
+    {
+        StageTimer timer("fft", &fileName);
+        midStft->finish();
+        if (quantizedMidStft)
+            quantizedMidStft->finish();
+    }
+    if (options.generateFFT)
+    {
+        StageTimer timer("plot", &fileName);
+        // Plot and save the averaged frequency spectrum of the original and quantized mid channel
+        plotFrequencySpectrum(midSpectrum->result(), sampleRate, options.stft.size, fileName + " - Mid Channel FFT (Original)");
+        plotFrequencySpectrum(quantizedMidSpectrum->result(), sampleRate, options.stft.size, fileName + " - Mid Channel FFT" + quantizedSuffix);
+    }
+    if (options.generateSpectrogram)
+    {
+        StageTimer timer("plot", &fileName);
+        midWriter.close();
+        quantizedMidWriter.close();
+        midImage->save(spectrogram_directory + spectrogramTitle + " (Original).png");
+        quantizedMidImage->save(spectrogram_directory + spectrogramTitle + quantizedSuffix + ".png");
+    }
+    if (midFeatures)
     {
-        // Compute FFT for the original mid channel
-        std::vector<std::complex<double>> fft_mid = computeFFT(midChannel);
+        StageTimer timer("features", &fileName);
+        std::string features_directory = "../outputs/features/";
+        std::filesystem::create_directory("../outputs/");
+        std::filesystem::create_directory(features_directory);
+        if (!midFeatures->save(features_directory + fileName + " - Mid Channel Features.bin"))
+            std::cerr << "Could not write the features of " << fileName << std::endl;
+    }
+}
 
-        // Plot and save the frequency spectrum of the original mid channel
-        plotFrequencySpectrum(fft_mid, buffer.getSampleRate(), fileName + " - Mid Channel FFT (Original)");
+// Runs TASK 1-5 (and the FFT extra) over one file, streaming it in blocks.
+// Outputs are named after outputName, the file name when it is empty.
+FileReport analyzeFile(const std::string &filePath, const AnalysisOptions &options, ThreadPool &pool, const std::string &outputName = "")
+{
+    FileReport report;
+    report.filePath = filePath;
+    report.fileName = outputName.empty() ? std::filesystem::path(filePath).filename().string() : outputName;
+    const std::string &fileName = report.fileName;
+    StageTimer fileTimer("file", &fileName);
 
-        // Compute and plot FFT for the quantized mid channel
-        std::vector<double> quantizedMidChannel(midChannel.size());
-        for (size_t i = 0; i < midChannel.size(); ++i)
-        {
-            quantizedMidChannel[i] = (quantizedLeftChannel[i] + quantizedRightChannel[i]) / 2.0;
-        }
-        std::vector<std::complex<double>> fft_quantized_mid = computeFFT(quantizedMidChannel);
-        plotFrequencySpectrum(fft_quantized_mid, buffer.getSampleRate(), fileName + " - Mid Channel FFT (Quantized " + std::to_string(16 - bitsToReduce) + " bits)");
+    /***************************************
+     *                TASK 1               *
+     ***************************************/
+
+    // Open the audio file; samples are processed block by block below, either
+    // straight from the memory-mapped WAV data or streamed through SFML, so
+    // memory use does not depend on the length of the recording
+    AudioSource source;
+    bool opened;
+    {
+        StageTimer timer("load", &fileName);
+        opened = source.open(filePath, options.memoryMap);
     }
-#endif
+    if (!opened)
+    {
+        report.error = "Failed to load WAV file: " + filePath;
+        return report;
+    }
+
+    unsigned int sampleRate = source.sampleRate();
+    unsigned int channelCount = source.channelCount();
+    std::uint64_t frameCount = source.frameCount();
+    report.info.sampleRate = sampleRate;
+    report.info.channelCount = channelCount;
+    report.info.sampleCount = frameCount * channelCount;
+    report.info.duration = static_cast<float>(static_cast<double>(frameCount) / sampleRate);
+    report.info.bitsPerSample = source.bitsPerSample();
+    report.info.floatingPoint = source.sampleFormat() == SampleFormat::Float32;
+
+    // Every stage below runs on the file's own sample type, chosen once per file
+    switch (source.sampleFormat())
+    {
+    case SampleFormat::Int16:
+        analyzeSamples<sf::Int16>(source, options, pool, report);
+        break;
+    case SampleFormat::Int32:
+        analyzeSamples<std::int32_t>(source, options, pool, report);
+        break;
+    case SampleFormat::Float32:
+        analyzeSamples<float>(source, options, pool, report);
+        break;
+    }
+    return report;
+}
+
+void printResampling(const FileReport &report)
+{
+    const ResampleReport &resampling = report.resampling;
+    std::cout << "\nResampled " << resampling.inputRate << " Hz -> " << resampling.outputRate << " Hz (" << resampling.phases << " phases x "
+              << resampling.taps << " taps):" << std::endl;
+    std::cout << "  Passband ripple: " << resampling.quality.passbandRippleDb << " dB up to " << resampling.quality.passbandEdge << " Hz" << std::endl;
+    std::cout << "  Stopband attenuation: " << resampling.quality.stopbandDb << " dB from " << resampling.quality.stopbandEdge << " Hz" << std::endl;
+    std::cout << "  Speed: " << report.info.duration << " s of audio in " << resampling.seconds << " s (real-time factor "
+              << report.info.duration / resampling.seconds << "x)" << std::endl;
+}
+
+// Typical delay and gain of R against L over the blocks with sound, and
+// whether MID / SIDE can take the channels as aligned
+void printChannelDelay(const FileReport &report)
+{
+    std::vector<double> delays, gains, correlations;
+    for (const BlockDelay &block : report.channelDelay)
+    {
+        if (!block.estimate.valid)
+            continue;
+        delays.push_back(block.estimate.delay);
+        gains.push_back(20.0 * std::log10(std::abs(block.estimate.gain)));
+        correlations.push_back(block.estimate.correlation);
+    }
+    std::cout << "\nInter-channel delay of " << report.fileName << " (R against L, " << delays.size() << " blocks):" << std::endl;
+    if (delays.empty())
+    {
+        std::cout << "  No block with sound in both channels" << std::endl;
+        return;
+    }
+    auto median = [](std::vector<double> values) {
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    };
+    double delay = median(delays);
+    auto range = std::minmax_element(delays.begin(), delays.end());
+    double sampleRate = report.resampling.outputRate ? report.resampling.outputRate : report.info.sampleRate;
+    std::cout << "  Delay: " << delay << " samples (" << delay * 1e3 / sampleRate << " ms), blocks from " << *range.first << " to "
+              << *range.second << std::endl;
+    std::cout << "  Gain: " << median(gains) << " dB" << std::endl;
+    std::cout << "  Correlation: " << median(correlations) << std::endl;
+    if (std::abs(delay) >= 0.5)
+        std::cout << "  Note: MID / SIDE assume aligned channels; R lags L by " << delay << " samples here" << std::endl;
+}
+
+void printQualityMetrics(const FileReport &report, int bitsToReduce, QuantizerKind quantizer)
+{
+    std::cout << "\nQuantization Quality Metrics for " << report.fileName << " (" << report.info.resolutionBits() - bitsToReduce << " bit";
+    if (quantizer != QuantizerKind::Truncate)
+        std::cout << ", " << quantizerName(quantizer);
+    std::cout << "):" << std::endl;
+    double avgMSE = 0.0;
+    double avgSNR = 0.0;
+    unsigned int channelCount = report.info.channelCount;
+    for (const ChannelReport &channel : report.channels)
+    {
+        if (!channel.hasQuality)
+            continue;
+        std::cout << channel.name << ":" << std::endl;
+        std::cout << "  MSE: " << channel.mse << std::endl;
+        std::cout << "  SNR: " << channel.snr << " dB" << std::endl;
+        std::cout << "  Segmental SNR: " << channel.segmentalSnr << " dB" << std::endl;
+        std::cout << "  Peak error: " << channel.peakError << std::endl;
+        avgMSE += channel.mse / channelCount;
+        avgSNR += channel.snr / channelCount;
+    }
+
+    // Average MSE and SNR across all channels
+    std::cout << "Average across " << (channelCount == 2 ? "both" : "all") << " channels:" << std::endl;
+    std::cout << "  MSE: " << avgMSE << std::endl;
+    std::cout << "  SNR: " << avgSNR << " dB" << std::endl;
+}
+
+void printRateDistortion(const FileReport &report)
+{
+    std::cout << "\nRate-Distortion sweep for " << report.fileName << ":" << std::endl;
+    std::cout << std::left << std::setw(6) << "Bits";
+    for (const std::string &name : {std::string("MSE"), std::string("SNR (dB)")})
+    {
+        for (size_t c = 0; c < report.sweep.size(); ++c)
+            std::cout << std::setw(28) << report.channels[c].name + " " + name;
+    }
+    std::cout << std::endl;
+    for (size_t p = 0; p < report.sweep.front().size(); ++p)
+    {
+        std::cout << std::setw(6) << report.sweep.front()[p].bits;
+        for (const auto &curve : report.sweep)
+            std::cout << std::setw(28) << curve[p].mse;
+        for (const auto &curve : report.sweep)
+            std::cout << std::setw(28) << curve[p].snr;
+        std::cout << std::endl;
+    }
+
+    // Every quantizer, measured at the analysed depth
+    if (!report.quantizers.empty())
+    {
+        std::cout << "\nQuantizers at " << report.quantizers.front().bits << " bits for " << report.fileName << ":" << std::endl;
+        std::cout << std::setw(12) << "Quantizer";
+        for (const std::string &name : {std::string("SNR (dB)"), std::string("Seg. SNR (dB)")})
+        {
+            for (size_t c = 0; c < report.sweep.size(); ++c)
+                std::cout << std::setw(28) << report.channels[c].name + " " + name;
+        }
+        std::cout << "Msamples/s" << std::endl;
+        for (const QuantizerReport &run : report.quantizers)
+        {
+            std::cout << std::setw(12) << quantizerName(run.kind);
+            for (const ErrorResult &channel : run.channels)
+                std::cout << std::setw(28) << channel.snr;
+            for (const ErrorResult &channel : run.channels)
+                std::cout << std::setw(28) << channel.segmentalSnr;
+            std::cout << (run.seconds > 0.0 ? run.samples / run.seconds / 1e6 : 0.0) << std::endl;
+        }
+    }
+    std::cout << std::right;
+}
+
+// Simple wildcard match supporting '*' and '?'
+bool matchesPattern(const std::string &name, const std::string &pattern)
+{
+    size_t n = 0, p = 0, star = std::string::npos, mark = 0;
+    while (n < name.size())
+    {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+        {
+            n++;
+            p++;
+        }
+        else if (p < pattern.size() && pattern[p] == '*')
+        {
+            star = p++;
+            mark = n;
+        }
+        else if (star != std::string::npos)
+        {
+            p = star + 1;
+            n = ++mark;
+        }
+        else
+            return false;
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+        p++;
+    return p == pattern.size();
+}
+
+// Expands directories (recursively, *.wav only), globs in the last path
+// component and plain file names into a sorted list of input files
+std::vector<std::string> collectInputs(const std::vector<std::string> &specs)
+{
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    for (const std::string &spec : specs)
+    {
+        fs::path path(spec);
+        std::error_code ec;
+        if (fs::is_directory(path, ec))
+        {
+            for (const auto &entry : fs::recursive_directory_iterator(path, ec))
+            {
+                if (entry.is_regular_file() && entry.path().extension() == ".wav")
+                    files.push_back(entry.path().string());
+            }
+        }
+        else if (spec.find_first_of("*?") != std::string::npos)
+        {
+            fs::path directory = path.parent_path().empty() ? fs::path(".") : path.parent_path();
+            std::string pattern = path.filename().string();
+            for (const auto &entry : fs::directory_iterator(directory, ec))
+            {
+                if (entry.is_regular_file() && matchesPattern(entry.path().filename().string(), pattern))
+                    files.push_back(entry.path().string());
+            }
+        }
+        else
+            files.push_back(spec);
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
+
+// Names the outputs of every input after its file name. Inputs sharing a
+// file name (x.wav in two directories) are named after their path below the
+// deepest directory all inputs have in common instead, with the separators
+// turned into '_', and an index is added should that still collide.
+std::vector<std::string> outputNames(const std::vector<std::string> &files)
+{
+    namespace fs = std::filesystem;
+    std::vector<fs::path> paths;
+    for (const std::string &file : files)
+        paths.push_back(fs::absolute(file).lexically_normal());
+
+    fs::path root = paths.empty() ? fs::path() : paths.front().parent_path();
+    for (const fs::path &path : paths)
+    {
+        for (fs::path below = path.lexically_relative(root); !root.empty() && (below.empty() || *below.begin() == "..");
+             below = path.lexically_relative(root))
+            root = root.parent_path();
+    }
+
+    std::map<std::string, int> uses;
+    for (const fs::path &path : paths)
+        uses[path.filename().string()]++;
+
+    std::vector<std::string> names;
+    std::set<std::string> taken;
+    for (const fs::path &path : paths)
+    {
+        std::string name = path.filename().string();
+        if (uses[name] > 1)
+        {
+            name = path.lexically_relative(root).generic_string();
+            std::replace(name.begin(), name.end(), '/', '_');
+        }
+        std::string unique = name;
+        for (int index = 2; !taken.insert(unique).second; ++index)
+            unique = fs::path(name).stem().string() + " (" + std::to_string(index) + ")" + fs::path(name).extension().string();
+        names.push_back(unique);
+    }
+    return names;
+}
+
+// A CSV field, quoted when it holds a separator, quote or line break
+std::string csvField(const std::string &text)
+{
+    if (text.find_first_of(",\"\r\n") == std::string::npos)
+        return text;
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// Analyses every input on a work-stealing pool and writes one CSV report
+int runBatch(const std::vector<std::string> &specs, const AnalysisOptions &options, unsigned int threads, const std::string &reportPath)
+{
+    std::vector<std::string> files = collectInputs(specs);
+    if (files.empty())
+    {
+        std::cerr << "No input files found" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> names = outputNames(files);
+
+    std::vector<FileReport> reports(files.size());
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        for (size_t i = 0; i < files.size(); ++i)
+            pool.submit([&, i]() { reports[i] = analyzeFile(files[i], options, pool, names[i]); });
+        pool.wait();
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::filesystem::path reportFile(reportPath);
+    if (reportFile.has_parent_path())
+        std::filesystem::create_directories(reportFile.parent_path());
+    std::ofstream outfile(reportPath);
+    outfile << std::setprecision(10);
+    outfile << "File,Sample Rate,Channels,Duration (s),Bits,Channel,MSE,SNR (dB),Segmental SNR (dB),Peak Error,Min,Max,Mean,Std Dev,Entropy (bits)\n";
+
+    double audioSeconds = 0.0;
+    int failed = 0;
+    for (const FileReport &report : reports)
+    {
+        if (!report.error.empty())
+        {
+            std::cerr << report.error << std::endl;
+            failed++;
+            continue;
+        }
+        audioSeconds += report.info.duration;
+        for (const ChannelReport &channel : report.channels)
+        {
+            outfile << csvField(report.filePath) << "," << report.info.sampleRate << "," << report.info.channelCount << ","
+                    << report.info.duration << "," << report.info.resolutionBits() - options.bitsToReduce << "," << channel.name << ",";
+            if (channel.hasQuality)
+                outfile << channel.mse << "," << channel.snr << "," << channel.segmentalSnr << "," << channel.peakError;
+            else
+                outfile << ",,,";
+            outfile << "," << channel.histogram.min << "," << channel.histogram.max << "," << channel.histogram.mean << ","
+                    << channel.histogram.stddev << "," << channel.histogram.entropy << "\n";
+        }
+    }
+    outfile.close();
+
+    double audioHours = audioSeconds / 3600.0;
+    std::cout << "Analysed " << files.size() - failed << " of " << files.size() << " files (" << audioHours << " audio hours) in "
+              << wallSeconds << " s using " << std::max(1u, threads) << " threads" << std::endl;
+    std::cout << "Throughput: " << audioHours / wallSeconds << " audio hours per second" << std::endl;
+    std::cout << "Report written to " << reportPath << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// Lossless round trip of every input: compression ratio, encode and decode
+// speed, and a bit-exact comparison of the decoded samples with the originals
+int runLossless(const std::vector<std::string> &specs, const LosslessOptions &codecOptions, unsigned int threads)
+{
+    std::vector<std::string> files = collectInputs(specs.empty() ? std::vector<std::string>{"../datasets/"} : specs);
+    if (files.empty())
+    {
+        std::cerr << "No input files found" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> names = outputNames(files);
+
+    std::string output_directory = "../outputs/lossless/";
+    std::filesystem::create_directories(output_directory);
+
+    ThreadPool pool(threads);
+    std::cout << std::left << std::setw(28) << "File" << std::right << std::setw(12) << "PCM bytes" << std::setw(12) << "Coded bytes"
+              << std::setw(8) << "Ratio" << std::setw(14) << "Encode MB/s" << std::setw(14) << "Decode MB/s" << "  Round trip" << std::endl;
+
+    std::uint64_t totalInput = 0, totalOutput = 0;
+    double totalEncode = 0.0, totalDecode = 0.0;
+    int failed = 0;
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        const std::string &path = files[i];
+        const std::string &name = names[i];
+        StageTimer loadTimer("load", &name);
+        AudioSource source;
+        if (!source.open(path))
+        {
+            std::cerr << "Failed to load audio file: " << path << std::endl;
+            failed++;
+            continue;
+        }
+        // The codec stores int16 samples; wider files would be cut to their top 16 bits first
+        if (source.sampleFormat() != SampleFormat::Int16)
+        {
+            std::cerr << "Skipping " << path << ": unsupported " << source.bitsPerSample()
+                      << (source.sampleFormat() == SampleFormat::Float32 ? "-bit float" : "-bit") << " input" << std::endl;
+            failed++;
+            continue;
+        }
+        std::vector<sf::Int16> buffer;
+        PcmView audio = source.readAll(buffer);
+        unsigned int channelCount = audio.channels;
+        std::uint64_t frames = audio.frames;
+        std::size_t sampleCount = static_cast<std::size_t>(frames * channelCount);
+        loadTimer.stop();
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::uint8_t> encoded;
+        {
+            StageTimer timer("encode", &name);
+            encoded = encodeLossless(audio.samples, frames, channelCount, source.sampleRate(), pool, codecOptions);
+        }
+        auto encodedAt = std::chrono::steady_clock::now();
+        LosslessAudio decoded;
+        bool ok;
+        {
+            StageTimer timer("decode", &name);
+            ok = decodeLossless(encoded.data(), encoded.size(), decoded, pool);
+        }
+        auto decodedAt = std::chrono::steady_clock::now();
+        bool exact = ok && decoded.channels == channelCount && decoded.samples.size() == sampleCount &&
+                     std::equal(decoded.samples.begin(), decoded.samples.end(), audio.samples);
+
+        {
+            StageTimer timer("write", &name);
+            std::ofstream outfile(output_directory + std::filesystem::path(name).stem().string() + ".p2la", std::ios::binary);
+            outfile.write(reinterpret_cast<const char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+        }
+
+        std::uint64_t inputBytes = sampleCount * ((source.bitsPerSample() + 7) / 8);
+        double encodeSeconds = std::chrono::duration<double>(encodedAt - start).count();
+        double decodeSeconds = std::chrono::duration<double>(decodedAt - encodedAt).count();
+        std::cout << std::left << std::setw(28) << name << std::right << std::setw(12) << inputBytes << std::setw(12) << encoded.size()
+                  << std::fixed << std::setprecision(3) << std::setw(8) << static_cast<double>(inputBytes) / encoded.size()
+                  << std::setprecision(1) << std::setw(14) << inputBytes / encodeSeconds / 1e6 << std::setw(14)
+                  << inputBytes / decodeSeconds / 1e6 << "  " << (exact ? "exact" : "MISMATCH") << std::defaultfloat << std::endl;
+
+        totalInput += inputBytes;
+        totalOutput += encoded.size();
+        totalEncode += encodeSeconds;
+        totalDecode += decodeSeconds;
+        if (!exact)
+            failed++;
+    }
+
+    if (totalOutput > 0)
+    {
+        std::cout << std::left << std::setw(28) << "Total" << std::right << std::setw(12) << totalInput << std::setw(12) << totalOutput
+                  << std::fixed << std::setprecision(3) << std::setw(8) << static_cast<double>(totalInput) / totalOutput
+                  << std::setprecision(1) << std::setw(14) << totalInput / totalEncode / 1e6 << std::setw(14)
+                  << totalInput / totalDecode / 1e6 << std::defaultfloat << std::endl;
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+// Fingerprints every input in parallel and saves one inverted index over all
+// of them, with its size per hour of indexed audio
+int runFingerprintIndex(const std::vector<std::string> &specs, const std::string &indexPath, unsigned int threads)
+{
+    std::vector<std::string> files = collectInputs(specs.empty() ? std::vector<std::string>{"../datasets/"} : specs);
+    if (files.empty())
+    {
+        std::cerr << "No input files found" << std::endl;
+        return 1;
+    }
+
+    struct Fingerprint
+    {
+        std::vector<FingerprintHash> hashes;
+        double seconds = 0.0;
+        std::string error;
+    };
+    std::vector<Fingerprint> fingerprints(files.size());
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        for (std::size_t i = 0; i < files.size(); ++i)
+        {
+            pool.submit([&, i]() {
+                StageTimer timer("fingerprint", &files[i]);
+                Fingerprint &fingerprint = fingerprints[i];
+                fingerprintFile(files[i], pool, fingerprint.hashes, fingerprint.seconds, fingerprint.error);
+            });
+        }
+        pool.wait();
+    }
+
+    // Files go in in sorted order, so the index does not depend on the thread count
+    FingerprintIndex index;
+    int failed = 0;
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        if (!fingerprints[i].error.empty())
+        {
+            std::cerr << fingerprints[i].error << std::endl;
+            failed++;
+        }
+        else if (!index.addFile(files[i], fingerprints[i].seconds, fingerprints[i].hashes))
+        {
+            std::cerr << "Fingerprint index is full, skipping " << files[i] << std::endl;
+            failed++;
+        }
+        fingerprints[i].hashes = std::vector<FingerprintHash>();
+    }
+    {
+        StageTimer timer("index");
+        index.build();
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::filesystem::path indexFile(indexPath);
+    if (indexFile.has_parent_path())
+        std::filesystem::create_directories(indexFile.parent_path());
+    if (!index.save(indexPath))
+    {
+        std::cerr << "Could not write " << indexPath << std::endl;
+        return 1;
+    }
+
+    double audioHours = index.audioSeconds() / 3600.0;
+    double megabytes = index.sizeBytes() / 1e6;
+    std::cout << "Indexed " << index.fileCount() << " of " << files.size() << " files (" << audioHours << " audio hours) in "
+              << wallSeconds << " s using " << std::max(1u, threads) << " threads" << std::endl;
+    std::cout << "Landmarks: " << index.postingCount() << " (" << index.postingCount() / std::max(1e-9, index.audioSeconds()) << " per second of audio)"
+              << std::endl;
+    std::cout << "Index size: " << megabytes << " MB (" << megabytes / std::max(1e-9, audioHours) << " MB per audio hour)" << std::endl;
+    std::cout << "Index written to " << indexPath << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// Matches every clip against the index: the files that share it and where
+// the clip starts in them, with the time taken to fingerprint and look it up
+int runFingerprintQuery(const std::vector<std::string> &clips, const std::string &indexPath, unsigned int threads)
+{
+    if (clips.empty())
+    {
+        std::cerr << "No query clips given" << std::endl;
+        return 1;
+    }
+
+    FingerprintIndex index;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!index.load(indexPath, error))
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Loaded " << indexPath << ": " << index.fileCount() << " files, " << index.postingCount() << " landmarks in "
+              << loadSeconds * 1e3 << " ms" << std::endl;
+
+    ThreadPool pool(threads);
+    int failed = 0;
+    for (const std::string &clip : clips)
+    {
+        std::vector<FingerprintHash> hashes;
+        double seconds = 0.0;
+        auto clipStart = std::chrono::steady_clock::now();
+        if (!fingerprintFile(clip, pool, hashes, seconds, error))
+        {
+            std::cerr << error << std::endl;
+            failed++;
+            continue;
+        }
+        auto fingerprinted = std::chrono::steady_clock::now();
+        std::vector<FingerprintMatch> matches = index.query(hashes);
+        auto matched = std::chrono::steady_clock::now();
+
+        std::cout << "\n" << clip << " (" << seconds << " s, " << hashes.size() << " landmarks): fingerprint "
+                  << std::chrono::duration<double>(fingerprinted - clipStart).count() * 1e3 << " ms, lookup "
+                  << std::chrono::duration<double>(matched - fingerprinted).count() * 1e3 << " ms" << std::endl;
+        if (matches.empty())
+            std::cout << "  No match" << std::endl;
+        for (const FingerprintMatch &match : matches)
+        {
+            std::cout << "  " << index.filePath(match.file) << " at " << match.offset << " s (" << match.score << " of " << hashes.size()
+                      << " landmarks)" << std::endl;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+// Error metrics of processed against original over `frames` frames from
+// the given start frames, read block by block as float
+void compareRanges(AudioSource &original, AudioSource &processed, std::uint64_t originalStart, std::uint64_t processedStart,
+                   std::uint64_t frames, std::size_t blockFrames, BasicErrorMetrics<float> &metrics, ThreadPool &pool)
+{
+    std::vector<float> originalBuffer, processedBuffer;
+    for (std::uint64_t done = 0; done < frames;)
+    {
+        std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(blockFrames, frames - done));
+        BasicPcmView<float> a = original.read(originalStart + done, count, originalBuffer);
+        BasicPcmView<float> b = processed.read(processedStart + done, count, processedBuffer);
+        std::size_t common = static_cast<std::size_t>(std::min(a.frames, b.frames));
+        if (common == 0)
+            break;
+        metrics.feed(a.samples, b.samples, common, pool);
+        done += common;
+    }
+}
+
+// Compares a processed version of a file (re-encoded, re-recorded) with its
+// original: the delay and gain between them come from an FFT cross-correlation
+// of the first 2^20 frames of both, mixed down to mono, and the error metrics
+// are computed as the files are and with that delay removed
+int runCompare(const std::vector<std::string> &files, double maxLag, std::size_t blockFrames, unsigned int threads)
+{
+    if (files.size() != 2)
+    {
+        std::cerr << "--compare needs an original and a processed file" << std::endl;
+        return 1;
+    }
+    AudioSource original, processed;
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        if (!(i == 0 ? original : processed).open(files[i]))
+        {
+            std::cerr << "Failed to load audio file: " << files[i] << std::endl;
+            return 1;
+        }
+    }
+    const unsigned int channelCount = original.channelCount();
+    const unsigned int sampleRate = original.sampleRate();
+    if (processed.channelCount() != channelCount || processed.sampleRate() != sampleRate)
+    {
+        std::cerr << "Both files need the same sample rate and channel count (resample with --rate first)" << std::endl;
+        return 1;
+    }
+
+    // Delay estimate on mono mixes of the start of both files
+    StageTimer correlateTimer("correlate");
+    auto start = std::chrono::steady_clock::now();
+    const std::size_t excerpt = static_cast<std::size_t>(std::min<std::uint64_t>({original.frameCount(), processed.frameCount(), 1u << 20}));
+    std::vector<float> mixes[2];
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        std::vector<float> buffer;
+        BasicPcmView<float> view = (i == 0 ? original : processed).read(0, excerpt, buffer);
+        mixes[i].assign(excerpt, 0.0f);
+        for (std::size_t f = 0; f < view.frames; ++f)
+        {
+            for (unsigned int c = 0; c < channelCount; ++c)
+                mixes[i][f] += view.at(f, c) / channelCount;
+        }
+    }
+    CrossCorrelator correlator(excerpt, static_cast<std::size_t>(std::ceil(maxLag * sampleRate)));
+    DelayEstimate estimate = correlator.estimate(mixes[0].data(), mixes[1].data(), excerpt);
+    double correlateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    correlateTimer.stop();
+    if (!estimate.valid)
+    {
+        std::cerr << "The start of one of the files is silent: no delay to estimate" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Comparing " << files[1] << " against " << files[0] << std::endl;
+    std::cout << "  Delay: " << estimate.delay << " samples (" << estimate.delay * 1e3 / sampleRate << " ms, searched +/- "
+              << maxLag * 1e3 << " ms)" << std::endl;
+    std::cout << "  Gain: " << 20.0 * std::log10(std::abs(estimate.gain)) << " dB" << (estimate.gain < 0.0 ? " (inverted)" : "") << std::endl;
+    std::cout << "  Correlation: " << estimate.correlation << std::endl;
+    std::cout << "  Cross-correlation of " << excerpt << " frames: " << correlateSeconds * 1e3 << " ms (FFT size " << fastFftSize(excerpt + correlator.maxLag())
+              << ")" << std::endl;
+
+    // processed[n + lag] lines up with original[n]
+    ThreadPool pool(threads);
+    BasicErrorMetrics<float> asIs(channelCount), aligned(channelCount);
+    {
+        StageTimer timer("metrics");
+        compareRanges(original, processed, 0, 0, std::min(original.frameCount(), processed.frameCount()), blockFrames, asIs, pool);
+        std::uint64_t originalStart = estimate.lag < 0 ? static_cast<std::uint64_t>(-estimate.lag) : 0;
+        std::uint64_t processedStart = estimate.lag > 0 ? static_cast<std::uint64_t>(estimate.lag) : 0;
+        std::uint64_t frames = std::min(original.frameCount() - std::min(original.frameCount(), originalStart),
+                                        processed.frameCount() - std::min(processed.frameCount(), processedStart));
+        compareRanges(original, processed, originalStart, processedStart, frames, blockFrames, aligned, pool);
+    }
+
+    std::cout << std::left << std::setw(20) << "\nChannel" << std::right << std::setw(14) << "SNR as is" << std::setw(14) << "SNR aligned"
+              << std::setw(16) << "Seg. SNR al." << std::setw(14) << "MSE aligned" << std::endl;
+    for (unsigned int c = 0; c < channelCount; ++c)
+    {
+        ErrorResult before = asIs.result(c), after = aligned.result(c);
+        std::cout << std::left << std::setw(19) << channelName(c, channelCount) << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(11) << before.snr << " dB" << std::setw(11) << after.snr << " dB" << std::setw(13) << after.segmentalSnr
+                  << " dB" << std::defaultfloat << std::setw(14) << after.mse << std::endl;
+    }
+    return 0;
+}
+
+// Codes the file with the MDCT coder at the bitrate of the truncated PCM and
+// compares both against the original with the integer error metrics. The
+// coder works on int16, so wider files are compared on their top 16 bits,
+// with the same number of bits kept as the analysis above.
+void compareTransformCoding(const std::string &filePath, int keptBits, ThreadPool &pool)
+{
+    if (keptBits < 1 || keptBits > 15)
+    {
+        std::cerr << "MDCT comparison skipped: it needs 1 to 15 kept bits, not " << keptBits << std::endl;
+        return;
+    }
+    const int bitsToReduce = 16 - keptBits;
+    AudioSource source;
+    if (!source.open(filePath))
+    {
+        std::cerr << "Failed to load audio file: " << filePath << std::endl;
+        return;
+    }
+    std::vector<sf::Int16> buffer;
+    PcmView audio = source.readAll(buffer);
+    unsigned int channelCount = audio.channels;
+    std::uint64_t frames = audio.frames;
+    std::size_t sampleCount = static_cast<std::size_t>(frames * channelCount);
+    unsigned int sampleRate = source.sampleRate();
+    if (source.sampleFormat() != SampleFormat::Int16)
+        std::cout << "\nNote: the MDCT comparison runs on the top 16 bits of this " << source.bitsPerSample() << "-bit file" << std::endl;
+    double duration = static_cast<double>(frames) / sampleRate;
+
+    TransformCodecOptions codecOptions;
+    codecOptions.bitsPerSample = 16 - bitsToReduce;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::uint8_t> encoded = encodeTransform(audio.samples, frames, channelCount, sampleRate, pool, codecOptions);
+    auto encodedAt = std::chrono::steady_clock::now();
+    std::vector<sf::Int16> decoded;
+    unsigned int decodedChannels = 0;
+    bool ok = decodeTransform(encoded.data(), encoded.size(), decoded, decodedChannels, pool);
+    auto decodedAt = std::chrono::steady_clock::now();
+    if (!ok || decoded.size() != sampleCount)
+    {
+        std::cerr << "MDCT round trip failed for " << filePath << std::endl;
+        return;
+    }
+
+    std::vector<sf::Int16> truncated(sampleCount);
+    quantizeAudio(audio.samples, truncated.data(), sampleCount, bitsToReduce);
+
+    double bitsPerSample = encoded.size() * 8.0 / sampleCount;
+    std::cout << "\nMDCT coding vs truncation at " << 16 - bitsToReduce << " bits per sample:" << std::endl;
+    std::cout << "MDCT stream: " << bitsPerSample << " bits per sample (" << bitsPerSample * sampleRate * channelCount / 1000.0
+              << " kbit/s)" << std::endl;
+    ErrorMetrics truncationErrors(channelCount), transformErrors(channelCount);
+    truncationErrors.feed(audio.samples, truncated.data(), static_cast<std::size_t>(frames), pool);
+    transformErrors.feed(audio.samples, decoded.data(), static_cast<std::size_t>(frames), pool);
+    for (unsigned int c = 0; c < channelCount; ++c)
+    {
+        ErrorResult truncation = truncationErrors.result(c), transform = transformErrors.result(c);
+        std::cout << channelName(c, channelCount) << ":" << std::endl;
+        std::cout << "  Truncation SNR: " << truncation.snr << " dB (segmental " << truncation.segmentalSnr << " dB)" << std::endl;
+        std::cout << "  MDCT SNR: " << transform.snr << " dB (segmental " << transform.segmentalSnr << " dB)" << std::endl;
+    }
+    double encodeSeconds = std::chrono::duration<double>(encodedAt - start).count();
+    double decodeSeconds = std::chrono::duration<double>(decodedAt - encodedAt).count();
+    std::cout << "Encode: " << duration / encodeSeconds << "x real time, decode: " << duration / decodeSeconds << "x real time" << std::endl;
+}
+
+// Settings of the stdin streaming mode
+struct StreamOptions
+{
+    std::size_t blockFrames = 4096;
+    std::size_t queueBlocks = 8;
+    bool raw = false; // headerless PCM instead of a WAV stream
+    unsigned int rawChannels = 2;
+    unsigned int rawSampleRate = 44100;
+    std::string outputPath; // empty for stdout
+};
+
+// One block handed from the reader thread to the analysis thread
+struct StreamBlock
+{
+    std::vector<sf::Int16> samples;
+    std::size_t frames = 0;
+    bool last = false;
+    std::chrono::steady_clock::time_point ready; // when the reader finished the block
+};
+
+// Spins briefly, then yields, then sleeps, so a side waiting on the ring costs little CPU
+void backOff(unsigned int &spins)
+{
+    if (++spins < 64)
+        return;
+    if (spins < 128)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+void appendNumber(std::string &line, double value)
+{
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+    line.append(buffer, static_cast<std::size_t>(length));
+}
+
+// Reads PCM from stdin on one thread and analyses it block by block on this
+// one, with a lock-free ring between them. Every block gets one CSV line per
+// block (RMS, peak, block and running quantization SNR and a histogram per
+// channel), written and flushed as soon as the block is done. Latency from
+// the end of a block's read to its line is bounded by the ring capacity while
+// the analysis keeps up with the input.
+int runStreaming(const StreamOptions &stream, const AnalysisOptions &options)
+{
+    PcmStreamReader reader(stdin);
+    if (stream.raw)
+        reader.openRaw(stream.rawChannels, stream.rawSampleRate);
+    else
+    {
+        std::string error;
+        if (!reader.openWav(error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+    const unsigned int channelCount = reader.channelCount();
+    const std::size_t blockFrames = std::max<std::size_t>(1, stream.blockFrames);
+    const int bitsToReduce = options.bitsToReduce;
+    const int bins = options.histogramBins > 0 ? options.histogramBins : 64;
+
+    std::FILE *out = stdout;
+    if (!stream.outputPath.empty() && !(out = std::fopen(stream.outputPath.c_str(), "w")))
+    {
+        std::cerr << "Failed to open " << stream.outputPath << std::endl;
+        return 1;
+    }
+
+    std::string line = "Block,First Frame,Time (s)";
+    for (unsigned int c = 0; c < channelCount; ++c)
+    {
+        std::string name = channelName(c, channelCount);
+        line += "," + name + " RMS," + name + " Peak," + name + " SNR (dB)," + name + " Running SNR (dB)," + name + " Histogram";
+    }
+    line += "\n";
+    std::fwrite(line.data(), 1, line.size(), out);
+    std::fflush(out);
+
+    SpscRing<StreamBlock> ring(std::max<std::size_t>(2, stream.queueBlocks));
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&]() {
+        for (bool last = false; !last;)
+        {
+            StreamBlock *block;
+            unsigned int spins = 0;
+            while (!(block = ring.beginWrite()))
+                backOff(spins);
+            block->samples.resize(blockFrames * channelCount);
+            block->frames = reader.read(block->samples.data(), blockFrames);
+            // Reads only come back short at the end of the stream
+            block->last = last = block->frames < blockFrames;
+            block->ready = std::chrono::steady_clock::now();
+            ring.endWrite();
+        }
+    });
+
+    std::vector<sf::Int16> quantized(blockFrames * channelCount);
+    std::vector<std::uint64_t> signalEnergy(channelCount, 0), errorEnergy(channelCount, 0);
+    std::vector<std::uint32_t> histogram(bins);
+    std::vector<double> latencies;
+    std::uint64_t position = 0;
+    std::size_t blockIndex = 0, deepestQueue = 0;
+    auto snr = [](std::uint64_t signal, std::uint64_t error) {
+        return 10 * std::log10(static_cast<double>(signal) / static_cast<double>(error));
+    };
+
+    for (bool last = false; !last;)
+    {
+        StreamBlock *block;
+        unsigned int spins = 0;
+        while (!(block = ring.beginRead()))
+            backOff(spins);
+        deepestQueue = std::max(deepestQueue, ring.size());
+        last = block->last;
+
+        if (block->frames > 0)
+        {
+            std::size_t frames = block->frames;
+            const sf::Int16 *samples = block->samples.data();
+            {
+                StageTimer timer("quantize");
+                quantizeAudio(samples, quantized.data(), frames * channelCount, bitsToReduce, options.quantizer, position * channelCount);
+            }
+
+            StageTimer metricsTimer("metrics");
+            line.clear();
+            line += std::to_string(blockIndex) + "," + std::to_string(position) + ",";
+            appendNumber(line, static_cast<double>(position) / reader.sampleRate());
+            for (unsigned int c = 0; c < channelCount; ++c)
+            {
+                std::uint64_t signal = 0, error = 0;
+                int peak = 0;
+                std::fill(histogram.begin(), histogram.end(), 0);
+                for (std::size_t i = 0; i < frames; ++i)
+                {
+                    int value = samples[i * channelCount + c];
+                    int difference = value - quantized[i * channelCount + c];
+                    signal += static_cast<std::uint64_t>(value * value);
+                    error += static_cast<std::uint64_t>(difference * difference);
+                    peak = std::max(peak, std::abs(value));
+                    histogram[static_cast<std::size_t>(value + 32768) * bins >> 16]++;
+                }
+                signalEnergy[c] += signal;
+                errorEnergy[c] += error;
+
+                line += ",";
+                appendNumber(line, std::sqrt(static_cast<double>(signal) / frames) * int16Scale);
+                line += ",";
+                appendNumber(line, peak * int16Scale);
+                line += ",";
+                appendNumber(line, snr(signal, error));
+                line += ",";
+                appendNumber(line, snr(signalEnergy[c], errorEnergy[c]));
+                line += ",";
+                for (int b = 0; b < bins; ++b)
+                    line += (b ? "|" : "") + std::to_string(histogram[b]);
+            }
+            line += "\n";
+            metricsTimer.stop();
+            {
+                StageTimer timer("write");
+                std::fwrite(line.data(), 1, line.size(), out);
+                std::fflush(out);
+            }
+            position += frames;
+            blockIndex++;
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - block->ready).count());
+        }
+        ring.endRead();
+    }
+    producer.join();
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (out != stdout)
+        std::fclose(out);
+
+    // Summary on stderr, so stdout carries only the CSV
+    double audioSeconds = static_cast<double>(position) / std::max(1u, reader.sampleRate());
+    std::cerr << "Streamed " << position << " frames (" << audioSeconds << " s of audio) in " << blockIndex << " blocks of "
+              << blockFrames << " frames, " << wallSeconds << " s wall time" << std::endl;
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) { return latencies[static_cast<std::size_t>(p / 100.0 * (latencies.size() - 1) + 0.5)]; };
+        std::cerr << "Block latency (us): p50 " << percentile(50) << ", p90 " << percentile(90) << ", p99 " << percentile(99)
+                  << ", p99.9 " << percentile(99.9) << ", max " << latencies.back() << std::endl;
+    }
+    std::cerr << "Deepest queue: " << deepestQueue << " of " << ring.capacity() << " blocks" << std::endl;
+    return 0;
+}
+
+// Stage summary, plus the trace file when one was asked for
+void reportProfile(const std::string &tracePath, std::ostream &out = std::cout)
+{
+    printStageSummary(out);
+    if (tracePath.empty())
+        return;
+    if (writeChromeTrace(tracePath))
+        out << "Trace written to " << tracePath << std::endl;
+    else
+        std::cerr << "Failed to write " << tracePath << std::endl;
+}
+
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [sampleNumber] [bitsToReduce] [options]\n";
+    std::cerr << "       " << program << " --batch <dir|glob|file>... [--bits N] [-j threads] [--report file] [options]\n";
+    std::cerr << "       " << program << " --lossless [dir|glob|file]... [-j threads] [--codec-block N]\n";
+    std::cerr << "       " << program << " --fingerprint [dir|glob|file]... [-j threads] [--index file]\n";
+    std::cerr << "       " << program << " --query <clip>... [--index file]\n";
+    std::cerr << "       " << program << " --compare <original> <processed> [--max-lag ms] [-b frames]\n";
+    std::cerr << "       " << program << " --stream [--raw channels:rate] [-b frames] [--bits N] [--stream-queue N] [--stream-out file]\n";
+    std::cerr << "Options:\n";
+    std::cerr << "  -w                 Plot the channel waveforms\n";
+    std::cerr << "  -h                 Plot the channel histograms\n";
+    std::cerr << "  --hist-bins N      Histogram bins, or 'exact' for one bin per sample value (default 64)\n";
+    std::cerr << "  -q                 Plot the zoomed-in original and quantized waveforms\n";
+    std::cerr << "  --zoom off:frames  Zoomed-in waveform range in frames (default: 500 frames from one second in)\n";
+    std::cerr << "  -a                 Save the quantized audio file\n";
+    std::cerr << "  -f                 Plot the mid channel spectrum\n";
+    std::cerr << "  --quantizer name   Quantizer: truncate (default), mid-tread, mid-rise, mu-law, a-law, tpdf\n";
+    std::cerr << "  -s                 Rate-distortion sweep over every bit depth of the file, and every quantizer\n";
+    std::cerr << "  -m                 Compare the MDCT coder with truncation at the same bitrate\n";
+    std::cerr << "  -b frames          Frames read per block (default 65536)\n";
+    std::cerr << "  --no-mmap          Decode WAV files with SFML instead of memory-mapping them\n";
+    std::cerr << "  --rate Hz          Resample every file to this rate before the analysis\n";
+    std::cerr << "  --resample-quality q Resampler filter: fast, standard, best (default standard)\n";
+    std::cerr << "  --spectrogram      Save mid channel spectrograms\n";
+    std::cerr << "  --features         Save per-frame mid channel features (RMS, ZCR, spectral shape, band energies)\n";
+    std::cerr << "  --lr-delay         Estimate the delay and gain of R against L in every block\n";
+    std::cerr << "  --max-lag ms       Largest delay searched (default 10 ms, 1000 ms for --compare)\n";
+    std::cerr << "  --fft-size N       STFT frame size (default 4096)\n";
+    std::cerr << "  --hop N            STFT hop size (default 1024)\n";
+    std::cerr << "  --window name      STFT window: rect, hann, hamming, blackman (default hann)\n";
+    std::cerr << "  --fft-planner r    FFTW planner rigor (FFTW builds): estimate, measure, patient, exhaustive (default measure)\n";
+#ifdef USE_PLOTTING
+    std::cerr << "  --plot B           Plot output: gnuplot (default), native or csv\n";
+#else
+    std::cerr << "  --plot B           Plot output: csv (default) or native PNGs\n";
+#endif
+    std::cerr << "  --plot-processes N Gnuplot processes shared by all plots (default 1)\n";
+    std::cerr << "  --timings          Print the time taken to write every plot / CSV output\n";
+    std::cerr << "  --profile          Print the time spent in every pipeline stage\n";
+    std::cerr << "  --trace file       Write a Chrome / Perfetto trace of the pipeline stages (implies --profile)\n";
+    std::cerr << "  --raw ch:rate      Stream mode: headerless 16-bit PCM instead of WAV on stdin\n";
+    std::cerr << "  --stream-queue N   Stream mode: blocks buffered between reader and analysis (default 8)\n";
+    std::cerr << "  --stream-out file  Stream mode: per-block CSV file (default stdout)\n";
+    std::cerr << "  --codec-block N    Frames per block of the lossless codec (default 4096)\n";
+    std::cerr << "  --index file       Fingerprint index to build or query (default ../outputs/fingerprints.p2fp)\n";
+    std::cerr << "  --fft-wisdom dir   FFTW wisdom cache directory, empty to disable (default ../outputs/fftw-wisdom/)\n";
+}
+
+int main(int argc, char *argv[])
+{
+    /***************************************
+     *           PARSING ARGUMENTS         *
+     ***************************************/
+
+    // Default values
+    int sampleNumber = 1;
+    AnalysisOptions options;
+    bool batchMode = false;
+    bool losslessMode = false;
+    bool streamMode = false;
+    bool fingerprintMode = false;
+    bool queryMode = false;
+    bool compareMode = false;
+    double maxLagMs = -1.0; // --max-lag; the default depends on the mode
+    std::string indexPath = "../outputs/fingerprints.p2fp";
+    bool blockFramesSet = false;
+    StreamOptions streamOptions;
+    LosslessOptions codecOptions;
+    std::vector<std::string> batchInputs;
+    unsigned int threads = std::thread::hardware_concurrency();
+    std::string reportPath = "../outputs/batch_report.csv";
+    FftRigor fftRigor = FftRigor::Measure;
+    std::string fftWisdomDirectory = "../outputs/fftw-wisdom/";
+    unsigned int plotProcesses = 1;
+    PlotBackend plotBackendChoice = plotBackend();
+    bool showTimings = false;
+    bool showProfile = false;
+    std::string tracePath;
+
+    // Positional arguments (single-file mode only)
+    int firstOption = 1;
+    if (argc > 1 && std::string(argv[1]) == "--batch")
+    {
+        batchMode = true;
+        firstOption = 2;
+    }
+    else if (argc > 1 && std::string(argv[1]) == "--stream")
+    {
+        streamMode = true;
+        firstOption = 2;
+    }
+    else if (argc > 1 && std::string(argv[1]) == "--lossless")
+    {
+        losslessMode = true;
+        firstOption = 2;
+    }
+    else if (argc > 1 && std::string(argv[1]) == "--fingerprint")
+    {
+        fingerprintMode = true;
+        firstOption = 2;
+    }
+    else if (argc > 1 && std::string(argv[1]) == "--query")
+    {
+        queryMode = true;
+        firstOption = 2;
+    }
+    else if (argc > 1 && std::string(argv[1]) == "--compare")
+    {
+        compareMode = true;
+        firstOption = 2;
+    }
+    else
+    {
+        if (argc > 1)
+            sampleNumber = std::stoi(argv[1]);
+        if (argc > 2)
+            options.bitsToReduce = std::stoi(argv[2]);
+        firstOption = 3;
+    }
+
+    // Parse command line arguments
+    for (int i = firstOption; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-w")
+            options.generateWaveform = true;
+        else if (arg == "-h")
+            options.generateHistograms = true;
+        else if (arg == "-q")
+            options.generateQuantizedWaveform = true;
+        else if (arg == "-a")
+            options.generateAudioFile = true;
+        else if (arg == "-f")
+            options.generateFFT = true;
+        else if (arg == "-s")
+            options.generateSweep = true;
+        else if (arg == "-m")
+            options.generateTransformCoding = true;
+        else if (arg == "--spectrogram")
+            options.generateSpectrogram = true;
+        else if (arg == "--features")
+            options.generateFeatures = true;
+        else if (arg == "--lr-delay")
+            options.generateChannelDelay = true;
+        else if (arg == "--max-lag" && i + 1 < argc)
+            maxLagMs = std::stod(argv[++i]);
+        else if (arg == "--fft-size" && i + 1 < argc)
+            options.stft.size = std::max<std::size_t>(2, std::stoul(argv[++i]));
+        else if (arg == "--hop" && i + 1 < argc)
+            options.stft.hop = std::max<std::size_t>(1, std::stoul(argv[++i]));
+        else if (arg == "--window" && i + 1 < argc && parseWindowType(argv[i + 1], options.stft.window))
+            i++;
+        else if (arg == "--fft-planner" && i + 1 < argc && parseFftRigor(argv[i + 1], fftRigor))
+            i++;
+        else if (arg == "--fft-wisdom" && i + 1 < argc)
+            fftWisdomDirectory = argv[++i];
+        else if (arg == "--hist-bins" && i + 1 < argc)
+        {
+            std::string bins = argv[++i];
+            options.histogramBins = bins == "exact" ? 0 : std::max(1, std::stoi(bins));
+        }
+        else if (arg == "--zoom" && i + 1 < argc)
+        {
+            // offset:frames, both in sample frames
+            std::string zoom = argv[++i];
+            std::size_t colon = zoom.find(':');
+            options.zoomOffset = std::stoll(zoom.substr(0, colon));
+            if (colon != std::string::npos)
+                options.zoomFrames = std::max<std::uint64_t>(1, std::stoull(zoom.substr(colon + 1)));
+        }
+        else if (arg == "--no-mmap")
+            options.memoryMap = false;
+        else if (arg == "--rate" && i + 1 < argc)
+            options.targetRate = std::stoul(argv[++i]);
+        else if (arg == "--resample-quality" && i + 1 < argc && parseResamplerQuality(argv[i + 1], options.resampler))
+            i++;
+        else if (arg == "--quantizer" && i + 1 < argc && parseQuantizerKind(argv[i + 1], options.quantizer))
+            i++;
+        else if (arg == "-b" && i + 1 < argc)
+        {
+            options.blockFrames = std::max<std::size_t>(1, std::stoul(argv[++i]));
+            blockFramesSet = true;
+        }
+        else if (arg == "--raw" && i + 1 < argc)
+        {
+            // channels:rate
+            std::string format = argv[++i];
+            std::size_t colon = format.find(':');
+            streamOptions.raw = true;
+            streamOptions.rawChannels = std::max(1, std::stoi(format.substr(0, colon)));
+            if (colon != std::string::npos)
+                streamOptions.rawSampleRate = std::stoul(format.substr(colon + 1));
+        }
+        else if (arg == "--stream-queue" && i + 1 < argc)
+            streamOptions.queueBlocks = std::stoul(argv[++i]);
+        else if (arg == "--stream-out" && i + 1 < argc)
+            streamOptions.outputPath = argv[++i];
+        else if (arg == "--bits" && i + 1 < argc)
+            options.bitsToReduce = std::stoi(argv[++i]);
+        else if (arg == "-j" && i + 1 < argc)
+            threads = std::stoul(argv[++i]);
+        else if (arg == "--plot" && i + 1 < argc && parsePlotBackend(argv[i + 1], plotBackendChoice))
+            i++;
+        else if (arg == "--plot-processes" && i + 1 < argc)
+            plotProcesses = std::stoul(argv[++i]);
+        else if (arg == "--timings")
+            showTimings = true;
+        else if (arg == "--profile")
+            showProfile = true;
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            tracePath = argv[++i];
+            showProfile = true;
+        }
+        else if (arg == "--report" && i + 1 < argc)
+            reportPath = argv[++i];
+        else if (arg == "--help")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if (arg == "--codec-block" && i + 1 < argc)
+            codecOptions.blockFrames = std::stoul(argv[++i]);
+        else if (arg == "--index" && i + 1 < argc)
+            indexPath = argv[++i];
+        else if ((batchMode || losslessMode || fingerprintMode || queryMode || compareMode) && arg[0] != '-')
+            batchInputs.push_back(arg);
+        else
+        {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (showProfile)
+        enableProfiling();
+    configureFftPlanner(fftRigor, fftWisdomDirectory);
+    configurePlotting(plotProcesses);
+    setPlotBackend(plotBackendChoice);
+
+    if (losslessMode)
+    {
+        int status = runLossless(batchInputs, codecOptions, threads);
+        if (showProfile)
+            reportProfile(tracePath);
+        return status;
+    }
+
+    if (maxLagMs >= 0.0)
+        options.maxLag = maxLagMs / 1e3;
+
+    if (compareMode)
+    {
+        int status = runCompare(batchInputs, maxLagMs >= 0.0 ? options.maxLag : 1.0, options.blockFrames, threads);
+        if (showProfile)
+            reportProfile(tracePath);
+        return status;
+    }
+
+    if (fingerprintMode || queryMode)
+    {
+        int status = fingerprintMode ? runFingerprintIndex(batchInputs, indexPath, threads) : runFingerprintQuery(batchInputs, indexPath, threads);
+        if (showProfile)
+            reportProfile(tracePath);
+        return status;
+    }
+
+    if (streamMode)
+    {
+        if (blockFramesSet)
+            streamOptions.blockFrames = options.blockFrames;
+        int status = runStreaming(streamOptions, options);
+        // stdout may be the CSV stream
+        if (showProfile)
+            reportProfile(tracePath, std::cerr);
+        return status;
+    }
+
+    if (batchMode)
+    {
+        int status = runBatch(batchInputs, options, threads, reportPath);
+        finishPlotting();
+        if (showTimings)
+            printOutputTimes(std::cout, true);
+        if (showProfile)
+            reportProfile(tracePath);
+        return status;
+    }
+
+    // If no specific outputs are requested, generate all
+    if (!(options.generateWaveform || options.generateHistograms || options.generateQuantizedWaveform || options.generateAudioFile || options.generateFFT || options.generateSweep || options.generateSpectrogram || options.generateFeatures || options.generateChannelDelay || options.generateTransformCoding))
+    {
+        options.generateWaveform = options.generateHistograms = options.generateQuantizedWaveform = options.generateAudioFile = options.generateFFT = true;
+    }
+
+    std::string filePath = "../datasets/";
+    std::string fileName = "sample";
+    if (sampleNumber < 10)
+        fileName += "0";
+    fileName += std::to_string(sampleNumber) + ".wav";
+    filePath += fileName;
+
+    ThreadPool pool(threads);
+    FileReport report = analyzeFile(filePath, options, pool);
+    if (!report.error.empty())
+    {
+        std::cerr << report.error << std::endl;
+        return 1;
+    }
+
+    // Print audio file information and the quantization metrics
+    printAudioInfo(report.info);
+    if (report.resampling.outputRate)
+        printResampling(report);
+    printQualityMetrics(report, options.bitsToReduce, options.quantizer);
+    if (options.generateChannelDelay && report.info.channelCount >= 2)
+        printChannelDelay(report);
+    if (!report.sweep.empty())
+        printRateDistortion(report);
+    if (options.generateTransformCoding)
+        compareTransformCoding(filePath, report.info.resolutionBits() - options.bitsToReduce, pool);
+    finishPlotting();
+    if (showTimings)
+        printOutputTimes(std::cout, false);
+    if (showProfile)
+        reportProfile(tracePath);
     return 0;
 }
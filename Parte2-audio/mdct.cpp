@@ -0,0 +1,405 @@
+#include "mdct.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "bitstream.h"
+
+namespace
+{
+const double pi = 3.14159265358979323846;
+
+// Stream header: magic, version, channels, noise tilt, sample rate, frames,
+// hop, MDCT frame count; then the byte size of every frame and the frames
+const std::uint8_t magic[4] = {'P', '2', 'T', 'C'};
+const std::uint8_t formatVersion = 1;
+const std::size_t headerBytes = 26;
+
+const std::size_t minHop = 16;
+const std::size_t maxHop = std::size_t(1) << 16;
+
+const unsigned int stepIndexBits = 7;
+const int maxStepIndex = 127;
+const unsigned int riceParameterBits = 5;
+const unsigned int zeroBand = 31; // Rice parameter field of a band with no non-zero values
+const unsigned int maxRiceParameter = 30;
+
+void putLittleEndian(std::vector<std::uint8_t> &out, std::uint64_t value, int bytes)
+{
+    for (int b = 0; b < bytes; ++b)
+        out.push_back(static_cast<std::uint8_t>(value >> (8 * b)));
+}
+
+std::uint64_t getLittleEndian(const std::uint8_t *data, int bytes)
+{
+    std::uint64_t value = 0;
+    for (int b = bytes - 1; b >= 0; --b)
+        value = (value << 8) | data[b];
+    return value;
+}
+
+// Band edges over the hop coefficients: narrow bands at low frequencies, the
+// width doubling every eight bands up to hop / 16
+std::vector<std::size_t> bandEdges(std::size_t hop)
+{
+    std::vector<std::size_t> edges = {0};
+    std::size_t width = std::max<std::size_t>(1, hop / 256);
+    std::size_t widest = std::max<std::size_t>(1, hop / 16);
+    for (int band = 0; edges.back() < hop; ++band)
+    {
+        if (band > 0 && band % 8 == 0)
+            width = std::min(width * 2, widest);
+        edges.push_back(std::min(hop, edges.back() + width));
+    }
+    return edges;
+}
+
+// Step index offset of every band: tilt quarter steps per octave above the first band
+std::vector<int> bandOffsets(const std::vector<std::size_t> &edges, int tilt)
+{
+    std::vector<int> offsets(edges.size() - 1);
+    double first = (edges[0] + edges[1]) / 2.0;
+    for (std::size_t b = 0; b < offsets.size(); ++b)
+        offsets[b] = static_cast<int>(std::lround(tilt * std::log2((edges[b] + edges[b + 1]) / 2.0 / first)));
+    return offsets;
+}
+
+double stepSize(int index)
+{
+    return std::exp2(std::clamp(index, 0, maxStepIndex) / 4.0);
+}
+
+// Everything the frame coder needs, shared by the encoder and decoder
+struct Layout
+{
+    std::size_t hop;
+    unsigned int channels;
+    std::vector<std::size_t> edges;
+    std::vector<int> offsets;
+};
+
+// Quantizes one band into zigzagged values; returns their sum
+std::uint64_t quantizeBand(const double *coefficients, std::size_t count, double step, std::uint32_t *values)
+{
+    std::uint64_t sum = 0;
+    double scale = 1.0 / step;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        double magnitude = std::floor(std::abs(coefficients[i]) * scale + 0.5);
+        std::int32_t q = static_cast<std::int32_t>(std::min(magnitude, 1048575.0));
+        values[i] = zigzagEncode(coefficients[i] < 0 ? -q : q);
+        sum += values[i];
+    }
+    return sum;
+}
+
+// Codes (or, without a writer, only measures) the coefficients of one frame
+// and channel at a global step index; returns the size in bits
+std::uint64_t codeFrame(const Layout &layout, const double *coefficients, int stepIndex, std::vector<std::uint32_t> &values, BitWriter *out)
+{
+    values.resize(layout.hop);
+    std::uint64_t bits = stepIndexBits;
+    if (out)
+        out->put(static_cast<std::uint32_t>(stepIndex), stepIndexBits);
+    for (std::size_t b = 0; b + 1 < layout.edges.size(); ++b)
+    {
+        std::size_t begin = layout.edges[b], count = layout.edges[b + 1] - begin;
+        std::uint64_t sum = quantizeBand(coefficients + begin, count, stepSize(stepIndex + layout.offsets[b]), values.data() + begin);
+        bits += riceParameterBits;
+        if (sum == 0)
+        {
+            if (out)
+                out->put(zeroBand, riceParameterBits);
+            continue;
+        }
+        unsigned int k = riceParameter(sum, count, maxRiceParameter);
+        bits += static_cast<std::uint64_t>(count) * (k + 1);
+        for (std::size_t i = begin; i < begin + count; ++i)
+            bits += values[i] >> k;
+        if (out)
+        {
+            out->put(k, riceParameterBits);
+            for (std::size_t i = begin; i < begin + count; ++i)
+                out->putRice(values[i], k);
+        }
+    }
+    return bits;
+}
+
+bool decodeFrame(const Layout &layout, BitReader &in, double *coefficients)
+{
+    int stepIndex = static_cast<int>(in.get(stepIndexBits));
+    for (std::size_t b = 0; b + 1 < layout.edges.size(); ++b)
+    {
+        std::size_t begin = layout.edges[b], end = layout.edges[b + 1];
+        unsigned int k = in.get(riceParameterBits);
+        if (k == zeroBand)
+        {
+            std::fill(coefficients + begin, coefficients + end, 0.0);
+            continue;
+        }
+        if (k > maxRiceParameter)
+            return false;
+        double step = stepSize(stepIndex + layout.offsets[b]);
+        for (std::size_t i = begin; i < end; ++i)
+            coefficients[i] = zigzagDecode(in.getRice(k)) * step;
+        if (in.overrun())
+            return false;
+    }
+    return true;
+}
+}
+
+Mdct::Workspace::Workspace(std::size_t hop)
+    : folded(hop), re(hop / 2), im(hop / 2), scratchRe(hop / 2), scratchIm(hop / 2)
+{
+}
+
+Mdct::Mdct(std::size_t hop) : m(hop), fft(hop / 2), window(2 * hop), preRe(hop / 2), preIm(hop / 2), postRe(hop / 2), postIm(hop / 2)
+{
+    for (std::size_t n = 0; n < 2 * m; ++n)
+        window[n] = std::sin(pi * (n + 0.5) / (2.0 * m));
+    for (std::size_t n = 0; n < m / 2; ++n)
+    {
+        preRe[n] = std::cos(pi * (4.0 * n + 1.0) / (4.0 * m));
+        preIm[n] = -std::sin(pi * (4.0 * n + 1.0) / (4.0 * m));
+        postRe[n] = std::cos(pi * n / m);
+        postIm[n] = -std::sin(pi * n / m);
+    }
+}
+
+// Unnormalized DCT-IV in place: pairs of inputs become one complex value,
+// rotated, transformed with the half-size FFT and rotated again
+void Mdct::dct4(double *data, Workspace &workspace) const
+{
+    std::size_t half = m / 2;
+    double *re = workspace.re.data(), *im = workspace.im.data();
+    for (std::size_t n = 0; n < half; ++n)
+    {
+        double a = data[2 * n], b = data[m - 1 - 2 * n];
+        re[n] = a * preRe[n] - b * preIm[n];
+        im[n] = a * preIm[n] + b * preRe[n];
+    }
+    fft.forward(re, im, workspace.scratchRe.data(), workspace.scratchIm.data());
+    for (std::size_t k = 0; k < half; ++k)
+    {
+        double yr = re[k] * postRe[k] - im[k] * postIm[k];
+        double yi = re[k] * postIm[k] + im[k] * postRe[k];
+        data[2 * k] = yr;
+        data[m - 1 - 2 * k] = -yi;
+    }
+}
+
+void Mdct::forward(const double *input, double *coefficients, Workspace &workspace) const
+{
+    // Fold the windowed quarters (a, b, c, d) into (-c_r - d, a - b_r)
+    std::size_t half = m / 2;
+    double *folded = workspace.folded.data();
+    for (std::size_t n = 0; n < half; ++n)
+    {
+        std::size_t c = 3 * half - 1 - n, d = 3 * half + n;
+        folded[n] = -window[c] * input[c] - window[d] * input[d];
+        folded[half + n] = window[n] * input[n] - window[m - 1 - n] * input[m - 1 - n];
+    }
+    dct4(folded, workspace);
+    double scale = std::sqrt(2.0 / m);
+    for (std::size_t k = 0; k < m; ++k)
+        coefficients[k] = folded[k] * scale;
+}
+
+void Mdct::inverse(const double *coefficients, double *output, Workspace &workspace) const
+{
+    std::size_t half = m / 2;
+    double *u = workspace.folded.data();
+    std::copy(coefficients, coefficients + m, u);
+    dct4(u, workspace);
+    double scale = std::sqrt(2.0 / m);
+
+    // Unfold (u1, u2) into (u2, -u2_r, -u1_r, -u1) and window
+    for (std::size_t n = 0; n < half; ++n)
+    {
+        output[n] = u[half + n] * scale;
+        output[m - 1 - n] = -u[half + n] * scale;
+        output[m + n] = -u[half - 1 - n] * scale;
+        output[3 * half + n] = -u[n] * scale;
+    }
+    for (std::size_t n = 0; n < 2 * m; ++n)
+        output[n] *= window[n];
+}
+
+std::vector<std::uint8_t> encodeTransform(const sf::Int16 *samples, std::uint64_t frames, unsigned int channels, unsigned int sampleRate,
+                                          ThreadPool &pool, const TransformCodecOptions &options)
+{
+    std::size_t hop = std::clamp<std::size_t>(options.hop & ~std::size_t(1), minHop, maxHop);
+    Layout layout{hop, channels, bandEdges(hop), {}};
+    layout.offsets = bandOffsets(layout.edges, options.noiseTilt);
+
+    // MDCT frame f covers samples [(f - 1) hop, (f + 1) hop), so the first and
+    // last hop of the signal are each covered by two frames
+    std::size_t frameCount = static_cast<std::size_t>((frames + hop - 1) / hop) + 1;
+    std::vector<double> coefficients(frameCount * channels * hop);
+    Mdct mdct(hop);
+    pool.parallelFor(0, frameCount, 4, [&](std::size_t first, std::size_t last) {
+        Mdct::Workspace workspace(hop);
+        std::vector<double> input(2 * hop);
+        for (std::size_t f = first; f < last; ++f)
+        {
+            for (unsigned int c = 0; c < channels; ++c)
+            {
+                for (std::size_t n = 0; n < 2 * hop; ++n)
+                {
+                    std::int64_t t = static_cast<std::int64_t>(f * hop + n) - static_cast<std::int64_t>(hop);
+                    input[n] = t >= 0 && static_cast<std::uint64_t>(t) < frames ? samples[t * channels + c] : 0.0;
+                }
+                mdct.forward(input.data(), &coefficients[(f * channels + c) * hop], workspace);
+            }
+        }
+    });
+
+    // Measures every frame at one global step index, in parallel
+    auto frameBits = [&](int stepIndex) {
+        std::vector<std::uint64_t> bits(frameCount);
+        pool.parallelFor(0, frameCount, 4, [&](std::size_t first, std::size_t last) {
+            std::vector<std::uint32_t> values;
+            for (std::size_t f = first; f < last; ++f)
+            {
+                bits[f] = 0;
+                for (unsigned int c = 0; c < channels; ++c)
+                    bits[f] += codeFrame(layout, &coefficients[(f * channels + c) * hop], stepIndex, values, nullptr);
+                bits[f] = (bits[f] + 7) / 8 * 8 + 32; // byte padding and the size table entry
+            }
+        });
+        std::uint64_t total = 0;
+        for (std::uint64_t b : bits)
+            total += b;
+        return total;
+    };
+
+    // Smallest global step that fits the budget: the size falls as the step grows
+    std::uint64_t budget = static_cast<std::uint64_t>(options.bitsPerSample * frames * channels);
+    budget = budget > headerBytes * 8 ? budget - headerBytes * 8 : 0;
+    int lo = 0, hi = maxStepIndex;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (frameBits(mid) <= budget)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    int stepIndex = lo;
+
+    std::vector<std::vector<std::uint8_t>> payloads(frameCount);
+    pool.parallelFor(0, frameCount, 4, [&](std::size_t first, std::size_t last) {
+        std::vector<std::uint32_t> values;
+        for (std::size_t f = first; f < last; ++f)
+        {
+            BitWriter out(payloads[f]);
+            for (unsigned int c = 0; c < channels; ++c)
+                codeFrame(layout, &coefficients[(f * channels + c) * hop], stepIndex, values, &out);
+            out.flush();
+        }
+    });
+
+    std::size_t total = headerBytes + 4 * frameCount;
+    for (const auto &payload : payloads)
+        total += payload.size();
+    std::vector<std::uint8_t> stream(magic, magic + 4);
+    stream.reserve(total);
+    stream.push_back(formatVersion);
+    stream.push_back(static_cast<std::uint8_t>(channels));
+    stream.push_back(static_cast<std::uint8_t>(static_cast<std::int8_t>(options.noiseTilt)));
+    putLittleEndian(stream, sampleRate, 4);
+    putLittleEndian(stream, frames, 8);
+    putLittleEndian(stream, hop, 3);
+    putLittleEndian(stream, frameCount, 4);
+    for (const auto &payload : payloads)
+        putLittleEndian(stream, payload.size(), 4);
+    for (const auto &payload : payloads)
+        stream.insert(stream.end(), payload.begin(), payload.end());
+    return stream;
+}
+
+bool decodeTransform(const std::uint8_t *data, std::size_t size, std::vector<sf::Int16> &samples, unsigned int &channels, ThreadPool &pool)
+{
+    if (size < headerBytes || std::memcmp(data, magic, 4) != 0 || data[4] != formatVersion)
+        return false;
+    channels = data[5];
+    int tilt = static_cast<std::int8_t>(data[6]);
+    std::uint64_t frames = getLittleEndian(data + 11, 8);
+    std::size_t hop = static_cast<std::size_t>(getLittleEndian(data + 19, 3));
+    std::size_t frameCount = static_cast<std::size_t>(getLittleEndian(data + 22, 4));
+    if (channels == 0 || hop < minHop || hop > maxHop || hop % 2 != 0)
+        return false;
+    Layout layout{hop, channels, bandEdges(hop), {}};
+    layout.offsets = bandOffsets(layout.edges, tilt);
+
+    // Every channel of a frame needs at least its step index and one Rice
+    // parameter per band, so the frame count, and with it the inverse
+    // transform buffer and frames * channels, are bounded by the size of the
+    // stream before anything is allocated. frames must need exactly
+    // frameCount - 1 hops; this is checked without rounding frames up, which
+    // could wrap.
+    const std::size_t minFrameBytes = (channels * (stepIndexBits + (layout.edges.size() - 1) * riceParameterBits) + 7) / 8;
+    if (frameCount == 0 || (size - headerBytes) / (4 + minFrameBytes) < frameCount || frames > (frameCount - 1) * hop ||
+        (frameCount > 1 && frames <= (frameCount - 2) * hop))
+        return false;
+
+    std::vector<std::size_t> offsets(frameCount + 1);
+    offsets[0] = headerBytes + 4 * frameCount;
+    for (std::size_t f = 0; f < frameCount; ++f)
+    {
+        std::size_t payload = static_cast<std::size_t>(getLittleEndian(data + headerBytes + 4 * f, 4));
+        if (payload < minFrameBytes)
+            return false;
+        offsets[f + 1] = offsets[f] + payload;
+    }
+    if (offsets[frameCount] > size)
+        return false;
+
+    // Windowed inverse transform of every frame, then the overlap-add
+    std::vector<double> frameOutput(frameCount * channels * 2 * hop);
+    Mdct mdct(hop);
+    std::atomic<bool> failed{false};
+    pool.parallelFor(0, frameCount, 4, [&](std::size_t first, std::size_t last) {
+        Mdct::Workspace workspace(hop);
+        std::vector<double> coefficients(hop);
+        for (std::size_t f = first; f < last && !failed; ++f)
+        {
+            BitReader in(data + offsets[f], offsets[f + 1] - offsets[f]);
+            for (unsigned int c = 0; c < channels; ++c)
+            {
+                if (!decodeFrame(layout, in, coefficients.data()))
+                {
+                    failed = true;
+                    break;
+                }
+                mdct.inverse(coefficients.data(), &frameOutput[(f * channels + c) * 2 * hop], workspace);
+            }
+        }
+    });
+    if (failed)
+        return false;
+
+    samples.resize(frames * channels);
+    std::size_t blocks = frameCount - 1;
+    pool.parallelFor(0, blocks, 16, [&](std::size_t first, std::size_t last) {
+        for (std::size_t j = first; j < last; ++j)
+        {
+            std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(hop, frames - j * hop));
+            for (unsigned int c = 0; c < channels; ++c)
+            {
+                const double *tail = &frameOutput[(j * channels + c) * 2 * hop + hop];
+                const double *head = &frameOutput[((j + 1) * channels + c) * 2 * hop];
+                for (std::size_t n = 0; n < count; ++n)
+                {
+                    double value = std::round(tail[n] + head[n]);
+                    samples[(j * hop + n) * channels + c] = static_cast<sf::Int16>(std::clamp(value, -32768.0, 32767.0));
+                }
+            }
+        }
+    });
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef MDCT_H
+#define MDCT_H
+
+#include <SFML/Config.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fft.h"
+#include "thread_pool.h"
+
+// Orthonormal MDCT with a sine window: hop() coefficients from 2 * hop()
+// samples, frames advancing by hop(). Windowed inverse transforms of
+// neighbouring frames overlap-add back to the input (time-domain aliasing
+// cancellation). Both directions fold the frame into a DCT-IV, computed with
+// a hop() / 2 point complex FFT.
+class Mdct
+{
+public:
+    class Workspace
+    {
+    public:
+        explicit Workspace(std::size_t hop);
+
+    private:
+        friend class Mdct;
+        std::vector<double> folded, re, im, scratchRe, scratchIm;
+    };
+
+    // hop must be even
+    explicit Mdct(std::size_t hop);
+
+    std::size_t hop() const { return m; }
+
+    // 2 * hop() input samples (windowed here) to hop() coefficients
+    void forward(const double *input, double *coefficients, Workspace &workspace) const;
+    // hop() coefficients to 2 * hop() windowed samples, to be overlap-added
+    void inverse(const double *coefficients, double *output, Workspace &workspace) const;
+
+private:
+    void dct4(double *data, Workspace &workspace) const;
+
+    std::size_t m;
+    MixedRadixFFT fft;
+    std::vector<double> window;
+    std::vector<double> preRe, preIm, postRe, postIm;
+};
+
+// Lossy transform coder: MDCT frames, quantized band by band and Rice coded.
+// Every band of a frame has its own step, 2^(index / 4) with the index taken
+// from a global step plus a per-band offset set by noiseTilt. A flat tilt
+// (the default) spreads the noise evenly, which gives the best SNR for the
+// rate. The global step is searched for the smallest one whose stream fits in
+// bitsPerSample. Frames are coded and decoded in parallel.
+struct TransformCodecOptions
+{
+    std::size_t hop = 1024; // rounded down to even and clamped to [16, 65536]
+    double bitsPerSample = 6.0;
+    int noiseTilt = 0; // step index change per octave above the first band, in quarter steps
+};
+
+std::vector<std::uint8_t> encodeTransform(const sf::Int16 *samples, std::uint64_t frames, unsigned int channels, unsigned int sampleRate,
+                                          ThreadPool &pool, const TransformCodecOptions &options = TransformCodecOptions());
+
+// Decodes to interleaved samples; false if the stream is malformed
+bool decodeTransform(const std::uint8_t *data, std::size_t size, std::vector<sf::Int16> &samples, unsigned int &channels, ThreadPool &pool);
+
+#endif
@@ -0,0 +1,150 @@
+#include "pcm_stream.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace
+{
+std::uint32_t littleEndian32(const std::uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<std::uint32_t>(data[3]) << 24);
+}
+
+std::uint16_t littleEndian16(const std::uint8_t *data)
+{
+    return static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+}
+
+// KSDATAFORMAT_SUBTYPE_PCM after its leading format tag
+const std::uint8_t pcmGuidTail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+// WAVE_FORMAT_EXTENSIBLE takes 40 bytes; anything much longer is not a format chunk
+const std::uint32_t maxFormatBytes = 64;
+}
+
+PcmStreamReader::PcmStreamReader(std::FILE *file) : file(file)
+{
+#ifdef _WIN32
+    // stdin is opened in text mode on Windows
+    _setmode(_fileno(file), _O_BINARY);
+#endif
+}
+
+bool PcmStreamReader::readBytes(void *data, std::size_t size)
+{
+    return std::fread(data, 1, size, file) == size;
+}
+
+bool PcmStreamReader::skipBytes(std::uint64_t size)
+{
+    std::uint8_t scratch[4096];
+    while (size > 0)
+    {
+        std::size_t part = static_cast<std::size_t>(std::min<std::uint64_t>(size, sizeof(scratch)));
+        if (!readBytes(scratch, part))
+            return false;
+        size -= part;
+    }
+    return true;
+}
+
+bool PcmStreamReader::openWav(std::string &error)
+{
+    std::uint8_t riff[12];
+    if (!readBytes(riff, sizeof(riff)) || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0)
+    {
+        error = "Input is not a WAV stream";
+        return false;
+    }
+
+    bool haveFormat = false;
+    for (;;)
+    {
+        std::uint8_t chunk[8];
+        if (!readBytes(chunk, sizeof(chunk)))
+        {
+            error = "WAV stream ends before the data chunk";
+            return false;
+        }
+        std::uint32_t size = littleEndian32(chunk + 4);
+
+        if (std::memcmp(chunk, "data", 4) == 0)
+        {
+            if (!haveFormat)
+            {
+                error = "WAV stream has no format chunk before its data";
+                return false;
+            }
+            if (size != 0 && size != 0xFFFFFFFFu)
+                remaining = size;
+            return true;
+        }
+
+        // Chunks are padded to an even size
+        std::uint64_t padded = std::uint64_t(size) + (size & 1);
+        if (std::memcmp(chunk, "fmt ", 4) != 0)
+        {
+            if (!skipBytes(padded))
+            {
+                error = "WAV stream ends inside a chunk";
+                return false;
+            }
+            continue;
+        }
+
+        if (size < 16 || size > maxFormatBytes)
+        {
+            error = "Malformed WAV format chunk";
+            return false;
+        }
+        std::uint8_t format[maxFormatBytes];
+        if (!readBytes(format, size) || !skipBytes(padded - size))
+        {
+            error = "WAV stream ends inside a chunk";
+            return false;
+        }
+        std::uint16_t formatTag = littleEndian16(format);
+        channels = littleEndian16(format + 2);
+        rate = littleEndian32(format + 4);
+        std::uint16_t bits = littleEndian16(format + 14);
+        if (formatTag == 0xFFFE)
+        {
+            // WAVE_FORMAT_EXTENSIBLE: the real format is the sub-format GUID
+            if (size < 40 || littleEndian16(format + 16) < 22 || std::memcmp(format + 26, pcmGuidTail, sizeof(pcmGuidTail)) != 0)
+            {
+                error = "Only 16-bit PCM WAV streams are supported";
+                return false;
+            }
+            formatTag = littleEndian16(format + 24);
+        }
+        if (formatTag != 1 || bits != 16 || channels == 0)
+        {
+            error = "Only 16-bit PCM WAV streams are supported";
+            return false;
+        }
+        haveFormat = true;
+    }
+}
+
+void PcmStreamReader::openRaw(unsigned int channelCount, unsigned int sampleRate)
+{
+    channels = std::max(1u, channelCount);
+    rate = sampleRate;
+}
+
+std::size_t PcmStreamReader::read(sf::Int16 *samples, std::size_t frames)
+{
+    std::size_t frameBytes = channels * sizeof(sf::Int16);
+    std::size_t bytes = static_cast<std::size_t>(std::min<std::uint64_t>(frames * frameBytes, remaining / frameBytes * frameBytes));
+    std::size_t got = std::fread(samples, 1, bytes, file);
+    std::size_t whole = got / frameBytes;
+    if (remaining != ~std::uint64_t(0))
+        remaining -= got;
+    // A partial frame can only come at the end of the stream; it is dropped
+    return whole;
+}
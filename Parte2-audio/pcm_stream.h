@@ -0,0 +1,42 @@
+#ifndef PCM_STREAM_H
+#define PCM_STREAM_H
+
+#include <SFML/Config.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// 16-bit PCM frames from a stdio stream such as stdin or a pipe: either a WAV
+// stream, whose header is parsed without seeking, or headerless little-endian
+// samples in a format given by the caller. Reads block until a whole request
+// is available or the stream ends.
+class PcmStreamReader
+{
+public:
+    explicit PcmStreamReader(std::FILE *file);
+
+    // Parses the RIFF header up to the start of the data chunk. Only 16-bit
+    // PCM is accepted; a data size of 0 or 0xFFFFFFFF (unknown, as written by
+    // streaming encoders) reads until the end of the stream.
+    bool openWav(std::string &error);
+    void openRaw(unsigned int channels, unsigned int sampleRate);
+
+    unsigned int channelCount() const { return channels; }
+    unsigned int sampleRate() const { return rate; }
+
+    // Reads up to `frames` interleaved frames; returns the number read, 0 at the end
+    std::size_t read(sf::Int16 *samples, std::size_t frames);
+
+private:
+    bool readBytes(void *data, std::size_t size);
+    // Reads through `size` bytes, since the stream cannot seek
+    bool skipBytes(std::uint64_t size);
+
+    std::FILE *file;
+    unsigned int channels = 0;
+    unsigned int rate = 0;
+    std::uint64_t remaining = ~std::uint64_t(0); // bytes left in the data chunk
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "plot_output.h"
+
+#include <iomanip>
+#include <mutex>
+
+namespace
+{
+std::mutex timesMutex;
+std::vector<OutputTime> times;
+}
+
+CsvWriter::CsvWriter(const std::string &filename, std::size_t buffer_size)
+    : file(filename, std::ios::binary), buffer(std::max<std::size_t>(64, buffer_size))
+{
+}
+
+CsvWriter::~CsvWriter()
+{
+    close();
+}
+
+void CsvWriter::flush()
+{
+    if (used == 0)
+        return;
+    if (file.is_open())
+        file.write(buffer.data(), static_cast<std::streamsize>(used));
+    written += used;
+    used = 0;
+}
+
+std::uint64_t CsvWriter::close()
+{
+    flush();
+    if (file.is_open())
+        file.close();
+    return written;
+}
+
+OutputTimer::~OutputTimer()
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(timesMutex);
+    times.push_back({name, seconds, bytes});
+}
+
+std::vector<OutputTime> outputTimes()
+{
+    std::lock_guard<std::mutex> lock(timesMutex);
+    return times;
+}
+
+void printOutputTimes(std::ostream &out, bool summary)
+{
+    std::vector<OutputTime> all = outputTimes();
+    double total = 0.0;
+    std::uint64_t bytes = 0;
+    for (const OutputTime &time : all)
+    {
+        total += time.seconds;
+        bytes += time.bytes;
+    }
+
+    out << "Output write times:" << std::endl;
+    if (!summary)
+    {
+        for (const OutputTime &time : all)
+        {
+            out << "  " << std::fixed << std::setprecision(2) << std::setw(9) << time.seconds * 1000.0 << " ms";
+            if (time.bytes > 0)
+                out << std::setw(10) << std::setprecision(2) << time.bytes / 1e6 << " MB";
+            else
+                out << std::setw(13) << "";
+            out << "  " << time.name << std::endl;
+        }
+    }
+    out << "  " << std::fixed << std::setprecision(2) << std::setw(9) << total * 1000.0 << " ms" << std::setw(10) << bytes / 1e6
+        << " MB  total over " << all.size() << " outputs" << std::endl;
+    out << std::defaultfloat;
+}
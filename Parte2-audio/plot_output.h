@@ -0,0 +1,119 @@
+#ifndef PLOT_OUTPUT_H
+#define PLOT_OUTPUT_H
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// CSV writer for the plot fallbacks. Numbers are formatted with std::to_chars
+// straight into a large buffer, which is written out in one call whenever it
+// fills up. Floating-point values use 10 significant digits, the same text as
+// an ostream with setprecision(10).
+class CsvWriter
+{
+public:
+    explicit CsvWriter(const std::string &filename, std::size_t buffer_size = 1 << 20);
+    ~CsvWriter();
+    CsvWriter(const CsvWriter &) = delete;
+    CsvWriter &operator=(const CsvWriter &) = delete;
+
+    bool isOpen() const { return file.is_open(); }
+
+    CsvWriter &text(std::string_view value)
+    {
+        reserve(value.size());
+        std::copy(value.begin(), value.end(), buffer.begin() + static_cast<std::ptrdiff_t>(used));
+        used += value.size();
+        return *this;
+    }
+
+    template <typename T>
+    CsvWriter &number(T value)
+    {
+        reserve(32);
+        char *first = &buffer[used];
+        std::to_chars_result result;
+        if constexpr (std::is_floating_point_v<T>)
+            result = std::to_chars(first, first + 32, static_cast<double>(value), std::chars_format::general, 10);
+        else
+            result = std::to_chars(first, first + 32, value);
+        used += static_cast<std::size_t>(result.ptr - first);
+        return *this;
+    }
+
+    // One line of comma-separated numbers
+    template <typename... Values>
+    void row(const Values &...values)
+    {
+        bool first = true;
+        auto field = [&](const auto &value) {
+            if (!first)
+                text(",");
+            first = false;
+            number(value);
+        };
+        (field(values), ...);
+        text("\n");
+    }
+
+    // Flushes and closes the file; returns the number of bytes written
+    std::uint64_t close();
+
+private:
+    void reserve(std::size_t bytes)
+    {
+        if (used + bytes > buffer.size())
+            flush();
+        if (bytes > buffer.size())
+            buffer.resize(bytes);
+    }
+    void flush();
+
+    std::ofstream file;
+    std::vector<char> buffer;
+    std::size_t used = 0;
+    std::uint64_t written = 0;
+};
+
+// Time taken to write one output of this run: the whole write for a CSV, the
+// time to hand the script and data to the gnuplot session for a PNG
+struct OutputTime
+{
+    std::string name;
+    double seconds;
+    std::uint64_t bytes; // 0 when unknown (gnuplot output)
+};
+
+// Times the enclosing scope and records it under `name` when it ends; declare it
+// before the writer so the writer's own cleanup is included
+class OutputTimer
+{
+public:
+    explicit OutputTimer(std::string name) : name(std::move(name)), start(std::chrono::steady_clock::now()) {}
+    ~OutputTimer();
+    OutputTimer(const OutputTimer &) = delete;
+    OutputTimer &operator=(const OutputTimer &) = delete;
+
+    void setBytes(std::uint64_t count) { bytes = count; }
+
+private:
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+    std::uint64_t bytes = 0;
+};
+
+// Every output recorded so far (thread-safe)
+std::vector<OutputTime> outputTimes();
+
+// One line per output, or a single total line when summary is set
+void printOutputTimes(std::ostream &out, bool summary);
+
+#endif
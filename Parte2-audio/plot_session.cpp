@@ -0,0 +1,122 @@
+#include "plot_session.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "chart.h"
+
+namespace
+{
+unsigned int plotProcesses = 1;
+#ifdef USE_PLOTTING
+PlotBackend backend = PlotBackend::Gnuplot;
+#else
+PlotBackend backend = PlotBackend::Csv;
+#endif
+
+#ifdef USE_PLOTTING
+struct PlotProcess
+{
+    std::mutex mutex;
+    std::unique_ptr<Gnuplot> gp; // started on first use
+};
+
+std::mutex sessionMutex;
+std::vector<std::unique_ptr<PlotProcess>> processes;
+std::atomic<std::size_t> nextProcess{0};
+
+// The process pool, created on first use with the configured size
+std::vector<std::unique_ptr<PlotProcess>> &pool()
+{
+    std::lock_guard<std::mutex> lock(sessionMutex);
+    if (processes.empty())
+    {
+        for (unsigned int i = 0; i < plotProcesses; ++i)
+            processes.push_back(std::make_unique<PlotProcess>());
+    }
+    return processes;
+}
+#endif
+}
+
+bool parsePlotBackend(const std::string &name, PlotBackend &result)
+{
+    if (name == "csv")
+        result = PlotBackend::Csv;
+#ifdef USE_PLOTTING
+    else if (name == "gnuplot")
+        result = PlotBackend::Gnuplot;
+#endif
+    else if (name == "native")
+        result = PlotBackend::Native;
+    else
+        return false;
+    return true;
+}
+
+void setPlotBackend(PlotBackend value)
+{
+    backend = value;
+}
+
+PlotBackend plotBackend()
+{
+    return backend;
+}
+
+void configurePlotting(unsigned int processes)
+{
+    plotProcesses = std::max(1u, processes);
+}
+
+#ifdef USE_PLOTTING
+void submitPlot(const std::function<void(Gnuplot &)> &script)
+{
+    std::vector<std::unique_ptr<PlotProcess>> &all = pool();
+
+    // Prefer an idle process; otherwise queue behind the next one in turn
+    std::size_t start = nextProcess.fetch_add(1, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock;
+    PlotProcess *process = nullptr;
+    for (std::size_t k = 0; k < all.size() && !process; ++k)
+    {
+        PlotProcess *candidate = all[(start + k) % all.size()].get();
+        std::unique_lock<std::mutex> attempt(candidate->mutex, std::try_to_lock);
+        if (attempt.owns_lock())
+        {
+            lock = std::move(attempt);
+            process = candidate;
+        }
+    }
+    if (!process)
+    {
+        process = all[start % all.size()].get();
+        lock = std::unique_lock<std::mutex>(process->mutex);
+    }
+
+    if (!process->gp)
+        process->gp = std::make_unique<Gnuplot>();
+    Gnuplot &gp = *process->gp;
+    gp << "reset\n";
+    script(gp);
+    // Closing the output makes gnuplot write the PNG now rather than at the next plot
+    gp << "unset output\n";
+    gp.flush();
+}
+
+void finishPlotting()
+{
+    waitForCharts();
+    std::lock_guard<std::mutex> lock(sessionMutex);
+    // Destroying a Gnuplot closes its pipe and waits for the process to exit
+    processes.clear();
+}
+#else
+void finishPlotting()
+{
+    waitForCharts();
+}
+#endif
@@ -0,0 +1,43 @@
+#ifndef PLOT_SESSION_H
+#define PLOT_SESSION_H
+
+#include <functional>
+#include <string>
+
+#ifdef USE_PLOTTING
+#include "gnuplot-iostream.h"
+#endif
+
+// Where plots go: CSV tables, PNGs rendered by gnuplot, or PNGs rendered in
+// process by Chart. The default is gnuplot when plotting is built in, else CSV.
+enum class PlotBackend
+{
+    Csv,
+    Gnuplot,
+    Native
+};
+
+// Parses "csv", "gnuplot" or "native"; gnuplot only in builds with plotting
+bool parsePlotBackend(const std::string &name, PlotBackend &backend);
+
+void setPlotBackend(PlotBackend backend);
+PlotBackend plotBackend();
+
+// Number of gnuplot processes kept alive for the run (default 1). Plots are
+// spread over them, so with several processes PNGs render in parallel.
+// Builds without plotting ignore this.
+void configurePlotting(unsigned int processes);
+
+// Waits for every queued plot to be rendered and closes the processes; the
+// next plot starts them again. Native charts still being encoded are waited for too.
+void finishPlotting();
+
+#ifdef USE_PLOTTING
+// Runs script(gp) on one of the shared gnuplot processes. The session resets
+// gnuplot's settings before the script and closes the output file after it,
+// so every plot starts from a clean state. Thread-safe: each process takes one
+// script at a time, and a caller picks an idle process when there is one.
+void submitPlot(const std::function<void(Gnuplot &)> &script);
+#endif
+
+#endif
@@ -0,0 +1,179 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace detail
+{
+std::atomic<bool> profilingOn{false};
+}
+
+namespace
+{
+struct StageEvent
+{
+    const char *stage;
+    std::string context;
+    double start; // microseconds since profiling was enabled
+    double duration;
+};
+
+// One per thread that recorded anything; shared with the registry so the
+// events outlive pool threads that finish before the results are read
+struct ThreadEvents
+{
+    unsigned int index;
+    bool main;
+    std::mutex mutex; // only contended while the results are read
+    std::vector<StageEvent> events;
+};
+
+std::mutex registryMutex;
+std::vector<std::shared_ptr<ThreadEvents>> registry;
+std::chrono::steady_clock::time_point epoch;
+std::thread::id mainThread;
+
+ThreadEvents &threadEvents()
+{
+    thread_local std::shared_ptr<ThreadEvents> events;
+    if (!events)
+    {
+        events = std::make_shared<ThreadEvents>();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        events->index = static_cast<unsigned int>(registry.size());
+        events->main = std::this_thread::get_id() == mainThread;
+        registry.push_back(events);
+    }
+    return *events;
+}
+
+// Trace name of every recording thread, by index
+std::vector<std::string> threadNames()
+{
+    std::vector<std::string> names;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto &thread : registry)
+        names.push_back(thread->main ? "main" : "worker " + std::to_string(thread->index));
+    return names;
+}
+
+// Copy of every event, with the index of the thread that recorded it
+std::vector<std::pair<unsigned int, StageEvent>> allEvents()
+{
+    std::vector<std::pair<unsigned int, StageEvent>> all;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto &thread : registry)
+    {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        for (const StageEvent &event : thread->events)
+            all.emplace_back(thread->index, event);
+    }
+    return all;
+}
+
+void writeJsonString(std::ostream &out, const std::string &text)
+{
+    out << '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+        else
+            out << c;
+    }
+    out << '"';
+}
+}
+
+void detail::recordStage(const char *stage, const std::string *context, std::chrono::steady_clock::time_point start,
+                         std::chrono::steady_clock::time_point end)
+{
+    ThreadEvents &thread = threadEvents();
+    StageEvent event{stage, context ? *context : std::string(), std::chrono::duration<double, std::micro>(start - epoch).count(),
+                     std::chrono::duration<double, std::micro>(end - start).count()};
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.events.push_back(std::move(event));
+}
+
+void enableProfiling()
+{
+    if (!detail::profilingOn.load())
+    {
+        epoch = std::chrono::steady_clock::now();
+        mainThread = std::this_thread::get_id();
+        detail::profilingOn.store(true);
+    }
+}
+
+void printStageSummary(std::ostream &out)
+{
+    struct Totals
+    {
+        std::uint64_t calls = 0;
+        double total = 0.0;
+        double longest = 0.0;
+    };
+    std::map<std::string, Totals> stages;
+    for (const auto &[thread, event] : allEvents())
+    {
+        Totals &totals = stages[event.stage];
+        totals.calls++;
+        totals.total += event.duration;
+        totals.longest = std::max(totals.longest, event.duration);
+    }
+    std::vector<std::pair<std::string, Totals>> sorted(stages.begin(), stages.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second.total > b.second.total; });
+
+    out << "Stage times (summed over threads; nested stages are also part of their parent):" << std::endl;
+    out << std::left << std::setw(14) << "  Stage" << std::right << std::setw(10) << "Calls" << std::setw(14) << "Total (ms)"
+        << std::setw(14) << "Mean (us)" << std::setw(14) << "Max (us)" << std::endl;
+    for (const auto &[stage, totals] : sorted)
+    {
+        out << "  " << std::left << std::setw(12) << stage << std::right << std::setw(10) << totals.calls << std::fixed
+            << std::setprecision(2) << std::setw(14) << totals.total / 1000.0 << std::setw(14) << totals.total / totals.calls
+            << std::setw(14) << totals.longest << std::defaultfloat << std::endl;
+    }
+}
+
+bool writeChromeTrace(const std::string &path)
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+    std::vector<std::pair<unsigned int, StageEvent>> events = allEvents();
+    std::vector<std::string> names = threadNames();
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << std::fixed << std::setprecision(3);
+    bool first = true;
+    for (std::size_t t = 0; t < names.size(); ++t)
+    {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\""
+            << names[t] << "\"}}";
+        first = false;
+    }
+    for (const auto &[thread, event] : events)
+    {
+        out << (first ? "" : ",\n") << "{\"name\":\"" << event.stage << "\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+            << ",\"ts\":" << event.start << ",\"dur\":" << event.duration;
+        if (!event.context.empty())
+        {
+            out << ",\"args\":{\"file\":";
+            writeJsonString(out, event.context);
+            out << "}";
+        }
+        out << "}";
+        first = false;
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,62 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+// Stage profiling of the analysis pipeline. StageTimer times its scope and
+// records one event under a stage name ("load", "quantize", ...) plus an
+// optional context such as the file name. Events go to per-thread buffers, so
+// recording only takes an uncontended per-thread lock; with profiling off a
+// timer costs one relaxed load.
+// At the end of a run the events are summed per stage into a table and can be
+// written as a Chrome / Perfetto trace (chrome://tracing, ui.perfetto.dev).
+
+namespace detail
+{
+extern std::atomic<bool> profilingOn;
+void recordStage(const char *stage, const std::string *context, std::chrono::steady_clock::time_point start,
+                 std::chrono::steady_clock::time_point end);
+}
+
+void enableProfiling();
+inline bool profilingEnabled() { return detail::profilingOn.load(std::memory_order_relaxed); }
+
+class StageTimer
+{
+public:
+    // stage must outlive the run (a string literal); context (the file name,
+    // say) is copied only when the event is recorded
+    explicit StageTimer(const char *stage, const std::string *context = nullptr)
+        : stage(profilingEnabled() ? stage : nullptr), context(context)
+    {
+        if (this->stage)
+            start = std::chrono::steady_clock::now();
+    }
+    ~StageTimer() { stop(); }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    // Records the event now instead of at the end of the scope
+    void stop()
+    {
+        if (stage)
+            detail::recordStage(stage, context, start, std::chrono::steady_clock::now());
+        stage = nullptr;
+    }
+
+private:
+    const char *stage;
+    const std::string *context;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Calls, total, mean and longest time of every stage, slowest total first
+void printStageSummary(std::ostream &out);
+
+// Every event as a complete ("X") event of the Chrome trace event format
+bool writeChromeTrace(const std::string &path);
+
+#endif
@@ -0,0 +1,406 @@
+#include "quantize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include "channels.h"
+
+namespace
+{
+const double muLawMu = 255.0;
+const double aLawA = 87.6;
+
+// Samples per chunk of the pooled version
+const std::size_t quantizeGrain = std::size_t(1) << 16;
+
+// Counter-based hash (lowbias32) the dither is drawn from, keyed by the low 32
+// bits of the sample index. int16 takes one hash per sample, so its dither
+// repeats after 2^32 samples (about 13.5 hours of 44.1 kHz stereo); int32 and
+// float take two, and repeat after 2^31 (about 6.8 hours).
+inline std::uint32_t ditherHash(std::uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Triangular dither in (-2^b, 2^b), as the difference of two uniform values
+// in [0, 2^b), for 0 < b <= 32. int16 (b < 16) takes both from the two halves
+// of one hash, int32 one hash each.
+template <typename T>
+inline std::int64_t ditherOffset(std::uint64_t index, int b)
+{
+    if constexpr (std::is_same_v<T, sf::Int16>)
+    {
+        std::uint32_t h = ditherHash(static_cast<std::uint32_t>(index));
+        return static_cast<std::int64_t>((h & 0xFFFFu) >> (16 - b)) - static_cast<std::int64_t>(h >> (32 - b));
+    }
+    else
+    {
+        std::uint32_t first = ditherHash(static_cast<std::uint32_t>(2 * index));
+        std::uint32_t second = ditherHash(static_cast<std::uint32_t>(2 * index + 1));
+        return static_cast<std::int64_t>(first >> (32 - b)) - static_cast<std::int64_t>(second >> (32 - b));
+    }
+}
+
+// Triangular dither in (-1, 1) for float samples, in units of the step
+inline float ditherFraction(std::uint64_t index)
+{
+    std::uint32_t first = ditherHash(static_cast<std::uint32_t>(2 * index));
+    std::uint32_t second = ditherHash(static_cast<std::uint32_t>(2 * index + 1));
+    return static_cast<float>((static_cast<double>(first) - static_cast<double>(second)) * (1.0 / 4294967296.0));
+}
+
+// Step of 2^b on an integer sample type, worked in 64 bits so that no kind
+// overflows before it is clamped back to the range of T
+template <typename T>
+struct IntegerGrid
+{
+    explicit IntegerGrid(int b)
+        : bits(b), half(b ? std::int64_t(1) << (b - 1) : 0), mask(~((std::int64_t(1) << b) - 1)),
+          lowest(std::numeric_limits<T>::min()), highest(std::numeric_limits<T>::max() & mask)
+    {
+    }
+
+    int bits;
+    std::int64_t half;
+    std::int64_t mask;
+    std::int64_t lowest;
+    std::int64_t highest; // the largest multiple of the step
+};
+
+template <QuantizerKind K, typename T>
+inline T quantizeInteger(T sample, const IntegerGrid<T> &grid, std::uint64_t index)
+{
+    std::int64_t value = sample;
+    if constexpr (K == QuantizerKind::Truncate)
+        value &= grid.mask;
+    else if constexpr (K == QuantizerKind::MidRise)
+        value = std::min<std::int64_t>((value & grid.mask) + grid.half, std::numeric_limits<T>::max());
+    else
+    {
+        if constexpr (K == QuantizerKind::Tpdf)
+            value += ditherOffset<T>(index, grid.bits);
+        value = std::clamp((value + grid.half) & grid.mask, grid.lowest, grid.highest);
+    }
+    return static_cast<T>(value);
+}
+
+template <QuantizerKind K>
+inline float quantizeFloat(float sample, float step, float inverse, std::uint64_t index)
+{
+    float scaled = sample * inverse;
+    if constexpr (K == QuantizerKind::Truncate)
+        return std::floor(scaled) * step;
+    else if constexpr (K == QuantizerKind::MidRise)
+        return (std::floor(scaled) + 0.5f) * step;
+    else
+    {
+        if constexpr (K == QuantizerKind::Tpdf)
+            scaled += ditherFraction(index);
+        return std::floor(scaled + 0.5f) * step;
+    }
+}
+
+#ifdef CHANNELS_USE_SSE2
+// Low 32 bits of the lane products; SSE2 only multiplies the even lanes, into 64 bits
+inline __m128i multiplyLow32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+inline __m128i ditherHash(__m128i x)
+{
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = multiplyLow32(x, _mm_set1_epi32(0x7feb352d));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = multiplyLow32(x, _mm_set1_epi32(static_cast<int>(0x846ca68bu)));
+    return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+}
+
+// Eight samples per iteration, for 0 < b < 16; returns how many were done.
+// Saturating adds stand in for the clamps of quantizeInteger: a sum past
+// either end of the range lands on the same level either way.
+template <QuantizerKind K>
+std::size_t quantizeInt16Sse2(const sf::Int16 *in, sf::Int16 *out, std::size_t count, int b, std::uint64_t index)
+{
+    const __m128i mask = _mm_set1_epi16(static_cast<short>(~((1 << b) - 1)));
+    const __m128i half = _mm_set1_epi16(static_cast<short>(1 << (b - 1)));
+    const __m128i lowHalf = _mm_set1_epi32(0xFFFF);
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i four = _mm_set1_epi32(4);
+    const __m128i firstShift = _mm_cvtsi32_si128(16 - b);
+    const __m128i secondShift = _mm_cvtsi32_si128(32 - b);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        if constexpr (K == QuantizerKind::Truncate)
+            x = _mm_and_si128(x, mask);
+        else if constexpr (K == QuantizerKind::MidRise)
+            x = _mm_or_si128(_mm_and_si128(x, mask), half);
+        else
+        {
+            if constexpr (K == QuantizerKind::Tpdf)
+            {
+                __m128i key = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(index + i))), lanes);
+                __m128i low = ditherHash(key);
+                __m128i high = ditherHash(_mm_add_epi32(key, four));
+                low = _mm_sub_epi32(_mm_srl_epi32(_mm_and_si128(low, lowHalf), firstShift), _mm_srl_epi32(low, secondShift));
+                high = _mm_sub_epi32(_mm_srl_epi32(_mm_and_si128(high, lowHalf), firstShift), _mm_srl_epi32(high, secondShift));
+                x = _mm_adds_epi16(x, _mm_packs_epi32(low, high));
+            }
+            x = _mm_and_si128(_mm_adds_epi16(x, half), mask);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), x);
+    }
+    return i;
+}
+
+// floor() in SSE2: truncation corrected for negative values. Values from 2^23
+// up (and NaN) are already whole and pass through.
+inline __m128 floorSse2(__m128 v)
+{
+    const __m128 magnitude = _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+    const __m128 whole = _mm_cmpnlt_ps(magnitude, _mm_set1_ps(8388608.0f));
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+    return _mm_or_ps(_mm_and_ps(whole, v), _mm_andnot_ps(whole, t));
+}
+
+// Four samples per iteration of the deterministic uniform kinds
+template <QuantizerKind K>
+std::size_t quantizeFloatSse2(const float *in, float *out, std::size_t count, float step, float inverse)
+{
+    const __m128 stepVector = _mm_set1_ps(step);
+    const __m128 inverseVector = _mm_set1_ps(inverse);
+    const __m128 half = _mm_set1_ps(0.5f);
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 scaled = _mm_mul_ps(_mm_loadu_ps(in + i), inverseVector);
+        if constexpr (K == QuantizerKind::Truncate)
+            scaled = floorSse2(scaled);
+        else if constexpr (K == QuantizerKind::MidRise)
+            scaled = _mm_add_ps(floorSse2(scaled), half);
+        else
+            scaled = floorSse2(_mm_add_ps(scaled, half));
+        _mm_storeu_ps(out + i, _mm_mul_ps(scaled, stepVector));
+    }
+    return i;
+}
+#endif
+
+template <QuantizerKind K>
+double compress(double x)
+{
+    double magnitude = std::min(std::abs(x), 1.0);
+    double y;
+    if constexpr (K == QuantizerKind::MuLaw)
+        y = std::log1p(muLawMu * magnitude) / std::log1p(muLawMu);
+    else
+    {
+        const double denominator = 1.0 + std::log(aLawA);
+        y = magnitude < 1.0 / aLawA ? aLawA * magnitude / denominator : (1.0 + std::log(aLawA * magnitude)) / denominator;
+    }
+    return std::copysign(y, x);
+}
+
+template <QuantizerKind K>
+double expand(double y)
+{
+    double magnitude = std::abs(y);
+    double x;
+    if constexpr (K == QuantizerKind::MuLaw)
+        x = std::expm1(magnitude * std::log1p(muLawMu)) / muLawMu;
+    else
+    {
+        const double denominator = 1.0 + std::log(aLawA);
+        x = magnitude < 1.0 / denominator ? magnitude * denominator / aLawA : std::exp(magnitude * denominator - 1.0) / aLawA;
+    }
+    return std::copysign(x, y);
+}
+
+// One amplitude in [-1, 1] through the compander, with the companded value
+// rounded to one of 2 x levels steps
+template <QuantizerKind K>
+double compand(double x, double levels)
+{
+    double code = std::clamp(std::floor(compress<K>(x) * levels + 0.5), -levels, levels - 1.0);
+    return expand<K>(code / levels);
+}
+
+template <QuantizerKind K, typename T>
+T compandSample(T sample, double levels)
+{
+    if constexpr (std::is_floating_point_v<T>)
+        return static_cast<T>(compand<K>(sample, levels));
+    else
+    {
+        const double fullScale = 1.0 / SampleTraits<T>::scale;
+        double value = std::floor(compand<K>(sample * SampleTraits<T>::scale, levels) * fullScale + 0.5);
+        return static_cast<T>(std::clamp<double>(value, std::numeric_limits<T>::min(), std::numeric_limits<T>::max()));
+    }
+}
+
+// int16 companders go through a table of all 65536 inputs, built on first
+// use for every kind and bit depth
+template <QuantizerKind K>
+const sf::Int16 *companderTable(int b)
+{
+    static std::mutex mutex;
+    static std::unique_ptr<sf::Int16[]> tables[17];
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<sf::Int16[]> &table = tables[b];
+    if (!table)
+    {
+        table = std::make_unique<sf::Int16[]>(65536);
+        double levels = std::ldexp(1.0, std::max(0, 15 - b));
+        for (int value = -32768; value < 32768; ++value)
+            table[value + 32768] = compandSample<K>(static_cast<sf::Int16>(value), levels);
+    }
+    return table.get();
+}
+
+template <QuantizerKind K, typename T>
+void quantizeKernel(const T *in, T *out, std::size_t count, int b, std::uint64_t index)
+{
+    if constexpr (K == QuantizerKind::MuLaw || K == QuantizerKind::ALaw)
+    {
+        if constexpr (std::is_same_v<T, sf::Int16>)
+        {
+            const sf::Int16 *table = companderTable<K>(b);
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = table[in[i] + 32768];
+        }
+        else
+        {
+            // Kept bits, sign included
+            double levels = std::ldexp(1.0, std::max(0, SampleTraits<T>::bits - b - 1));
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = compandSample<K>(in[i], levels);
+        }
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        // A grid of 2^(b - 23), the step of a 24-bit integer with b bits
+        // removed; both scalings are by powers of two, so they are exact
+        const float step = std::ldexp(1.0f, b - 23);
+        const float inverse = std::ldexp(1.0f, 23 - b);
+        std::size_t i = 0;
+#ifdef CHANNELS_USE_SSE2
+        if constexpr (K != QuantizerKind::Tpdf)
+            i = quantizeFloatSse2<K>(in, out, count, step, inverse);
+#endif
+        for (; i < count; ++i)
+            out[i] = quantizeFloat<K>(in[i], step, inverse, index + i);
+    }
+    else
+    {
+        // Every uniform kind keeps integers as they are with no bits removed
+        if (b == 0)
+        {
+            if (in != out)
+                std::copy(in, in + count, out);
+            return;
+        }
+        std::size_t i = 0;
+#ifdef CHANNELS_USE_SSE2
+        if constexpr (std::is_same_v<T, sf::Int16>)
+        {
+            if (b < 16)
+                i = quantizeInt16Sse2<K>(in, out, count, b, index);
+        }
+#endif
+        const IntegerGrid<T> grid(b);
+        for (; i < count; ++i)
+            out[i] = quantizeInteger<K>(in[i], grid, index + i);
+    }
+}
+} // namespace
+
+const char *quantizerName(QuantizerKind kind)
+{
+    switch (kind)
+    {
+    case QuantizerKind::Truncate:
+        return "truncate";
+    case QuantizerKind::MidTread:
+        return "mid-tread";
+    case QuantizerKind::MidRise:
+        return "mid-rise";
+    case QuantizerKind::MuLaw:
+        return "mu-law";
+    case QuantizerKind::ALaw:
+        return "a-law";
+    case QuantizerKind::Tpdf:
+        return "tpdf";
+    }
+    return "";
+}
+
+bool parseQuantizerKind(const std::string &name, QuantizerKind &kind)
+{
+    for (QuantizerKind candidate : quantizerKinds)
+    {
+        if (name == quantizerName(candidate))
+        {
+            kind = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+void quantizeAudio(const T *samples, T *quantizedSamples, std::size_t count, int bitsToReduce, QuantizerKind kind, std::uint64_t firstSample)
+{
+    const int b = std::clamp(bitsToReduce, 0, SampleTraits<T>::bits);
+    switch (kind)
+    {
+    case QuantizerKind::Truncate:
+        quantizeKernel<QuantizerKind::Truncate>(samples, quantizedSamples, count, b, firstSample);
+        break;
+    case QuantizerKind::MidTread:
+        quantizeKernel<QuantizerKind::MidTread>(samples, quantizedSamples, count, b, firstSample);
+        break;
+    case QuantizerKind::MidRise:
+        quantizeKernel<QuantizerKind::MidRise>(samples, quantizedSamples, count, b, firstSample);
+        break;
+    case QuantizerKind::MuLaw:
+        quantizeKernel<QuantizerKind::MuLaw>(samples, quantizedSamples, count, b, firstSample);
+        break;
+    case QuantizerKind::ALaw:
+        quantizeKernel<QuantizerKind::ALaw>(samples, quantizedSamples, count, b, firstSample);
+        break;
+    case QuantizerKind::Tpdf:
+        quantizeKernel<QuantizerKind::Tpdf>(samples, quantizedSamples, count, b, firstSample);
+        break;
+    }
+}
+
+template <typename T>
+void quantizeAudio(const T *samples, T *quantizedSamples, std::size_t count, int bitsToReduce, QuantizerKind kind,
+                   std::uint64_t firstSample, ThreadPool &pool)
+{
+    // Every sample is quantized on its own, so the chunks match the serial result
+    pool.parallelFor(0, count, quantizeGrain, [&](std::size_t first, std::size_t last) {
+        quantizeAudio(samples + first, quantizedSamples + first, last - first, bitsToReduce, kind, firstSample + first);
+    });
+}
+
+template void quantizeAudio<sf::Int16>(const sf::Int16 *, sf::Int16 *, std::size_t, int, QuantizerKind, std::uint64_t);
+template void quantizeAudio<std::int32_t>(const std::int32_t *, std::int32_t *, std::size_t, int, QuantizerKind, std::uint64_t);
+template void quantizeAudio<float>(const float *, float *, std::size_t, int, QuantizerKind, std::uint64_t);
+template void quantizeAudio<sf::Int16>(const sf::Int16 *, sf::Int16 *, std::size_t, int, QuantizerKind, std::uint64_t, ThreadPool &);
+template void quantizeAudio<std::int32_t>(const std::int32_t *, std::int32_t *, std::size_t, int, QuantizerKind, std::uint64_t, ThreadPool &);
+template void quantizeAudio<float>(const float *, float *, std::size_t, int, QuantizerKind, std::uint64_t, ThreadPool &);
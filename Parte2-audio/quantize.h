@@ -0,0 +1,52 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <SFML/Config.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "sample_format.h"
+#include "thread_pool.h"
+
+// How a sample keeps SampleTraits<T>::bits - bitsToReduce bits. The uniform
+// quantizers have a step of 2^bitsToReduce in units of the sample type:
+//   Truncate  clears the low bits (rounds towards minus infinity)
+//   MidTread  rounds to the nearest step: zero is a level
+//   MidRise   truncates, then moves to the middle of the step: zero is a threshold
+//   MuLaw     compresses the amplitude with mu-law (mu = 255), rounds it to the
+//             kept bits and expands it back: G.711 at any bit depth
+//   ALaw      the same with A-law (A = 87.6)
+//   Tpdf      adds triangular dither of up to one step either way, then MidTread
+enum class QuantizerKind
+{
+    Truncate,
+    MidTread,
+    MidRise,
+    MuLaw,
+    ALaw,
+    Tpdf
+};
+
+constexpr QuantizerKind quantizerKinds[] = {QuantizerKind::Truncate, QuantizerKind::MidTread, QuantizerKind::MidRise,
+                                            QuantizerKind::MuLaw, QuantizerKind::ALaw, QuantizerKind::Tpdf};
+
+// Command line names: truncate, mid-tread, mid-rise, mu-law, a-law, tpdf
+const char *quantizerName(QuantizerKind kind);
+bool parseQuantizerKind(const std::string &name, QuantizerKind &kind);
+
+// Quantizes count samples; samples and quantizedSamples may be the same
+// buffer. firstSample is the index of samples[0] in the stream: the dither of
+// a sample is a hash of its index, so the result is the same however the
+// signal is cut into blocks or threads. Every kind is its own kernel per
+// sample type, with SSE2 loops for the uniform kinds of int16 and float.
+template <typename T>
+void quantizeAudio(const T *samples, T *quantizedSamples, std::size_t count, int bitsToReduce,
+                   QuantizerKind kind = QuantizerKind::Truncate, std::uint64_t firstSample = 0);
+
+// The same, in chunks over the pool
+template <typename T>
+void quantizeAudio(const T *samples, T *quantizedSamples, std::size_t count, int bitsToReduce, QuantizerKind kind,
+                   std::uint64_t firstSample, ThreadPool &pool);
+
+#endif
@@ -0,0 +1,268 @@
+#include "resampler.h"
+
+#include <SFML/Config.hpp>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <numeric>
+
+#include "channels.h"
+#include "fft.h"
+
+namespace
+{
+const double pi = 3.14159265358979323846;
+
+// Zeroth-order modified Bessel function of the first kind, by its power series
+double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 64; ++k)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-17)
+            break;
+    }
+    return sum;
+}
+
+// Kaiser's beta for a stopband attenuation in dB
+double kaiserBeta(double attenuation)
+{
+    if (attenuation > 50.0)
+        return 0.1102 * (attenuation - 8.7);
+    if (attenuation >= 21.0)
+        return 0.5842 * std::pow(attenuation - 21.0, 0.4) + 0.07886 * (attenuation - 21.0);
+    return 0.0;
+}
+
+// Inner product of n floats, n a multiple of 8
+float dot(const float *a, const float *b, std::size_t n)
+{
+#ifdef CHANNELS_USE_SSE2
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    for (std::size_t i = 0; i < n; i += 8)
+    {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, _mm_add_ps(sum0, sum1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    float sum[8] = {};
+    for (std::size_t i = 0; i < n; i += 8)
+    {
+        for (int k = 0; k < 8; ++k)
+            sum[k] += a[i + k] * b[i + k];
+    }
+    return ((sum[0] + sum[4]) + (sum[1] + sum[5])) + ((sum[2] + sum[6]) + (sum[3] + sum[7]));
+#endif
+}
+
+// Filter output back to a sample, rounded to the nearest value and clipped
+template <typename T>
+T toSample(float value);
+
+template <>
+sf::Int16 toSample<sf::Int16>(float value)
+{
+    return static_cast<sf::Int16>(std::clamp(std::lrint(value * 32768.0f), -32768L, 32767L));
+}
+
+template <>
+std::int32_t toSample<std::int32_t>(float value)
+{
+    return static_cast<std::int32_t>(std::clamp(std::llrint(value * 2147483648.0), -2147483648LL, 2147483647LL));
+}
+
+template <>
+float toSample<float>(float value)
+{
+    return value;
+}
+}
+
+bool parseResamplerQuality(const std::string &name, ResamplerConfig &config)
+{
+    if (name == "fast")
+        config = {0.85, 70.0};
+    else if (name == "standard")
+        config = {0.91, 100.0};
+    else if (name == "best")
+        config = {0.95, 120.0};
+    else
+        return false;
+    return true;
+}
+
+PolyphaseResampler::PolyphaseResampler(unsigned int input_rate, unsigned int output_rate, unsigned int channel_count,
+                                       const ResamplerConfig &config)
+    : input_rate(input_rate), output_rate(output_rate), channels(std::max(1u, channel_count))
+{
+    unsigned int divisor = std::gcd(input_rate, output_rate);
+    up = output_rate / divisor;
+    down = input_rate / divisor;
+
+    // The prototype runs at input_rate x L. Its length follows from Kaiser's
+    // formula for the attenuation and the width of the transition band.
+    double nyquist = std::min(input_rate, output_rate) / 2.0;
+    passband_edge = std::clamp(config.passband, 0.1, 0.99) * nyquist;
+    stopband_edge = nyquist;
+    double upRate = static_cast<double>(input_rate) * up;
+    double transition = (stopband_edge - passband_edge) / upRate;
+    double cutoff = (passband_edge + stopband_edge) / 2 / upRate;
+    double attenuation = std::max(21.0, config.stopbandDb);
+    std::size_t length = static_cast<std::size_t>(std::ceil((attenuation - 7.95) / (14.36 * transition))) + 1;
+    taps = std::max<std::size_t>(2, (length + up - 1) / up);
+    stride = (taps + 7) / 8 * 8;
+    length = taps * up;
+    // An odd span puts the centre on a sample, so the delay is a whole number
+    // of upsampled samples; an even length leaves its last coefficient zero
+    std::size_t span = length % 2 ? length : length - 1;
+    delay = (span - 1) / 2;
+
+    std::vector<double> prototype(length, 0.0);
+    double beta = kaiserBeta(attenuation);
+    double window = besselI0(beta);
+    double sum = 0.0;
+    for (std::size_t i = 0; i < span; ++i)
+    {
+        double x = static_cast<double>(i) - static_cast<double>(delay);
+        double sinc = x == 0.0 ? 2 * cutoff : std::sin(2 * pi * cutoff * x) / (pi * x);
+        double r = x / delay;
+        prototype[i] = sinc * besselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / window;
+        sum += prototype[i];
+    }
+
+    // Unity gain at DC: every phase sums to about 1, the whole filter to L
+    bank.assign(up * stride, 0.0f);
+    for (std::size_t i = 0; i < length; ++i)
+        bank[(i % up) * stride + stride - 1 - i / up] = static_cast<float>(prototype[i] * up / sum);
+
+    // Input before the start of the stream is silence
+    history.assign(channels, std::vector<float>(stride - 1, 0.0f));
+    historyStart = -static_cast<std::int64_t>(stride - 1);
+}
+
+std::uint64_t PolyphaseResampler::outputFrames(std::uint64_t frames) const
+{
+    return (frames * up + down - 1) / down;
+}
+
+std::size_t PolyphaseResampler::maxOutputFrames(std::size_t frames) const
+{
+    return (std::max(frames, stride) * up + down - 1) / down + 2;
+}
+
+template <typename T>
+std::size_t PolyphaseResampler::process(const T *in, std::size_t frames, std::vector<T> &out)
+{
+    const float scale = static_cast<float>(SampleTraits<T>::scale);
+    for (unsigned int c = 0; c < channels; ++c)
+    {
+        std::vector<float> &channel = history[c];
+        std::size_t start = channel.size();
+        channel.resize(start + frames);
+        for (std::size_t i = 0; i < frames; ++i)
+            channel[start + i] = static_cast<float>(in[i * channels + c]) * scale;
+    }
+    consumed += frames;
+    return produce(consumed, outputFrames(consumed), out);
+}
+
+template <typename T>
+std::size_t PolyphaseResampler::flush(std::vector<T> &out)
+{
+    std::uint64_t total = outputFrames(consumed);
+    if (produced >= total)
+    {
+        out.clear();
+        return 0;
+    }
+    // Silence after the end, up to the window of the last output frame
+    std::uint64_t end = ((total - 1) * down + delay) / up + 1;
+    std::uint64_t available = static_cast<std::uint64_t>(historyStart + static_cast<std::int64_t>(history[0].size()));
+    if (end > available)
+    {
+        for (std::vector<float> &channel : history)
+            channel.resize(channel.size() + (end - available), 0.0f);
+        available = end;
+    }
+    return produce(available, total, out);
+}
+
+// Output frames [produced, limit) whose input window lies before frame
+// `available`, then drops the input no later frame will need
+template <typename T>
+std::size_t PolyphaseResampler::produce(std::uint64_t available, std::uint64_t limit, std::vector<T> &out)
+{
+    // Frame n needs input up to (n M + delay) / L, so every frame made is
+    // below available x L / M
+    std::uint64_t last = std::min(limit, (available * up + down - 1) / down);
+    out.resize(static_cast<std::size_t>(last > produced ? last - produced : 0) * channels);
+    std::size_t count = 0;
+    for (std::uint64_t n = produced; n < limit; ++n)
+    {
+        std::uint64_t position = n * down + delay;
+        std::uint64_t base = position / up;
+        if (base >= available)
+            break;
+        const float *coefficients = bank.data() + (position % up) * stride;
+        std::size_t first = static_cast<std::size_t>(static_cast<std::int64_t>(base) - historyStart) - (stride - 1);
+        for (unsigned int c = 0; c < channels; ++c)
+            out[count * channels + c] = toSample<T>(dot(coefficients, history[c].data() + first, stride));
+        count++;
+    }
+    produced += count;
+    out.resize(count * channels);
+
+    std::int64_t keep = static_cast<std::int64_t>((produced * down + delay) / up) - static_cast<std::int64_t>(stride - 1);
+    std::size_t drop = static_cast<std::size_t>(std::clamp<std::int64_t>(keep - historyStart, 0, history[0].size()));
+    for (std::vector<float> &channel : history)
+        channel.erase(channel.begin(), channel.begin() + drop);
+    historyStart += static_cast<std::int64_t>(drop);
+    return count;
+}
+
+ResamplerQuality PolyphaseResampler::measureQuality() const
+{
+    // The prototype back out of the bank, as the float coefficients in use
+    std::size_t length = taps * up;
+    std::size_t size = 1 << 16;
+    while (size < 4 * length && size < (std::size_t(1) << 24))
+        size <<= 1;
+    RealFFT fft(size);
+    RealFFT::Workspace workspace(size);
+    double *input = workspace.input();
+    std::fill(input, input + size, 0.0);
+    for (std::size_t i = 0; i < std::min(length, size); ++i)
+        input[i] = bank[(i % up) * stride + stride - 1 - i / up] / static_cast<double>(up);
+    fft.forward(workspace);
+
+    ResamplerQuality quality;
+    quality.passbandEdge = passband_edge;
+    quality.stopbandEdge = stopband_edge;
+    double binWidth = static_cast<double>(input_rate) * up / size;
+    double peakStopband = 0.0;
+    const std::complex<double> *spectrum = workspace.output();
+    for (std::size_t k = 0; k < fft.bins(); ++k)
+    {
+        double frequency = k * binWidth;
+        double magnitude = std::abs(spectrum[k]);
+        if (frequency <= passband_edge)
+            quality.passbandRippleDb = std::max(quality.passbandRippleDb, std::abs(20 * std::log10(magnitude)));
+        else if (frequency >= stopband_edge)
+            peakStopband = std::max(peakStopband, magnitude);
+    }
+    quality.stopbandDb = -20 * std::log10(std::max(peakStopband, 1e-300));
+    return quality;
+}
+
+template std::size_t PolyphaseResampler::process(const sf::Int16 *, std::size_t, std::vector<sf::Int16> &);
+template std::size_t PolyphaseResampler::process(const std::int32_t *, std::size_t, std::vector<std::int32_t> &);
+template std::size_t PolyphaseResampler::process(const float *, std::size_t, std::vector<float> &);
+template std::size_t PolyphaseResampler::flush(std::vector<sf::Int16> &);
+template std::size_t PolyphaseResampler::flush(std::vector<std::int32_t> &);
+template std::size_t PolyphaseResampler::flush(std::vector<float> &);
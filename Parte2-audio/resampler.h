@@ -0,0 +1,90 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Anti-aliasing / anti-imaging filter of the resampler, relative to the
+// Nyquist frequency of the lower of the two rates: the passband runs up to
+// passband x Nyquist, the stopband starts at Nyquist
+struct ResamplerConfig
+{
+    double passband = 0.91;    // 20 kHz at 44.1 kHz
+    double stopbandDb = 100.0; // attenuation of the stopband
+};
+
+// Presets: fast (0.85, 70 dB), standard (0.91, 100 dB), best (0.95, 120 dB)
+bool parseResamplerQuality(const std::string &name, ResamplerConfig &config);
+
+// Response of the designed filter, measured on its spectrum
+struct ResamplerQuality
+{
+    double passbandEdge = 0.0;     // Hz
+    double stopbandEdge = 0.0;     // Hz
+    double passbandRippleDb = 0.0; // largest deviation from 0 dB in the passband
+    double stopbandDb = 0.0;       // attenuation of the strongest stopband frequency
+};
+
+// Rational sample-rate converter for streamed, interleaved blocks. The output
+// rate is input rate x L / M in lowest terms; the Kaiser-windowed sinc
+// prototype is split into L phases of tapsPerPhase() coefficients, all
+// precomputed, so every output sample is one inner product over contiguous
+// input samples (SSE, eight at a time). The filter's group delay is
+// compensated: output frame n is at the time of input frame n x M / L, and
+// once flush() has run the output has exactly outputFrames(input) frames.
+class PolyphaseResampler
+{
+public:
+    PolyphaseResampler(unsigned int input_rate, unsigned int output_rate, unsigned int channel_count,
+                       const ResamplerConfig &config = ResamplerConfig());
+
+    unsigned int inputRate() const { return input_rate; }
+    unsigned int outputRate() const { return output_rate; }
+    std::size_t phases() const { return up; }
+    std::size_t tapsPerPhase() const { return taps; }
+
+    // Frames the whole output of `frames` input frames has
+    std::uint64_t outputFrames(std::uint64_t frames) const;
+    // Most frames one process() call of `frames` frames, or flush(), can produce
+    std::size_t maxOutputFrames(std::size_t frames) const;
+
+    // Resamples `frames` interleaved frames into out, replacing its contents;
+    // returns the frames produced. Defined for sf::Int16, std::int32_t and float.
+    template <typename T>
+    std::size_t process(const T *in, std::size_t frames, std::vector<T> &out);
+    // The last frames, held back until now by the filter's lookahead
+    template <typename T>
+    std::size_t flush(std::vector<T> &out);
+
+    // Passband ripple and stopband attenuation of the filter bank
+    ResamplerQuality measureQuality() const;
+
+private:
+    template <typename T>
+    std::size_t produce(std::uint64_t available, std::uint64_t limit, std::vector<T> &out);
+
+    unsigned int input_rate;
+    unsigned int output_rate;
+    unsigned int channels;
+    std::size_t up;     // L
+    std::size_t down;   // M
+    std::size_t taps;   // coefficients per phase
+    std::size_t stride; // taps rounded up to the SIMD width
+    double passband_edge;
+    double stopband_edge;
+    std::uint64_t delay; // group delay of the prototype, in upsampled samples
+
+    // Phase p holds h[p + L (taps - 1 - t)] at t + stride - taps, so it runs
+    // forward over the input window; the leading coefficients are zero
+    std::vector<float> bank; // up x stride
+
+    // history[c][i] is input frame historyStart + i of channel c
+    std::vector<std::vector<float>> history;
+    std::int64_t historyStart;
+    std::uint64_t consumed = 0; // input frames seen
+    std::uint64_t produced = 0; // output frames made
+};
+
+#endif
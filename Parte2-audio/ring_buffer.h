@@ -0,0 +1,62 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Lock-free single-producer / single-consumer ring of preallocated slots. The
+// producer fills the slot from beginWrite() in place and publishes it with
+// endWrite(); the consumer reads the slot from beginRead() and hands it back
+// with endRead(). Slots are never copied, so they can own large buffers.
+// Head and tail are free-running counters on separate cache lines; each side
+// only ever stores its own counter (release) and loads the other (acquire).
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(std::size_t capacity) : slots(roundUp(capacity)), mask(slots.size() - 1) {}
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    std::size_t capacity() const { return slots.size(); }
+
+    // Producer: the next free slot, or nullptr while the ring is full
+    T *beginWrite()
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size())
+            return nullptr;
+        return &slots[t & mask];
+    }
+    void endWrite() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Consumer: the oldest published slot, or nullptr while the ring is empty
+    T *beginRead()
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &slots[h & mask];
+    }
+    void endRead() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Published slots not yet read (approximate while the other side runs)
+    std::size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+
+private:
+    static std::size_t roundUp(std::size_t n)
+    {
+        std::size_t power = 1;
+        while (power < n)
+            power <<= 1;
+        return power;
+    }
+
+    std::vector<T> slots;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> head{0}; // next slot to read
+    alignas(64) std::atomic<std::size_t> tail{0}; // next slot to write
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef SAMPLE_FORMAT_H
+#define SAMPLE_FORMAT_H
+
+#include <SFML/Config.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Scale that maps 16-bit samples to [-1, 1)
+constexpr double int16Scale = 1.0 / 32768.0;
+
+// Sample types the analysis runs on natively. 24-bit PCM is widened into
+// int32 with its bits at the top (value << 8), so one type and one scale cover
+// 24 and 32-bit PCM; float samples are IEEE floats in [-1, 1].
+enum class SampleFormat
+{
+    Int16,
+    Int32,
+    Float32
+};
+
+// Compile-time description of a sample type:
+//   bits        resolution the quantizer counts bitsToReduce from (a float
+//               has the 24 bits of its mantissa at full scale)
+//   scale       factor to amplitudes in [-1, 1)
+//   Sum         error sums of the metrics: exact integers for int16, double
+//               for the wider types, whose squares do not fit 64 bits
+//   fromInt32   conversion from a sample at the top of an int32
+//   fromFloat   conversion from a float in [-1, 1], truncated like the decoders
+//   toInt16     the top 16 bits, for the int16 display stages
+template <typename T>
+struct SampleTraits;
+
+template <>
+struct SampleTraits<sf::Int16>
+{
+    static constexpr SampleFormat format = SampleFormat::Int16;
+    static constexpr int bits = 16;
+    static constexpr double scale = int16Scale;
+    using Sum = std::uint64_t;
+    using Magnitude = std::uint32_t;
+
+    static sf::Int16 fromInt32(std::int32_t value) { return static_cast<sf::Int16>(value >> 16); }
+    static sf::Int16 fromFloat(float value) { return static_cast<sf::Int16>(std::clamp(std::floor(value * 32768.0f), -32768.0f, 32767.0f)); }
+    static sf::Int16 toInt16(sf::Int16 value) { return value; }
+};
+
+template <>
+struct SampleTraits<std::int32_t>
+{
+    static constexpr SampleFormat format = SampleFormat::Int32;
+    static constexpr int bits = 32;
+    static constexpr double scale = 1.0 / 2147483648.0;
+    using Sum = double;
+    using Magnitude = double;
+
+    static std::int32_t fromInt32(std::int32_t value) { return value; }
+    static std::int32_t fromFloat(float value)
+    {
+        return static_cast<std::int32_t>(std::clamp(std::floor(value * 2147483648.0), -2147483648.0, 2147483647.0));
+    }
+    static sf::Int16 toInt16(std::int32_t value) { return static_cast<sf::Int16>(value >> 16); }
+};
+
+template <>
+struct SampleTraits<float>
+{
+    static constexpr SampleFormat format = SampleFormat::Float32;
+    static constexpr int bits = 24;
+    static constexpr double scale = 1.0;
+    using Sum = double;
+    using Magnitude = double;
+
+    static float fromInt32(std::int32_t value) { return static_cast<float>(value * (1.0 / 2147483648.0)); }
+    static float fromFloat(float value) { return value; }
+    static sf::Int16 toInt16(float value) { return SampleTraits<sf::Int16>::fromFloat(value); }
+};
+
+// The top 16 bits of every sample
+template <typename T>
+void convertToInt16(const T *samples, sf::Int16 *out, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+        out[i] = SampleTraits<T>::toInt16(samples[i]);
+}
+
+#endif
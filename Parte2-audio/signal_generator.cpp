@@ -0,0 +1,147 @@
+#include "signal_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+const double pi = 3.14159265358979323846;
+
+struct KindName
+{
+    SignalKind kind;
+    const char *name;
+};
+
+const KindName kindNames[] = {
+    {SignalKind::Sine, "sine"},
+    {SignalKind::Noise, "noise"},
+    {SignalKind::Silence, "silence"},
+    {SignalKind::Speech, "speech"},
+};
+}
+
+const char *signalKindName(SignalKind kind)
+{
+    for (const KindName &entry : kindNames)
+    {
+        if (entry.kind == kind)
+            return entry.name;
+    }
+    return "";
+}
+
+bool parseSignalKind(const std::string &name, SignalKind &kind)
+{
+    for (const KindName &entry : kindNames)
+    {
+        if (name == entry.name)
+        {
+            kind = entry.kind;
+            return true;
+        }
+    }
+    return false;
+}
+
+SignalGenerator::SignalGenerator(const SignalSpec &spec)
+    : config(spec),
+      fullScale(std::ldexp(1.0, spec.bits - 1) - 1.0),
+      state(0x9E3779B97F4A7C15ull ^ spec.seed)
+{
+    config.channels = std::max(1u, config.channels);
+    phase.assign(config.channels, 0.0);
+    step.resize(config.channels);
+    gain.resize(config.channels);
+    for (unsigned int c = 0; c < config.channels; ++c)
+    {
+        // Tones half an octave apart from 220 Hz, so every channel differs
+        step[c] = 2 * pi * 220.0 * std::pow(2.0, c / 2.0) / config.sampleRate;
+        gain[c] = 1.0 - 0.08 * c;
+    }
+}
+
+// xorshift64*: fast enough to generate hours of noise
+double SignalGenerator::uniform()
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    std::uint64_t bits = state * 0x2545F4914F6CDD1Dull;
+    return static_cast<double>(bits >> 11) * std::ldexp(1.0, -52) - 1.0;
+}
+
+// Syllable-like bursts of 80-300 ms with a pitch of 100-220 Hz gliding by up
+// to 30 %, each followed by a 50-400 ms pause
+void SignalGenerator::startBurst()
+{
+    double rate = config.sampleRate;
+    burstLength = burstLeft = static_cast<std::uint64_t>(rate * (0.08 + 0.11 * (uniform() + 1.0)));
+    pitch = 100.0 + 60.0 * (uniform() + 1.0);
+    pitchStep = pitch * 0.3 * uniform() / burstLength;
+    pauseLeft = static_cast<std::uint64_t>(rate * (0.05 + 0.175 * (uniform() + 1.0)));
+}
+
+double SignalGenerator::next(unsigned int channel)
+{
+    switch (config.kind)
+    {
+    case SignalKind::Sine:
+    {
+        double value = 0.5 * std::sin(phase[channel]);
+        phase[channel] += step[channel];
+        if (phase[channel] > 2 * pi)
+            phase[channel] -= 2 * pi;
+        return value;
+    }
+    case SignalKind::Noise:
+        return 0.5 * uniform();
+    case SignalKind::Silence:
+        return 0.0;
+    case SignalKind::Speech:
+        break;
+    }
+
+    // Speech: one source sample per frame, scaled per channel
+    if (channel > 0)
+        return speechValue * gain[channel];
+    double value = 0.0;
+    if (burstLeft == 0 && pauseLeft == 0)
+        startBurst();
+    if (burstLeft > 0)
+    {
+        double t = static_cast<double>(burstLength - burstLeft) / burstLength;
+        double envelope = std::sin(pi * t);
+        double voice = 0.0;
+        for (int k = 1; k <= 8; ++k)
+            voice += std::sin(k * voicePhase) / k;
+        value = envelope * (0.25 * voice + 0.03 * uniform());
+        voicePhase += 2 * pi * pitch / config.sampleRate;
+        if (voicePhase > 2 * pi)
+            voicePhase -= 2 * pi;
+        pitch += pitchStep;
+        burstLeft--;
+    }
+    else
+    {
+        // Low background noise between bursts
+        value = 0.001 * uniform();
+        pauseLeft--;
+    }
+    speechValue = value;
+    return value;
+}
+
+void SignalGenerator::generate(std::int32_t *samples, std::size_t frames)
+{
+    const unsigned int channels = config.channels;
+    const double low = -fullScale - 1.0;
+    for (std::size_t i = 0; i < frames; ++i)
+    {
+        for (unsigned int c = 0; c < channels; ++c)
+        {
+            double value = std::round(next(c) * fullScale);
+            samples[i * channels + c] = static_cast<std::int32_t>(std::clamp(value, low, fullScale));
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef SIGNAL_GENERATOR_H
+#define SIGNAL_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Synthetic test signals for benchmarks and experiments
+enum class SignalKind
+{
+    Sine,    // one tone per channel, half of full scale
+    Noise,   // uniform white noise, half of full scale
+    Silence, // all zeros
+    Speech   // voiced bursts (harmonics of a gliding pitch) separated by pauses
+};
+
+const char *signalKindName(SignalKind kind);
+bool parseSignalKind(const std::string &name, SignalKind &kind);
+
+struct SignalSpec
+{
+    SignalKind kind = SignalKind::Sine;
+    unsigned int channels = 2;
+    unsigned int sampleRate = 44100;
+    int bits = 16; // 16, 24 or 32
+    std::uint32_t seed = 1;
+};
+
+// Generates a signal block by block, so its length is only bounded by the
+// caller: hours of audio never have to be held in memory. Samples are
+// interleaved, in int32 containers at the requested bit depth (a 24-bit
+// sample lies in [-2^23, 2^23)).
+class SignalGenerator
+{
+public:
+    explicit SignalGenerator(const SignalSpec &spec);
+
+    const SignalSpec &spec() const { return config; }
+
+    // The next `frames` frames
+    void generate(std::int32_t *samples, std::size_t frames);
+
+private:
+    double next(unsigned int channel);
+    double uniform(); // [-1, 1)
+    void startBurst();
+
+    SignalSpec config;
+    double fullScale;
+    std::uint64_t state;
+    std::vector<double> phase, step, gain;
+
+    // Speech: burst / pause state, shared by all channels
+    double pitch = 0.0, pitchStep = 0.0, voicePhase = 0.0;
+    double speechValue = 0.0; // this frame's source sample
+    std::uint64_t burstLeft = 0, burstLength = 0, pauseLeft = 0;
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "stft.h"
+
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cmath>
+
+bool parseWindowType(const std::string &name, WindowType &type)
+{
+    if (name == "rect" || name == "rectangular")
+        type = WindowType::Rectangular;
+    else if (name == "hann")
+        type = WindowType::Hann;
+    else if (name == "hamming")
+        type = WindowType::Hamming;
+    else if (name == "blackman")
+        type = WindowType::Blackman;
+    else
+        return false;
+    return true;
+}
+
+std::vector<double> makeWindow(WindowType type, std::size_t size)
+{
+    const double pi = 3.14159265358979323846;
+    std::vector<double> window(size, 1.0);
+    if (size < 2)
+        return window;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        // Periodic windows, so overlapping frames add up evenly
+        double x = 2.0 * pi * i / size;
+        switch (type)
+        {
+        case WindowType::Rectangular:
+            break;
+        case WindowType::Hann:
+            window[i] = 0.5 - 0.5 * std::cos(x);
+            break;
+        case WindowType::Hamming:
+            window[i] = 0.54 - 0.46 * std::cos(x);
+            break;
+        case WindowType::Blackman:
+            window[i] = 0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2.0 * x);
+            break;
+        }
+    }
+    return window;
+}
+
+std::uint64_t stftFrameCount(std::uint64_t samples, const StftConfig &config)
+{
+    if (samples == 0)
+        return 0;
+    if (samples <= config.size)
+        return 1;
+    return 1 + (samples - config.size + config.hop - 1) / config.hop;
+}
+
+StftEngine::StftEngine(const StftConfig &config, ThreadPool &pool)
+    : cfg(config), pool(pool), fft(config.size), window(makeWindow(config.window, config.size))
+{
+    // Enough frames per batch to keep every thread busy with a few tasks
+    batchFrames = 16 * std::max(1u, pool.size());
+    magnitudes.resize(batchFrames * fft.bins());
+    buffer.reserve((batchFrames - 1) * cfg.hop + cfg.size);
+}
+
+void StftEngine::addSink(StftSink sink)
+{
+    sinks.push_back(std::move(sink));
+}
+
+void StftEngine::addFrameSink(StftFrameSink sink)
+{
+    frameSinks.push_back(std::move(sink));
+}
+
+void StftEngine::feed(const double *samples, std::size_t count)
+{
+    // With hop > size some samples belong to no frame at all
+    std::size_t skip = 0;
+    if (bufferStart > position)
+        skip = static_cast<std::size_t>(std::min<std::uint64_t>(count, bufferStart - position));
+    buffer.insert(buffer.end(), samples + skip, samples + count);
+    position += count;
+
+    while (buffer.size() >= (batchFrames - 1) * cfg.hop + cfg.size)
+        processFrames(batchFrames);
+}
+
+void StftEngine::finish()
+{
+    std::uint64_t total = stftFrameCount(position, cfg);
+    while (nextFrame < total)
+    {
+        std::size_t frames = static_cast<std::size_t>(std::min<std::uint64_t>(batchFrames, total - nextFrame));
+        std::size_t needed = (frames - 1) * cfg.hop + cfg.size;
+        if (buffer.size() < needed)
+            buffer.resize(needed, 0.0);
+        processFrames(frames);
+    }
+}
+
+void StftEngine::processFrames(std::size_t frames)
+{
+    const std::size_t bins = fft.bins();
+    const std::size_t firstOffset = static_cast<std::size_t>(nextFrame * cfg.hop - bufferStart);
+
+    pool.parallelFor(0, frames, 4, [&](std::size_t first, std::size_t last) {
+        std::unique_ptr<RealFFT::Workspace> workspace;
+        {
+            std::lock_guard<std::mutex> lock(workspaceMutex);
+            if (!workspaces.empty())
+            {
+                workspace = std::move(workspaces.back());
+                workspaces.pop_back();
+            }
+        }
+        if (!workspace)
+            workspace = std::make_unique<RealFFT::Workspace>(cfg.size);
+
+        for (std::size_t f = first; f < last; ++f)
+        {
+            const double *frame = buffer.data() + firstOffset + f * cfg.hop;
+            double *in = workspace->input();
+            for (std::size_t i = 0; i < cfg.size; ++i)
+                in[i] = frame[i] * window[i];
+            fft.forward(*workspace);
+            const std::complex<double> *out = workspace->output();
+            float *row = magnitudes.data() + f * bins;
+            for (std::size_t b = 0; b < bins; ++b)
+                row[b] = static_cast<float>(std::abs(out[b]));
+        }
+
+        std::lock_guard<std::mutex> lock(workspaceMutex);
+        workspaces.push_back(std::move(workspace));
+    });
+
+    for (const StftSink &sink : sinks)
+        sink(nextFrame, magnitudes.data(), frames);
+    for (const StftFrameSink &sink : frameSinks)
+        sink(nextFrame, buffer.data() + firstOffset, magnitudes.data(), frames);
+    nextFrame += frames;
+
+    // Drop the samples no later frame needs
+    std::uint64_t newStart = nextFrame * cfg.hop;
+    std::uint64_t drop = std::min<std::uint64_t>(newStart - bufferStart, buffer.size());
+    buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(drop));
+    bufferStart = newStart;
+}
+
+void AverageSpectrum::consume(std::uint64_t, const float *magnitudes, std::size_t count)
+{
+    for (std::size_t f = 0; f < count; ++f)
+    {
+        const float *row = magnitudes + f * sum.size();
+        for (std::size_t b = 0; b < sum.size(); ++b)
+            sum[b] += row[b];
+    }
+    frames += count;
+}
+
+std::vector<double> AverageSpectrum::result() const
+{
+    std::vector<double> mean(sum);
+    if (frames > 0)
+    {
+        for (double &value : mean)
+            value /= frames;
+    }
+    return mean;
+}
+
+bool SpectrogramWriter::open(const std::string &filename, const StftConfig &config, std::size_t binCount, unsigned int sampleRate)
+{
+    file.open(filename, std::ios::binary);
+    if (!file)
+        return false;
+    bins = binCount;
+    frames = 0;
+
+    std::uint32_t version = 1;
+    std::uint32_t header[4] = {static_cast<std::uint32_t>(bins), sampleRate, static_cast<std::uint32_t>(config.size), static_cast<std::uint32_t>(config.hop)};
+    file.write("STFT", 4);
+    file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char *>(&frames), sizeof(frames)); // patched in close()
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    return true;
+}
+
+void SpectrogramWriter::consume(std::uint64_t, const float *magnitudes, std::size_t count)
+{
+    if (!file.is_open())
+        return;
+    file.write(reinterpret_cast<const char *>(magnitudes), static_cast<std::streamsize>(count * bins * sizeof(float)));
+    frames += count;
+}
+
+void SpectrogramWriter::close()
+{
+    if (!file.is_open())
+        return;
+    file.seekp(8);
+    file.write(reinterpret_cast<const char *>(&frames), sizeof(frames));
+    file.close();
+}
+
+SpectrogramImage::SpectrogramImage(std::uint64_t totalFrames, std::size_t bins, unsigned int width, unsigned int height)
+    : totalFrames(std::max<std::uint64_t>(1, totalFrames)), bins(bins),
+      width(static_cast<unsigned int>(std::min<std::uint64_t>(width, std::max<std::uint64_t>(1, totalFrames)))),
+      height(static_cast<unsigned int>(std::min<std::size_t>(height, bins))),
+      grid(static_cast<std::size_t>(this->width) * this->height, 0.0f)
+{
+}
+
+void SpectrogramImage::consume(std::uint64_t firstFrame, const float *magnitudes, std::size_t count)
+{
+    for (std::size_t f = 0; f < count; ++f)
+    {
+        std::size_t x = static_cast<std::size_t>((firstFrame + f) * width / totalFrames);
+        const float *row = magnitudes + f * bins;
+        for (std::size_t b = 0; b < bins; ++b)
+        {
+            std::size_t y = b * height / bins;
+            float &cell = grid[y * width + x];
+            cell = std::max(cell, row[b]);
+        }
+    }
+}
+
+// Black -> purple -> red -> yellow -> white, for t in [0, 1]
+static sf::Color heatColour(double t)
+{
+    static const double stops[5][3] = {{0, 0, 0}, {90, 20, 140}, {220, 50, 40}, {250, 200, 40}, {255, 255, 255}};
+    t = std::clamp(t, 0.0, 1.0) * 4.0;
+    int i = std::min(3, static_cast<int>(t));
+    double f = t - i;
+    auto mix = [&](int k) { return static_cast<sf::Uint8>(stops[i][k] + (stops[i + 1][k] - stops[i][k]) * f); };
+    return sf::Color(mix(0), mix(1), mix(2));
+}
+
+bool SpectrogramImage::save(const std::string &filename, double dynamicRange) const
+{
+    float peak = *std::max_element(grid.begin(), grid.end());
+    double peakDb = 20.0 * std::log10(std::max(peak, 1e-12f));
+
+    sf::Image image;
+    image.create(width, height);
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            double db = 20.0 * std::log10(std::max(grid[static_cast<std::size_t>(y) * width + x], 1e-12f));
+            // Low frequencies at the bottom
+            image.setPixel(x, height - 1 - y, heatColour(1.0 - (peakDb - db) / dynamicRange));
+        }
+    }
+    return image.saveToFile(filename);
+}
@@ -0,0 +1,129 @@
+#ifndef STFT_H
+#define STFT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fft.h"
+#include "thread_pool.h"
+
+enum class WindowType
+{
+    Rectangular,
+    Hann,
+    Hamming,
+    Blackman
+};
+
+bool parseWindowType(const std::string &name, WindowType &type);
+std::vector<double> makeWindow(WindowType type, std::size_t size);
+
+struct StftConfig
+{
+    std::size_t size = 4096;
+    std::size_t hop = 1024;
+    WindowType window = WindowType::Hann;
+};
+
+// Frames produced for a signal of the given length; the last frame is zero-padded
+std::uint64_t stftFrameCount(std::uint64_t samples, const StftConfig &config);
+
+// Receives frames in order: magnitudes holds `frames` rows of `bins` values
+using StftSink = std::function<void(std::uint64_t firstFrame, const float *magnitudes, std::size_t frames)>;
+// Same, with the unwindowed samples as well: frame f starts at samples + f x hop
+// and holds `size` samples, zero-padded past the end of the signal
+using StftFrameSink = std::function<void(std::uint64_t firstFrame, const double *samples, const float *magnitudes, std::size_t frames)>;
+
+// Short-time Fourier transform of a streamed signal. Samples are buffered until a
+// batch of frames is available; the batch is windowed and transformed in parallel
+// (one shared r2c transform, one workspace per task) and the magnitude rows are handed
+// to every sink in frame order. Memory is bounded by the batch size.
+class StftEngine
+{
+public:
+    StftEngine(const StftConfig &config, ThreadPool &pool);
+
+    void addSink(StftSink sink);
+    void addFrameSink(StftFrameSink sink);
+    void feed(const double *samples, std::size_t count);
+    // Processes the remaining (zero-padded) frames
+    void finish();
+
+    std::size_t bins() const { return fft.bins(); }
+    const StftConfig &config() const { return cfg; }
+
+private:
+    void processFrames(std::size_t frames);
+
+    StftConfig cfg;
+    ThreadPool &pool;
+    RealFFT fft;
+    std::vector<double> window;
+    std::size_t batchFrames;
+
+    std::vector<double> buffer;     // samples [bufferStart, position)
+    std::uint64_t bufferStart = 0;  // global index of buffer[0]
+    std::uint64_t position = 0;     // global index of the next incoming sample
+    std::uint64_t nextFrame = 0;
+    std::vector<float> magnitudes;  // batchFrames rows of bins()
+
+    std::mutex workspaceMutex;
+    std::vector<std::unique_ptr<RealFFT::Workspace>> workspaces;
+    std::vector<StftSink> sinks;
+    std::vector<StftFrameSink> frameSinks;
+};
+
+// Mean magnitude spectrum over all frames
+class AverageSpectrum
+{
+public:
+    explicit AverageSpectrum(std::size_t bins) : sum(bins, 0.0) {}
+    void consume(std::uint64_t firstFrame, const float *magnitudes, std::size_t frames);
+    std::vector<double> result() const;
+
+private:
+    std::vector<double> sum;
+    std::uint64_t frames = 0;
+};
+
+// Streams the magnitude matrix to a binary file:
+//   char[4] "STFT", uint32 version (1), uint64 frames, uint32 bins,
+//   uint32 sample rate, uint32 frame size, uint32 hop,
+//   then frames x bins float32 values, one row per frame (host byte order)
+class SpectrogramWriter
+{
+public:
+    bool open(const std::string &filename, const StftConfig &config, std::size_t bins, unsigned int sampleRate);
+    void consume(std::uint64_t firstFrame, const float *magnitudes, std::size_t frames);
+    void close();
+
+private:
+    std::ofstream file;
+    std::size_t bins = 0;
+    std::uint64_t frames = 0;
+};
+
+// Max-pools the spectrogram into a fixed-size grid while streaming and saves it
+// as a PNG (time on x, frequency on y, dB colour scale)
+class SpectrogramImage
+{
+public:
+    SpectrogramImage(std::uint64_t totalFrames, std::size_t bins, unsigned int width = 1200, unsigned int height = 400);
+    void consume(std::uint64_t firstFrame, const float *magnitudes, std::size_t frames);
+    bool save(const std::string &filename, double dynamicRange = 90.0) const;
+
+private:
+    std::uint64_t totalFrames;
+    std::size_t bins;
+    unsigned int width;
+    unsigned int height;
+    std::vector<float> grid; // width x height, row-major by frequency
+};
+
+#endif
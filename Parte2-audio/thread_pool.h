@@ -0,0 +1,206 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque: it pops its own work from
+// the back and, when empty, steals from the front of the other workers' deques.
+// Tasks submitted from inside a worker go to that worker's deque. parallelFor
+// never deadlocks when nested: its caller works through its own chunks and
+// only waits for chunks other threads have already started.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threads = std::thread::hardware_concurrency())
+    {
+        threads = std::max(1u, threads);
+        for (unsigned int i = 0; i < threads; ++i)
+            queues.push_back(std::make_unique<Queue>());
+        for (unsigned int i = 0; i < threads; ++i)
+            workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+
+    ~ThreadPool()
+    {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(workers.size());
+    }
+
+    void submit(std::function<void()> task)
+    {
+        std::size_t target = currentWorker() < queues.size() && currentPool() == this
+                                 ? currentWorker()
+                                 : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        pending.fetch_add(1, std::memory_order_acq_rel);
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->mutex);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every submitted task has finished, running tasks meanwhile
+    void wait()
+    {
+        while (pending.load(std::memory_order_acquire) > 0)
+        {
+            if (!runOne())
+                std::this_thread::yield();
+        }
+    }
+
+    // Calls fn(first, last) over [begin, end) in chunks of at most grain items
+    // and returns once all chunks are done
+    template <typename F>
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, F fn)
+    {
+        if (begin >= end)
+            return;
+        grain = std::max<std::size_t>(1, grain);
+        if (end - begin <= grain || size() == 1)
+        {
+            fn(begin, end);
+            return;
+        }
+
+        // The chunks are claimed from a shared counter, by the caller and by
+        // helper tasks. While waiting, the caller only works on its own chunks:
+        // running any queued task could nest a whole unrelated job (say another
+        // file) on this stack and keep its memory alive until it returns.
+        struct Shared
+        {
+            Shared(F fn, std::size_t begin, std::size_t end, std::size_t grain, std::size_t chunks)
+                : fn(std::move(fn)), begin(begin), end(end), grain(grain), chunks(chunks)
+            {
+            }
+
+            F fn;
+            std::size_t begin, end, grain, chunks;
+            std::atomic<std::size_t> next{0};
+            std::atomic<std::size_t> done{0};
+
+            // Runs chunks until none are left to claim
+            void work()
+            {
+                for (std::size_t chunk; (chunk = next.fetch_add(1, std::memory_order_relaxed)) < chunks;)
+                {
+                    std::size_t first = begin + chunk * grain;
+                    fn(first, std::min(end, first + grain));
+                    done.fetch_add(1, std::memory_order_acq_rel);
+                }
+            }
+        };
+        std::size_t chunks = (end - begin + grain - 1) / grain;
+        auto shared = std::make_shared<Shared>(fn, begin, end, grain, chunks);
+        std::size_t helpers = std::min<std::size_t>(chunks, size()) - 1;
+        for (std::size_t h = 0; h < helpers; ++h)
+            submit([shared]() { shared->work(); });
+        shared->work();
+        while (shared->done.load(std::memory_order_acquire) < chunks)
+            std::this_thread::yield();
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    static std::size_t &currentWorker()
+    {
+        static thread_local std::size_t index = static_cast<std::size_t>(-1);
+        return index;
+    }
+
+    static ThreadPool *&currentPool()
+    {
+        static thread_local ThreadPool *pool = nullptr;
+        return pool;
+    }
+
+    // Own deque first (LIFO), then steal from the others (FIFO)
+    bool runOne()
+    {
+        std::function<void()> task;
+        std::size_t self = currentPool() == this ? currentWorker() : 0;
+        for (std::size_t k = 0; k < queues.size() && !task; ++k)
+        {
+            std::size_t q = (self + k) % queues.size();
+            std::lock_guard<std::mutex> lock(queues[q]->mutex);
+            if (queues[q]->tasks.empty())
+                continue;
+            if (k == 0 && currentPool() == this)
+            {
+                task = std::move(queues[q]->tasks.back());
+                queues[q]->tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(queues[q]->tasks.front());
+                queues[q]->tasks.pop_front();
+            }
+        }
+        if (!task)
+            return false;
+        task();
+        pending.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    void workerLoop(std::size_t index)
+    {
+        currentWorker() = index;
+        currentPool() = this;
+        while (true)
+        {
+            if (runOne())
+                continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (stopping)
+                return;
+            if (pending.load(std::memory_order_acquire) == 0)
+                wake.wait(lock);
+            else
+                wake.wait_for(lock, std::chrono::milliseconds(1)); // tasks are running elsewhere
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> pending{0};
+    std::atomic<std::size_t> nextQueue{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "waveform.h"
+
+#include <algorithm>
+
+#include "channels.h"
+
+WaveformPyramid::WaveformPyramid(unsigned int channel_count, unsigned int sample_rate, std::size_t base_bucket, std::size_t fanout)
+    : channels(std::max(1u, channel_count)), sample_rate(sample_rate), bucket(std::max<std::size_t>(1, base_bucket)),
+      fanout(std::max<std::size_t>(2, fanout)), partialMin(channels, 32767), partialMax(channels, -32768)
+{
+    pyramid.push_back(Level{bucket, {}, {}});
+}
+
+void WaveformPyramid::feed(const sf::Int16 *samples, std::size_t frames, ThreadPool &pool)
+{
+    std::size_t i = 0;
+    auto accumulate = [&](std::size_t count) {
+        for (std::size_t f = 0; f < count; ++f, ++i)
+        {
+            const sf::Int16 *frame = samples + i * channels;
+            for (unsigned int c = 0; c < channels; ++c)
+            {
+                partialMin[c] = std::min(partialMin[c], frame[c]);
+                partialMax[c] = std::max(partialMax[c], frame[c]);
+            }
+        }
+        partialFrames += count;
+    };
+    auto flushPartial = [&]() {
+        Level &base = pyramid[0];
+        base.min.insert(base.min.end(), partialMin.begin(), partialMin.end());
+        base.max.insert(base.max.end(), partialMax.begin(), partialMax.end());
+        std::fill(partialMin.begin(), partialMin.end(), 32767);
+        std::fill(partialMax.begin(), partialMax.end(), -32768);
+        partialFrames = 0;
+    };
+
+    // Complete the bucket left open by the previous block
+    if (partialFrames > 0)
+    {
+        accumulate(std::min(frames, bucket - partialFrames));
+        if (partialFrames == bucket)
+            flushPartial();
+    }
+
+    // Whole buckets, reduced in parallel straight into level 0
+    std::size_t full = (frames - i) / bucket;
+    if (full > 0)
+    {
+        Level &base = pyramid[0];
+        std::size_t firstBucket = base.min.size() / channels;
+        base.min.resize((firstBucket + full) * channels);
+        base.max.resize((firstBucket + full) * channels);
+        const sf::Int16 *start = samples + i * channels;
+        pool.parallelFor(0, full, 64, [&, start, firstBucket](std::size_t b0, std::size_t b1) {
+            for (std::size_t b = b0; b < b1; ++b)
+            {
+                const sf::Int16 *frame = start + b * bucket * channels;
+                sf::Int16 *lo = base.min.data() + (firstBucket + b) * channels;
+                sf::Int16 *hi = base.max.data() + (firstBucket + b) * channels;
+                std::copy(frame, frame + channels, lo);
+                std::copy(frame, frame + channels, hi);
+                for (std::size_t f = 1; f < bucket; ++f)
+                {
+                    frame += channels;
+                    for (unsigned int c = 0; c < channels; ++c)
+                    {
+                        lo[c] = std::min(lo[c], frame[c]);
+                        hi[c] = std::max(hi[c], frame[c]);
+                    }
+                }
+            }
+        });
+        i += full * bucket;
+    }
+
+    // The rest opens a new partial bucket
+    accumulate(frames - i);
+    position += frames;
+    propagate(false);
+}
+
+void WaveformPyramid::finish()
+{
+    if (partialFrames > 0)
+    {
+        Level &base = pyramid[0];
+        base.min.insert(base.min.end(), partialMin.begin(), partialMin.end());
+        base.max.insert(base.max.end(), partialMax.begin(), partialMax.end());
+        partialFrames = 0;
+    }
+    propagate(true);
+}
+
+// Builds every level from the one below: only whole groups while streaming,
+// the trailing partial groups too once the input is complete
+void WaveformPyramid::propagate(bool final)
+{
+    for (std::size_t k = 0; k < pyramid.size(); ++k)
+    {
+        std::size_t have = pyramid[k].min.size() / channels;
+        std::size_t target = final ? (have + fanout - 1) / fanout : have / fanout;
+        if (k + 1 == pyramid.size())
+        {
+            if (have <= 1 || target == 0)
+                break;
+            pyramid.push_back(Level{pyramid[k].bucket * fanout, {}, {}});
+        }
+
+        const Level &down = pyramid[k];
+        Level &up = pyramid[k + 1];
+        for (std::size_t g = up.min.size() / channels; g < target; ++g)
+        {
+            std::size_t last = std::min(have, (g + 1) * fanout);
+            for (unsigned int c = 0; c < channels; ++c)
+            {
+                sf::Int16 lo = 32767, hi = -32768;
+                for (std::size_t b = g * fanout; b < last; ++b)
+                {
+                    lo = std::min(lo, down.min[b * channels + c]);
+                    hi = std::max(hi, down.max[b * channels + c]);
+                }
+                up.min.push_back(lo);
+                up.max.push_back(hi);
+            }
+        }
+    }
+}
+
+WaveformEnvelope WaveformPyramid::envelope(unsigned int channel, std::uint64_t first, std::uint64_t last, std::size_t columns, int bitsToReduce,
+                                           QuantizerKind quantizer) const
+{
+    WaveformEnvelope result;
+    last = std::min(last, position);
+    if (first >= last || columns == 0 || channel >= channels)
+        return result;
+
+    std::uint64_t span = last - first;
+    // Dither is not monotonic: show the levels it rounds to
+    if (quantizer == QuantizerKind::Tpdf)
+        quantizer = QuantizerKind::MidTread;
+    columns = static_cast<std::size_t>(std::min<std::uint64_t>(columns, (span + bucket - 1) / bucket));
+
+    // Coarsest level that still gives every column at least one whole bucket
+    std::size_t k = 0;
+    while (k + 1 < pyramid.size() && pyramid[k + 1].bucket * columns <= span)
+        ++k;
+    const Level &level = pyramid[k];
+    std::uint64_t count = level.min.size() / channels;
+
+    result.time.reserve(columns);
+    result.min.reserve(columns);
+    result.max.reserve(columns);
+    for (std::size_t p = 0; p < columns; ++p)
+    {
+        std::uint64_t start = first + span * p / columns;
+        std::uint64_t end = first + span * (p + 1) / columns;
+        std::uint64_t b0 = start / level.bucket;
+        std::uint64_t b1 = std::min(count, (end + level.bucket - 1) / level.bucket);
+        int lo = 32767, hi = -32768;
+        for (std::uint64_t b = b0; b < b1; ++b)
+        {
+            lo = std::min<int>(lo, level.min[b * channels + channel]);
+            hi = std::max<int>(hi, level.max[b * channels + channel]);
+        }
+        if (lo > hi)
+            continue;
+        sf::Int16 bounds[2] = {static_cast<sf::Int16>(lo), static_cast<sf::Int16>(hi)};
+        quantizeAudio(bounds, bounds, 2, bitsToReduce, quantizer);
+        lo = bounds[0];
+        hi = bounds[1];
+        result.time.push_back(static_cast<double>(start) / sample_rate);
+        result.min.push_back(lo * int16Scale);
+        result.max.push_back(hi * int16Scale);
+    }
+    return result;
+}
@@ -0,0 +1,71 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <SFML/Config.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "quantize.h"
+#include "thread_pool.h"
+
+// Min / max outline of one channel over a time range, one column per output point
+struct WaveformEnvelope
+{
+    std::vector<double> time; // start of each column, in seconds
+    std::vector<double> min;
+    std::vector<double> max;
+};
+
+// Multi-resolution min / max pyramid of every channel of a streamed file.
+// Level 0 keeps the extremes of each base_bucket samples, every level above
+// merges fanout buckets of the one below. An envelope of any range at any width
+// is answered from the coarsest level that still has one bucket per column, so
+// it costs O(columns) whatever the length of the file. Extremes are kept as
+// raw int16 values, which also gives the envelope of the quantized signal for
+// free: every quantizer but TPDF is monotonic, so it maps the extremes of a
+// bucket to the extremes of the quantized bucket.
+class WaveformPyramid
+{
+public:
+    WaveformPyramid(unsigned int channel_count, unsigned int sample_rate, std::size_t base_bucket = 256, std::size_t fanout = 4);
+
+    // Adds a block of interleaved frames; full buckets are reduced on the pool
+    void feed(const sf::Int16 *samples, std::size_t frames, ThreadPool &pool);
+    // Closes the last partial bucket and the partial groups of every level
+    void finish();
+
+    std::uint64_t frames() const { return position; }
+    std::size_t baseBucket() const { return bucket; }
+    std::size_t levels() const { return pyramid.size(); }
+
+    // Envelope of frames [first, last) of a channel in `columns` columns, scaled
+    // to [-1, 1), after removing bitsToReduce low bits with the given quantizer
+    // (TPDF is shown as mid-tread, without its dither). Columns narrower than the
+    // base bucket are widened to it: read the raw samples for such zooms.
+    WaveformEnvelope envelope(unsigned int channel, std::uint64_t first, std::uint64_t last, std::size_t columns, int bitsToReduce = 0,
+                              QuantizerKind quantizer = QuantizerKind::Truncate) const;
+
+private:
+    struct Level
+    {
+        std::size_t bucket;           // frames per bucket
+        std::vector<sf::Int16> min;   // buckets x channels
+        std::vector<sf::Int16> max;
+    };
+
+    void propagate(bool final);
+
+    unsigned int channels;
+    unsigned int sample_rate;
+    std::size_t bucket;
+    std::size_t fanout;
+    std::vector<Level> pyramid;
+
+    // Bucket being filled across block boundaries
+    std::vector<sf::Int16> partialMin, partialMax;
+    std::size_t partialFrames = 0;
+    std::uint64_t position = 0;
+};
+
+#endif